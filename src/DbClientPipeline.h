@@ -0,0 +1,139 @@
+/**
+ * @file DbClientPipeline.h
+ * @brief A StatementPipeline which executes on a drogon DbClient.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.29
+ *
+ * This header file binds the values of rendered statements to a
+ * `drogon::orm::DbClient`. It is kept apart from StatementPipeline.h so that
+ * only code which executes statements depends on the ORM of drogon.
+ */
+#pragma once
+
+#include <drogon/orm/DbClient.h>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+#include "StatementPipeline.h"
+
+namespace tl::sql
+{
+
+/**
+ * @brief Whether `value` can be bound to a placeholder by dbClientExecutor.
+ * @date 2026-10-17
+ * @since 0.6.29
+ */
+inline bool isBindable(const ParamValue& value)
+{
+    if (auto json = std::get_if<Json::Value>(&value))
+    {
+        return !json->isArray() && !json->isObject();
+    }
+    return !std::holds_alternative<IntArray>(value) &&
+           !std::holds_alternative<Int64Array>(value) &&
+           !std::holds_alternative<ColumnBatch>(value) &&
+           !std::holds_alternative<ColumnRow>(value);
+}
+
+/**
+ * @brief Returns an executor for a StatementPipeline which binds the values
+ * of a statement to its placeholders and runs it with `client`.
+ *
+ * Booleans, numbers, strings and null bind as themselves, also inside a
+ * Json::Value. Arrays and column batches cannot be bound, and the statement
+ * fails before it is passed to the client.
+ *
+ * @date 2026-10-17
+ * @since 0.6.28
+ */
+inline StatementPipeline::Executor dbClientExecutor(
+    drogon::orm::DbClientPtr client)
+{
+    return [client = std::move(client)](
+               Statement statement, StatementPipeline::DoneCallback done) {
+        // Checked before binding, since a SqlBinder which is destroyed without
+        // having been executed still runs its statement
+        for (const auto& arg : statement.args)
+        {
+            if (!isBindable(arg))
+            {
+                throw std::runtime_error(
+                    "Cannot bind an array, a column batch or a JSON object");
+            }
+        }
+        auto binder = *client << std::move(statement.sql);
+        for (auto& arg : statement.args)
+        {
+            std::visit(
+                [&binder](auto& value) {
+                    using T = std::decay_t<decltype(value)>;
+                    if constexpr (std::is_same_v<T, Json::Value>)
+                    {
+                        if (value.isNull())
+                        {
+                            binder << nullptr;
+                        }
+                        else if (value.isBool())
+                        {
+                            binder << value.asBool();
+                        }
+                        else if (value.isInt64())
+                        {
+                            binder << value.asInt64();
+                        }
+                        else if (value.isUInt64())
+                        {
+                            binder << value.asUInt64();
+                        }
+                        else if (value.isNumeric())
+                        {
+                            binder << value.asDouble();
+                        }
+                        else
+                        {
+                            binder << value.asString();
+                        }
+                    }
+                    else if constexpr (std::is_same_v<T, std::string> ||
+                                       std::is_same_v<T, int32_t> ||
+                                       std::is_same_v<T, int64_t> ||
+                                       std::is_same_v<T, double> ||
+                                       std::is_same_v<T, bool>)
+                    {
+                        binder << std::move(value);
+                    }
+                    // Other types were rejected above
+                },
+                arg);
+        }
+        binder >> [done](const drogon::orm::Result&) { done(nullptr); };
+        binder >> [done](const std::exception_ptr& error) { done(error); };
+        binder.exec();
+    };
+}
+
+/**
+ * @brief Creates a StatementPipeline which executes on `client`, with the
+ * placeholders of its database.
+ *
+ * @date 2026-10-17
+ * @since 0.6.28
+ */
+inline std::unique_ptr<StatementPipeline> makeDbClientPipeline(
+    SqlGenerator& generator,
+    const drogon::orm::DbClientPtr& client,
+    size_t capacity = 64,
+    bool ordered = true)
+{
+    auto style = client->type() == drogon::orm::ClientType::PostgreSQL
+                     ? PlaceholderStyle::Dollar
+                     : PlaceholderStyle::Question;
+    return std::make_unique<StatementPipeline>(
+        generator, dbClientExecutor(client), capacity, ordered, style);
+}
+
+}  // namespace tl::sql
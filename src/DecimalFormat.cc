@@ -0,0 +1,120 @@
+/**
+ * @file DecimalFormat.cc
+ * @brief Implementation of the batch integer formatting.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.29
+ */
+#include "DecimalFormat.h"
+#include <charconv>
+#include <cmath>
+
+using namespace ::std;
+using namespace ::tl::sql;
+
+namespace
+{
+/// Size of the stack block the elements are formatted into.
+constexpr size_t kBlockBytes = 8192;
+
+inline char *copyText(string_view text, char *out)
+{
+    // The data of an empty string_view may be null
+    if (!text.empty())
+    {
+        memcpy(out, text.data(), text.size());
+    }
+    return out + text.size();
+}
+
+template <typename Int>
+void appendDecimalsImpl(const Int *values,
+                        size_t count,
+                        const JoinFormat &format,
+                        string &sql)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    auto elementBytes = format.prefix.size() + kMaxDecimalBytes +
+                        format.suffix.size() + format.separator.size();
+    // Long text around the elements would leave little room in a block
+    if (elementBytes > kBlockBytes / 8)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i > 0)
+            {
+                sql += format.separator;
+            }
+            sql += format.prefix;
+            appendDecimal(values[i], sql);
+            sql += format.suffix;
+        }
+        return;
+    }
+
+    // Between two elements the suffix, separator and prefix are one text
+    char between[kBlockBytes / 8];
+    auto betweenEnd = copyText(format.suffix, between);
+    betweenEnd = copyText(format.separator, betweenEnd);
+    betweenEnd = copyText(format.prefix, betweenEnd);
+    auto betweenBytes = static_cast<size_t>(betweenEnd - between);
+
+    char block[kBlockBytes];
+    auto out = copyText(format.prefix, block);
+    out = formatDecimal(values[0], out);
+    // Room is left for one more element and the suffix after the last one
+    auto last = block + kBlockBytes - elementBytes - format.suffix.size();
+    for (size_t i = 1; i < count; ++i)
+    {
+        if (out > last)
+        {
+            sql.append(block, out);
+            out = block;
+        }
+        // A single separator character, such as ',', is the common case
+        if (betweenBytes == 1)
+        {
+            *out++ = between[0];
+        }
+        else
+        {
+            memcpy(out, between, betweenBytes);
+            out += betweenBytes;
+        }
+        out = formatDecimal(values[i], out);
+    }
+    out = copyText(format.suffix, out);
+    sql.append(block, out);
+}
+}  // namespace
+
+void tl::sql::appendDecimals(const int32_t *values,
+                             size_t count,
+                             const JoinFormat &format,
+                             string &sql)
+{
+    appendDecimalsImpl(values, count, format, sql);
+}
+
+void tl::sql::appendDecimals(const int64_t *values,
+                             size_t count,
+                             const JoinFormat &format,
+                             string &sql)
+{
+    appendDecimalsImpl(values, count, format, sql);
+}
+
+char *tl::sql::formatDouble(double value, char *out)
+{
+    if (!isfinite(value))
+    {
+        memcpy(out, "NULL", 4);
+        return out + 4;
+    }
+    // Without a format, to_chars writes the shortest round-trip text
+    return to_chars(out, out + kMaxDoubleBytes, value).ptr;
+}
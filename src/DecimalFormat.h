@@ -0,0 +1,210 @@
+/**
+ * @file DecimalFormat.h
+ * @brief Integer to decimal text conversion of the SqlGenerator plugin.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.17
+ *
+ * This header file contains formatDecimal, which writes one integer into a
+ * caller-provided buffer two digits at a time, formatDouble, which writes the
+ * shortest text that reads back as the same double, and appendDecimals, which
+ * prints a whole array of integers, such as the ids of an `IN (...)` list,
+ * into an output string without a temporary string per element.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace tl::sql
+{
+
+/// Upper bound of the length of a formatted int64_t, "-9223372036854775808".
+constexpr size_t kMaxDecimalBytes = 20;
+
+/// Upper bound of the length of a formatted double, such as
+/// "-2.2250738585072014e-308".
+constexpr size_t kMaxDoubleBytes = 24;
+
+namespace detail
+{
+/// The decimal text of 00 to 99, indexed by twice the number.
+inline constexpr char kDigitPairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/// Powers of ten from 10^0 to 10^19.
+inline constexpr uint64_t kPowersOf10[20] = {1ull,
+                                             10ull,
+                                             100ull,
+                                             1000ull,
+                                             10000ull,
+                                             100000ull,
+                                             1000000ull,
+                                             10000000ull,
+                                             100000000ull,
+                                             1000000000ull,
+                                             10000000000ull,
+                                             100000000000ull,
+                                             1000000000000ull,
+                                             10000000000000ull,
+                                             100000000000000ull,
+                                             1000000000000000ull,
+                                             10000000000000000ull,
+                                             100000000000000000ull,
+                                             1000000000000000000ull,
+                                             10000000000000000000ull};
+
+/**
+ * @brief Returns the number of digits of `value` without branches, which
+ * matters for lists of numbers of varying lengths.
+ */
+inline unsigned decimalLength(uint64_t value)
+{
+    // 1233 / 4096 approximates log10(2), and 0 is counted like 1
+    value |= 1;
+    unsigned bits = 64 - __builtin_clzll(value);
+    unsigned length = bits * 1233 >> 12;
+    return length + (value >= kPowersOf10[length]);
+}
+
+template <typename Unsigned>
+inline char *formatUnsigned(Unsigned value, char *out)
+{
+    auto end = out + decimalLength(value);
+    auto pos = end;
+    while (value >= 100)
+    {
+        auto pair = static_cast<unsigned>(value % 100) * 2;
+        value /= 100;
+        pos -= 2;
+        std::memcpy(pos, kDigitPairs + pair, 2);
+    }
+    if (value >= 10)
+    {
+        auto pair = static_cast<unsigned>(value) * 2;
+        std::memcpy(pos - 2, kDigitPairs + pair, 2);
+    }
+    else
+    {
+        pos[-1] = static_cast<char>('0' + value);
+    }
+    return end;
+}
+}  // namespace detail
+
+/**
+ * @brief Writes the decimal text of `value` to `out`, which must have room
+ * for kMaxDecimalBytes characters.
+ * @return The end of the written text.
+ * @date 2026-10-17
+ * @since 0.6.16
+ */
+inline char *formatDecimal(int32_t value, char *out)
+{
+    auto magnitude = static_cast<uint32_t>(value);
+    if (value < 0)
+    {
+        *out++ = '-';
+        magnitude = 0u - magnitude;
+    }
+    return detail::formatUnsigned(magnitude, out);
+}
+
+/**
+ * @overload
+ */
+inline char *formatDecimal(int64_t value, char *out)
+{
+    auto magnitude = static_cast<uint64_t>(value);
+    if (value < 0)
+    {
+        *out++ = '-';
+        magnitude = 0u - magnitude;
+    }
+    // 32-bit division is considerably cheaper
+    if (magnitude <= UINT32_MAX)
+    {
+        return detail::formatUnsigned(static_cast<uint32_t>(magnitude), out);
+    }
+    return detail::formatUnsigned(magnitude, out);
+}
+
+/**
+ * @brief Appends the decimal text of `value` to `sql`, like
+ * `sql += std::to_string(value)` without the temporary string.
+ * @date 2026-10-17
+ * @since 0.6.16
+ */
+inline void appendDecimal(int64_t value, std::string &sql)
+{
+    char digits[kMaxDecimalBytes];
+    sql.append(digits, formatDecimal(value, digits));
+}
+
+/**
+ * @brief Writes the shortest decimal text of `value` which reads back as the
+ * same double, such as "0.1" or "1e+100", to `out`, which must have room for
+ * kMaxDoubleBytes characters. NaN and infinities have no SQL literal and are
+ * written as NULL.
+ * @return The end of the written text.
+ * @date 2026-10-17
+ * @since 0.6.17
+ */
+char *formatDouble(double value, char *out);
+
+/**
+ * @brief Appends the text of formatDouble to `sql`.
+ * @date 2026-10-17
+ * @since 0.6.17
+ */
+inline void appendDouble(double value, std::string &sql)
+{
+    char digits[kMaxDoubleBytes];
+    sql.append(digits, formatDouble(value, digits));
+}
+
+/**
+ * @struct JoinFormat
+ * @brief The literal text around the elements printed by appendDecimals.
+ * @date 2026-10-17
+ * @since 0.6.16
+ */
+struct JoinFormat
+{
+    std::string_view prefix;     ///< Text before every element.
+    std::string_view suffix;     ///< Text after every element.
+    std::string_view separator;  ///< Text between two elements.
+};
+
+/**
+ * @brief Appends `count` integers to `sql`, each between the prefix and the
+ * suffix of `format` and separated by its separator.
+ *
+ * The elements are formatted into a block on the stack which is appended
+ * when full, so `sql` is grown and bounds-checked once per block instead of
+ * several times per element.
+ *
+ * @date 2026-10-17
+ * @since 0.6.16
+ */
+void appendDecimals(const int32_t *values,
+                    size_t count,
+                    const JoinFormat &format,
+                    std::string &sql);
+
+/**
+ * @overload
+ */
+void appendDecimals(const int64_t *values,
+                    size_t count,
+                    const JoinFormat &format,
+                    std::string &sql);
+
+}  // namespace tl::sql
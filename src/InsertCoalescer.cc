@@ -0,0 +1,188 @@
+/**
+ * @file InsertCoalescer.cc
+ * @brief Implementation of the batching of single-row inserts.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.27
+ */
+#include "InsertCoalescer.h"
+
+using namespace ::std;
+using namespace ::tl::sql;
+
+InsertCoalescer::InsertCoalescer(SqlGenerator &generator,
+                                 FlushCallback callback,
+                                 size_t maxRows,
+                                 chrono::milliseconds maxDelay,
+                                 ExceptionCallback exceptionCallback)
+    : generator_(generator),
+      callback_(std::move(callback)),
+      exceptionCallback_(std::move(exceptionCallback)),
+      maxRows_(max<size_t>(maxRows, 1)),
+      maxDelay_(maxDelay)
+{
+    if (maxDelay_.count() > 0)
+    {
+        timer_ = thread([this] { runTimer(); });
+    }
+}
+
+InsertCoalescer::~InsertCoalescer()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    timerWakeup_.notify_one();
+    if (timer_.joinable())
+    {
+        timer_.join();
+    }
+    flush();
+}
+
+void InsertCoalescer::add(const string &name, ParamList row)
+{
+    if (!generator_.hasValuesRow(name))
+    {
+        // Throws the error of the render now rather than at the flush
+        generator_.getInsertSql(name, {});
+    }
+    vector<ParamList> full;
+    auto first = false;
+    {
+        lock_guard<mutex> lock(mutex_);
+        auto &batch = batches_[name];
+        if (batch.rows.empty())
+        {
+            batch.deadline = chrono::steady_clock::now() + maxDelay_;
+            batch.rows.reserve(maxRows_);
+            first = true;
+        }
+        batch.rows.push_back(std::move(row));
+        if (batch.rows.size() >= maxRows_)
+        {
+            full.swap(batch.rows);
+        }
+    }
+    if (!full.empty())
+    {
+        flushRows(name, std::move(full));
+    }
+    else if (first && timer_.joinable())
+    {
+        // The deadline may be earlier than the one the timer waits for
+        timerWakeup_.notify_one();
+    }
+}
+
+void InsertCoalescer::flush()
+{
+    vector<pair<string, vector<ParamList>>> due;
+    {
+        lock_guard<mutex> lock(mutex_);
+        for (auto &[name, batch] : batches_)
+        {
+            if (!batch.rows.empty())
+            {
+                due.emplace_back(name, std::move(batch.rows));
+                batch.rows.clear();
+            }
+        }
+    }
+    for (auto &[name, rows] : due)
+    {
+        flushRows(name, std::move(rows));
+    }
+}
+
+size_t InsertCoalescer::pendingRows() const
+{
+    lock_guard<mutex> lock(mutex_);
+    size_t rows = 0;
+    for (const auto &[name, batch] : batches_)
+    {
+        rows += batch.rows.size();
+    }
+    return rows;
+}
+
+void InsertCoalescer::flushRows(const string &name, vector<ParamList> rows)
+{
+    try
+    {
+        CoalescedInsert insert;
+        insert.name = name;
+        insert.rows = rows.size();
+        insert.sql = generator_.getInsertSql(name, rows);
+        callback_(std::move(insert));
+    }
+    catch (...)
+    {
+        if (exceptionCallback_)
+        {
+            exceptionCallback_(name, current_exception());
+            return;
+        }
+        try
+        {
+            throw;
+        }
+        catch (const exception &e)
+        {
+            LOG_ERROR << "Failed to flush " << rows.size() << " rows of "
+                      << name << ": " << e.what();
+        }
+        catch (...)
+        {
+            LOG_ERROR << "Failed to flush " << rows.size() << " rows of "
+                      << name;
+        }
+    }
+}
+
+void InsertCoalescer::runTimer()
+{
+    unique_lock<mutex> lock(mutex_);
+    while (!stopping_)
+    {
+        auto now = chrono::steady_clock::now();
+        auto next = chrono::steady_clock::time_point::max();
+        vector<pair<string, vector<ParamList>>> due;
+        for (auto &[name, batch] : batches_)
+        {
+            if (batch.rows.empty())
+            {
+                continue;
+            }
+            if (batch.deadline <= now)
+            {
+                due.emplace_back(name, std::move(batch.rows));
+                batch.rows.clear();
+            }
+            else
+            {
+                next = min(next, batch.deadline);
+            }
+        }
+        if (!due.empty())
+        {
+            lock.unlock();
+            for (auto &[name, rows] : due)
+            {
+                flushRows(name, std::move(rows));
+            }
+            lock.lock();
+            continue;
+        }
+        if (next == chrono::steady_clock::time_point::max())
+        {
+            timerWakeup_.wait(lock);
+        }
+        else
+        {
+            timerWakeup_.wait_until(lock, next);
+        }
+    }
+}
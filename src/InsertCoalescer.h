@@ -0,0 +1,150 @@
+/**
+ * @file InsertCoalescer.h
+ * @brief Batching of single-row inserts of the SqlGenerator plugin.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.27
+ *
+ * This header file contains the CoalescedInsert struct and the
+ * InsertCoalescer class. Single-row parameter lists of `INSERT ... VALUES`
+ * statements are buffered per statement and rendered as one multi-row
+ * statement when enough rows are buffered or the oldest row has waited long
+ * enough, so that a high rate of inserts takes few round trips.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "SqlGenerator.h"
+
+namespace tl::sql
+{
+
+/**
+ * @struct CoalescedInsert
+ * @brief A multi-row statement rendered by an InsertCoalescer.
+ *
+ * @date 2026-10-17
+ * @since 0.6.27
+ */
+struct CoalescedInsert
+{
+    std::string name;  ///< The name of the SQL statement.
+    std::string sql;   ///< The statement with one row per buffered row.
+    size_t rows{0};    ///< The number of rows.
+};
+
+/**
+ * @class InsertCoalescer
+ * @brief Buffers single-row inserts per SQL statement and flushes them as
+ * multi-row statements rendered by SqlGenerator::getInsertSql.
+ *
+ * A statement is flushed on the adding thread as soon as it has `maxRows`
+ * rows, and on a timer thread of the coalescer when its oldest row has
+ * waited `maxDelay`. The flush callback may therefore be called from several
+ * threads at the same time, also for the same statement. Rows which are
+ * still buffered are flushed when the coalescer is destroyed.
+ *
+ * @code
+ * InsertCoalescer coalescer(*generator, [db](CoalescedInsert insert) {
+ *     db->execSqlAsync(insert.sql, ...);
+ * });
+ * coalescer.add("insert_user", {{"username", name}});
+ * @endcode
+ *
+ * @date 2026-10-17
+ * @since 0.6.27
+ */
+class InsertCoalescer
+{
+  public:
+    using FlushCallback = std::function<void(CoalescedInsert)>;
+    using ExceptionCallback =
+        std::function<void(const std::string&, const std::exception_ptr&)>;
+
+    /**
+     * @param generator Renders the statements; must outlive the coalescer.
+     * @param callback Called with every flushed statement.
+     * @param maxRows The number of rows at which a statement is flushed.
+     * @param maxDelay The longest time a row is buffered; zero flushes
+     * only by the number of rows and by flush().
+     * @param exceptionCallback Called with the name of the statement if
+     * rendering or `callback` throws; the error is logged if it is empty.
+     */
+    InsertCoalescer(SqlGenerator& generator,
+                    FlushCallback callback,
+                    size_t maxRows = 1000,
+                    std::chrono::milliseconds maxDelay =
+                        std::chrono::milliseconds(10),
+                    ExceptionCallback exceptionCallback = nullptr);
+
+    /**
+     * @brief Stops the timer thread and flushes the buffered rows.
+     */
+    ~InsertCoalescer();
+
+    InsertCoalescer(const InsertCoalescer&) = delete;
+    InsertCoalescer& operator=(const InsertCoalescer&) = delete;
+
+    /**
+     * @brief Buffers a row of the SQL statement `name`, and flushes the
+     * statement if it has `maxRows` rows.
+     * @throw std::out_of_range If the SQL statement does not exist.
+     * @throw std::runtime_error If the SQL statement has no `VALUES` row.
+     */
+    void add(const std::string& name, ParamList row);
+
+    /**
+     * @brief Flushes the buffered rows of every SQL statement.
+     */
+    void flush();
+
+    /**
+     * @brief Returns the number of buffered rows.
+     */
+    size_t pendingRows() const;
+
+  private:
+    /**
+     * @brief The buffered rows of a SQL statement.
+     */
+    struct Batch
+    {
+        std::vector<ParamList> rows;
+        std::chrono::steady_clock::time_point deadline;  ///< When the first
+                                                         ///< row is due.
+    };
+
+    /**
+     * @brief Renders the rows of a SQL statement and passes them to the
+     * callback. Called without holding the mutex.
+     */
+    void flushRows(const std::string& name, std::vector<ParamList> rows);
+
+    /**
+     * @brief Flushes statements whose deadline has passed until stopped.
+     */
+    void runTimer();
+
+    SqlGenerator& generator_;
+    FlushCallback callback_;
+    ExceptionCallback exceptionCallback_;
+    size_t maxRows_;
+    std::chrono::milliseconds maxDelay_;
+    mutable std::mutex mutex_;             ///< Guards batches_ and stopping_.
+    std::condition_variable timerWakeup_;  ///< Signals a new deadline.
+    std::unordered_map<std::string, Batch>
+        batches_;             ///< Buffered rows, by statement name.
+    bool stopping_{false};    ///< Whether the timer thread is to stop.
+    std::thread timer_;       ///< Flushes by deadline, if maxDelay_ is set.
+};
+
+}  // namespace tl::sql
@@ -0,0 +1,345 @@
+/**
+ * @file RenderMetrics.cc
+ * @brief Implementation of the per-template render metrics.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.29
+ */
+#include "RenderMetrics.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <unordered_map>
+
+using namespace ::std;
+using namespace ::tl::sql;
+
+namespace
+{
+atomic<uint64_t> nextRegistryId{0};
+
+/**
+ * @brief Increments a counter which is only written by the current thread.
+ * A relaxed load and store is enough and avoids a locked instruction.
+ */
+inline void increase(atomic<uint64_t> &counter, uint64_t value = 1)
+{
+    counter.store(counter.load(memory_order_relaxed) + value,
+                  memory_order_relaxed);
+}
+
+/**
+ * @brief Escapes a Prometheus label value.
+ */
+string escapeLabel(const string &value)
+{
+    string result;
+    result.reserve(value.size());
+    for (auto c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (c == '\n')
+        {
+            result += "\\n";
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    return result;
+}
+}  // namespace
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (size_t i = 0; i < kBucketCount; ++i)
+    {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+}
+
+uint64_t LatencyHistogram::quantile(double q) const
+{
+    if (count_ == 0)
+    {
+        return 0;
+    }
+    auto rank = static_cast<uint64_t>(q * count_);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i)
+    {
+        seen += buckets_[i];
+        if (seen > rank)
+        {
+            return bucketLowerBound(i);
+        }
+    }
+    return bucketLowerBound(kBucketCount - 1);
+}
+
+/**
+ * @brief The counters of one thread.
+ */
+struct RenderMetrics::Shard
+{
+    struct Counters
+    {
+        atomic<uint64_t> renders{0};
+        atomic<uint64_t> errors{0};
+        atomic<uint64_t> outputBytes{0};
+        atomic<uint64_t> latencySumNanos{0};
+        array<atomic<uint64_t>, LatencyHistogram::kBucketCount> latency{};
+        /// An open-addressing table, kNone marks a free slot
+        array<atomic<uint64_t>, kFingerprintSlots> fingerprints{};
+        array<atomic<uint64_t>, kFingerprintSlots> fingerprintRenders{};
+        atomic<uint64_t> untrackedFingerprintRenders{0};
+    };
+
+    Shard(size_t size) : counters(size)
+    {
+    }
+
+    vector<Counters> counters;
+};
+
+RenderMetrics::RenderMetrics(vector<string> names)
+    : names_(std::move(names)), id_(nextRegistryId.fetch_add(1))
+{
+}
+
+RenderMetrics::~RenderMetrics() = default;
+
+RenderMetrics::Shard &RenderMetrics::localShard()
+{
+    // Most threads only use one registry, so remember the last one
+    thread_local uint64_t lastId{UINT64_MAX};
+    thread_local Shard *lastShard{nullptr};
+    if (lastId == id_)
+    {
+        return *lastShard;
+    }
+    thread_local unordered_map<uint64_t, Shard *> shards;
+    auto &shard = shards[id_];
+    if (!shard)
+    {
+        lock_guard<mutex> lock(mutex_);
+        shards_.emplace_back(make_unique<Shard>(names_.size()));
+        shard = shards_.back().get();
+    }
+    lastId = id_;
+    lastShard = shard;
+    return *shard;
+}
+
+void RenderMetrics::record(size_t index,
+                           uint64_t nanos,
+                           size_t outputBytes,
+                           uint64_t fingerprint)
+{
+    auto &counters = localShard().counters[index];
+    increase(counters.renders);
+    increase(counters.outputBytes, outputBytes);
+    if (nanos != kNotTimed)
+    {
+        increase(counters.latencySumNanos, nanos);
+        increase(counters.latency[LatencyHistogram::bucketIndex(nanos)]);
+    }
+    if (fingerprint == StatementFingerprint::kNone)
+    {
+        return;
+    }
+    // Only this thread inserts, so a free slot stays free until stored to
+    constexpr auto mask = kFingerprintSlots - 1;
+    static_assert((kFingerprintSlots & mask) == 0);
+    for (size_t probe = 0, slot = fingerprint & mask; probe < kFingerprintSlots;
+         ++probe, slot = (slot + 1) & mask)
+    {
+        auto key = counters.fingerprints[slot].load(memory_order_relaxed);
+        if (key == StatementFingerprint::kNone)
+        {
+            counters.fingerprints[slot].store(fingerprint,
+                                              memory_order_relaxed);
+        }
+        else if (key != fingerprint)
+        {
+            continue;
+        }
+        increase(counters.fingerprintRenders[slot]);
+        return;
+    }
+    increase(counters.untrackedFingerprintRenders);
+}
+
+void RenderMetrics::recordError(size_t index)
+{
+    increase(localShard().counters[index].errors);
+}
+
+vector<TemplateMetrics> RenderMetrics::snapshot() const
+{
+    vector<TemplateMetrics> result(names_.size());
+    for (size_t i = 0; i < names_.size(); ++i)
+    {
+        result[i].name = names_[i];
+    }
+    vector<unordered_map<uint64_t, uint64_t>> fingerprints(names_.size());
+    lock_guard<mutex> lock(mutex_);
+    for (const auto &shard : shards_)
+    {
+        for (size_t i = 0; i < names_.size(); ++i)
+        {
+            const auto &counters = shard->counters[i];
+            auto &metrics = result[i];
+            metrics.renders += counters.renders.load(memory_order_relaxed);
+            metrics.errors += counters.errors.load(memory_order_relaxed);
+            metrics.outputBytes +=
+                counters.outputBytes.load(memory_order_relaxed);
+            metrics.latencySumNanos +=
+                counters.latencySumNanos.load(memory_order_relaxed);
+            for (size_t b = 0; b < LatencyHistogram::kBucketCount; ++b)
+            {
+                auto count = counters.latency[b].load(memory_order_relaxed);
+                if (count)
+                {
+                    metrics.latency.add(b, count);
+                }
+            }
+            for (size_t f = 0; f < kFingerprintSlots; ++f)
+            {
+                auto key = counters.fingerprints[f].load(memory_order_relaxed);
+                auto count =
+                    counters.fingerprintRenders[f].load(memory_order_relaxed);
+                if (key != StatementFingerprint::kNone && count)
+                {
+                    fingerprints[i][key] += count;
+                }
+            }
+            metrics.untrackedFingerprintRenders +=
+                counters.untrackedFingerprintRenders.load(
+                    memory_order_relaxed);
+        }
+    }
+    for (size_t i = 0; i < names_.size(); ++i)
+    {
+        auto &list = result[i].fingerprints;
+        for (const auto &[fingerprint, renders] : fingerprints[i])
+        {
+            list.push_back({fingerprint, renders});
+        }
+        sort(list.begin(),
+             list.end(),
+             [](const FingerprintMetrics &a, const FingerprintMetrics &b) {
+                 return a.renders != b.renders ? a.renders > b.renders
+                                               : a.fingerprint < b.fingerprint;
+             });
+    }
+    return result;
+}
+
+string RenderMetrics::toPrometheus() const
+{
+    auto metrics = snapshot();
+    string result;
+    char buffer[64];
+    auto counter = [&result, &metrics](const char *name,
+                                       const char *help,
+                                       auto getter) {
+        result += "# HELP ";
+        result += name;
+        result += ' ';
+        result += help;
+        result += "\n# TYPE ";
+        result += name;
+        result += " counter\n";
+        for (const auto &item : metrics)
+        {
+            result += name;
+            result += "{template=\"" + escapeLabel(item.name) + "\"} ";
+            result += to_string(getter(item));
+            result += '\n';
+        }
+    };
+    counter("sql_generator_renders_total",
+            "Number of rendered SQL statements.",
+            [](const TemplateMetrics &m) { return m.renders; });
+    counter("sql_generator_render_errors_total",
+            "Number of renders which failed with an exception.",
+            [](const TemplateMetrics &m) { return m.errors; });
+    counter("sql_generator_output_bytes_total",
+            "Total size of the rendered SQL statements.",
+            [](const TemplateMetrics &m) { return m.outputBytes; });
+
+    const char *histogram = "sql_generator_render_duration_seconds";
+    result += "# HELP ";
+    result += histogram;
+    result += " Render time of SQL statements.\n# TYPE ";
+    result += histogram;
+    result += " histogram\n";
+    for (const auto &item : metrics)
+    {
+        auto label = "template=\"" + escapeLabel(item.name) + "\"";
+        const auto &buckets = item.latency.buckets();
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        // Power-of-two bounds fall on bucket boundaries of the histogram
+        for (size_t exponent = 9; exponent <= 30; ++exponent)
+        {
+            auto bound = uint64_t(1) << exponent;
+            while (bucket < buckets.size() &&
+                   LatencyHistogram::bucketLowerBound(bucket) < bound)
+            {
+                cumulative += buckets[bucket++];
+            }
+            snprintf(buffer, sizeof(buffer), "%.9g", bound / 1e9);
+            result += string(histogram) + "_bucket{" + label + ",le=\"" +
+                      buffer + "\"} " + to_string(cumulative) + '\n';
+        }
+        result += string(histogram) + "_bucket{" + label + ",le=\"+Inf\"} " +
+                  to_string(item.latency.count()) + '\n';
+        snprintf(buffer, sizeof(buffer), "%.9g", item.latencySumNanos / 1e9);
+        result += string(histogram) + "_sum{" + label + "} " + buffer + '\n';
+        result += string(histogram) + "_count{" + label + "} " +
+                  to_string(item.latency.count()) + '\n';
+    }
+
+    const char *fingerprinted = "sql_generator_fingerprint_renders_total";
+    auto header = false;
+    for (const auto &item : metrics)
+    {
+        if (item.fingerprints.empty() && item.untrackedFingerprintRenders == 0)
+        {
+            continue;
+        }
+        if (!header)
+        {
+            result += "# HELP ";
+            result += fingerprinted;
+            result += " Number of renders per statement fingerprint.\n";
+            result += "# TYPE ";
+            result += fingerprinted;
+            result += " counter\n";
+            header = true;
+        }
+        auto label = "template=\"" + escapeLabel(item.name) + "\"";
+        for (const auto &[fingerprint, renders] : item.fingerprints)
+        {
+            snprintf(buffer, sizeof(buffer), "%016" PRIx64, fingerprint);
+            result += string(fingerprinted) + "{" + label + ",fingerprint=\"" +
+                      buffer + "\"} " + to_string(renders) + '\n';
+        }
+        if (item.untrackedFingerprintRenders)
+        {
+            result += string(fingerprinted) + "{" + label +
+                      ",fingerprint=\"other\"} " +
+                      to_string(item.untrackedFingerprintRenders) + '\n';
+        }
+    }
+    return result;
+}
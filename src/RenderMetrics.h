@@ -0,0 +1,237 @@
+/**
+ * @file RenderMetrics.h
+ * @brief Per-template render metrics of the SqlGenerator plugin.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.29
+ *
+ * This header file contains the LatencyHistogram and RenderMetrics classes.
+ * RenderMetrics keeps the render count, error count, output bytes and a
+ * latency histogram for every SQL statement, and optionally the number of
+ * renders per statement fingerprint. Each thread writes to its own shard
+ * without locks, and the shards are merged when the metrics are read.
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "StatementFingerprint.h"
+
+namespace tl::sql
+{
+
+/**
+ * @class LatencyHistogram
+ * @brief A log-linear (HDR-style) histogram of durations in nanoseconds.
+ *
+ * Every power of two is split into 8 linear sub-buckets, so a quantile read
+ * from the histogram is at most 12.5% below the real value. Durations above
+ * 2^36 ns (about 68 seconds) are counted in the last bucket.
+ *
+ * @date 2026-10-17
+ * @since 0.6.8
+ */
+class LatencyHistogram
+{
+  public:
+    static constexpr size_t kSubBucketBits = 3;
+    static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+    static constexpr size_t kMaxExponent = 36;
+    static constexpr size_t kBucketCount =
+        (kMaxExponent - kSubBucketBits + 1) * kSubBuckets;
+
+    /**
+     * @brief Returns the index of the bucket counting `nanos`.
+     */
+    static size_t bucketIndex(uint64_t nanos)
+    {
+        if (nanos < kSubBuckets)
+        {
+            return nanos;
+        }
+        size_t exponent = 63 - __builtin_clzll(nanos) - kSubBucketBits + 1;
+        if (exponent > kMaxExponent - kSubBucketBits)
+        {
+            return kBucketCount - 1;
+        }
+        return exponent * kSubBuckets +
+               ((nanos >> (exponent - 1)) & (kSubBuckets - 1));
+    }
+
+    /**
+     * @brief Returns the smallest duration counted by a bucket.
+     */
+    static uint64_t bucketLowerBound(size_t index)
+    {
+        if (index < kSubBuckets)
+        {
+            return index;
+        }
+        size_t exponent = index / kSubBuckets;
+        return uint64_t(kSubBuckets + index % kSubBuckets) << (exponent - 1);
+    }
+
+    /**
+     * @brief Adds `count` durations to a bucket.
+     */
+    void add(size_t index, uint64_t count = 1)
+    {
+        buckets_[index] += count;
+        count_ += count;
+    }
+
+    /**
+     * @brief Adds the counts of another histogram.
+     */
+    void merge(const LatencyHistogram& other);
+
+    /**
+     * @brief Returns the number of recorded durations.
+     */
+    uint64_t count() const
+    {
+        return count_;
+    }
+
+    /**
+     * @brief Returns the lower bound of the bucket containing the quantile
+     * `q` (0 <= q <= 1), or 0 if the histogram is empty.
+     */
+    uint64_t quantile(double q) const;
+
+    const std::array<uint64_t, kBucketCount>& buckets() const
+    {
+        return buckets_;
+    }
+
+  private:
+    std::array<uint64_t, kBucketCount> buckets_{};
+    uint64_t count_{0};
+};
+
+/**
+ * @struct FingerprintMetrics
+ * @brief The number of renders of a SQL statement with one fingerprint.
+ * @see StatementFingerprint
+ * @date 2026-10-17
+ * @since 0.6.26
+ */
+struct FingerprintMetrics
+{
+    uint64_t fingerprint{StatementFingerprint::kNone};
+    uint64_t renders{0};
+};
+
+/**
+ * @struct TemplateMetrics
+ * @brief The metrics of one SQL statement, merged from all threads.
+ *
+ * @date 2026-10-17
+ * @since 0.6.8
+ */
+struct TemplateMetrics
+{
+    std::string name;            ///< The name of the SQL statement.
+    uint64_t renders{0};         ///< Number of successful renders.
+    uint64_t errors{0};          ///< Number of renders which threw.
+    uint64_t outputBytes{0};     ///< Total size of the rendered SQL.
+    uint64_t latencySumNanos{0};  ///< Total time of the timed renders.
+    LatencyHistogram latency;  ///< Render time of the timed successful
+                               ///< renders, see sampleLatency().
+    std::vector<FingerprintMetrics>
+        fingerprints;  ///< Renders per fingerprint, the most frequent first.
+    uint64_t untrackedFingerprintRenders{0};  ///< Fingerprinted renders whose
+                                              ///< fingerprint did not fit in
+                                              ///< the table of a thread.
+};
+
+/**
+ * @class RenderMetrics
+ * @brief Lock-free per-thread render metrics of a set of SQL statements.
+ *
+ * SQL statements are identified by their index in the list of names given to
+ * the constructor. The first record() of a thread creates the shard of that
+ * thread under a mutex; afterwards recording only touches counters that no
+ * other thread writes, with relaxed atomic loads and stores.
+ *
+ * @date 2026-10-17
+ * @since 0.6.8
+ */
+class RenderMetrics
+{
+  public:
+    /// Number of distinct fingerprints counted per SQL statement and thread.
+    static constexpr size_t kFingerprintSlots = 32;
+    /// One in this many renders of a thread is timed for the latency.
+    static constexpr uint32_t kLatencySampleInterval = 64;
+    /// The duration of a render which was not timed.
+    static constexpr uint64_t kNotTimed = UINT64_MAX;
+
+    /**
+     * @brief Whether the current render of the calling thread is to be
+     * timed. Reading the clock twice costs more than the rest of the
+     * metrics, so only one render in kLatencySampleInterval is timed.
+     */
+    static bool sampleLatency()
+    {
+        thread_local uint32_t renders{0};
+        return renders++ % kLatencySampleInterval == 0;
+    }
+
+    RenderMetrics(std::vector<std::string> names);
+
+    ~RenderMetrics();
+
+    /**
+     * @brief Records a successful render.
+     * @param index The index of the SQL statement.
+     * @param nanos The render time in nanoseconds, or kNotTimed if the
+     * render was not sampled for the latency.
+     * @param outputBytes The size of the rendered SQL statement.
+     * @param fingerprint The fingerprint of the render, or
+     * StatementFingerprint::kNone if it was not fingerprinted.
+     */
+    void record(size_t index,
+                uint64_t nanos,
+                size_t outputBytes,
+                uint64_t fingerprint = StatementFingerprint::kNone);
+
+    /**
+     * @brief Records a render which threw an exception. Failed renders are not
+     * part of the latency histogram.
+     */
+    void recordError(size_t index);
+
+    /**
+     * @brief Merges the shards of all threads.
+     * @return The metrics of every SQL statement, in constructor order.
+     */
+    std::vector<TemplateMetrics> snapshot() const;
+
+    /**
+     * @brief Exports the metrics in the Prometheus text exposition format.
+     *
+     * The latency histogram is exported with a bucket for every power of two
+     * between 512 ns and 1 s. Renders per fingerprint are exported with the
+     * fingerprint in hexadecimal, and untracked ones as `other`.
+     */
+    std::string toPrometheus() const;
+
+  private:
+    struct Shard;
+
+    Shard& localShard();
+
+    std::vector<std::string> names_;  ///< Names of the SQL statements.
+    uint64_t id_;  ///< Unique id, used as key of the thread-local shard cache.
+    mutable std::mutex mutex_;  ///< Protects shards_.
+    std::vector<std::unique_ptr<Shard>> shards_;  ///< One shard per thread.
+};
+
+}  // namespace tl::sql
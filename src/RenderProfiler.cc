@@ -0,0 +1,246 @@
+/**
+ * @file RenderProfiler.cc
+ * @brief Implementation of the hierarchical render profiler.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.9
+ */
+#include "RenderProfiler.h"
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+
+using namespace ::std;
+using namespace ::tl::sql;
+
+namespace
+{
+uint64_t nowNanos()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * @brief Returns a small id of the calling thread for the Chrome trace.
+ */
+uint32_t localThreadId()
+{
+    static atomic<uint32_t> nextThreadId{1};
+    thread_local uint32_t threadId{nextThreadId.fetch_add(1)};
+    return threadId;
+}
+}  // namespace
+
+/**
+ * @brief The frames of the render running on one thread.
+ */
+struct RenderProfiler::Session
+{
+    struct Frame
+    {
+        size_t pathLength;  ///< Length of `path` before the frame was entered.
+        size_t labelStart;  ///< Start of the frame label in `path`.
+        uint64_t startNanos;
+        uint64_t childNanos{0};
+        uint64_t childBytes{0};
+    };
+
+    struct Record
+    {
+        string path;
+        uint64_t startNanos;
+        uint64_t durationNanos;
+        uint64_t selfNanos;
+        uint64_t bytes;
+        uint64_t selfBytes;
+    };
+
+    explicit Session(RenderProfiler *profiler) : profiler(profiler)
+    {
+    }
+
+    RenderProfiler *profiler;
+    string path;            ///< Labels of the open frames, joined by ';'.
+    vector<Frame> frames;   ///< The open frames.
+    vector<Record> records; ///< The closed frames.
+};
+
+RenderProfiler::RenderProfiler(size_t maxTraceEvents)
+    : maxTraceEvents_(maxTraceEvents), epochNanos_(nowNanos())
+{
+}
+
+RenderProfiler::Render::Render(RenderProfiler &profiler, const string &name)
+{
+    // A nested render is attributed to the outer one
+    if (current_)
+    {
+        return;
+    }
+    current_ = new Session(&profiler);
+    active_ = true;
+    enter(name);
+}
+
+RenderProfiler::Render::~Render()
+{
+    if (!active_)
+    {
+        return;
+    }
+    leave(bytes_);
+    auto session = current_;
+    current_ = nullptr;
+    session->profiler->merge(*session);
+    delete session;
+}
+
+void RenderProfiler::enter(string label)
+{
+    auto &session = *current_;
+    Session::Frame frame;
+    frame.pathLength = session.path.size();
+    if (!session.path.empty())
+    {
+        session.path += ';';
+    }
+    frame.labelStart = session.path.size();
+    // ';' separates frames and newlines separate stacks
+    for (auto &c : label)
+    {
+        if (c == ';' || c == '\n')
+        {
+            c = ' ';
+        }
+    }
+    session.path += label;
+    frame.startNanos = nowNanos();
+    session.frames.emplace_back(frame);
+}
+
+void RenderProfiler::leave(size_t bytes)
+{
+    auto &session = *current_;
+    auto frame = session.frames.back();
+    session.frames.pop_back();
+    auto duration = nowNanos() - frame.startNanos;
+
+    Session::Record record;
+    record.path = session.path;
+    record.startNanos = frame.startNanos;
+    record.durationNanos = duration;
+    record.selfNanos =
+        duration > frame.childNanos ? duration - frame.childNanos : 0;
+    record.bytes = bytes;
+    // A sub-SQL passed as a parameter may be printed several times or never
+    record.selfBytes = bytes > frame.childBytes ? bytes - frame.childBytes : 0;
+    session.records.emplace_back(std::move(record));
+
+    session.path.resize(frame.pathLength);
+    if (!session.frames.empty())
+    {
+        session.frames.back().childNanos += duration;
+        session.frames.back().childBytes += bytes;
+    }
+}
+
+void RenderProfiler::merge(Session &session)
+{
+    auto threadId = localThreadId();
+    lock_guard<mutex> lock(mutex_);
+    for (auto &record : session.records)
+    {
+        auto &entry = paths_[record.path];
+        if (entry.path.empty())
+        {
+            entry.path = record.path;
+        }
+        ++entry.calls;
+        entry.nanos += record.selfNanos;
+        entry.bytes += record.selfBytes;
+
+        if (traceEvents_.size() >= maxTraceEvents_)
+        {
+            ++droppedEvents_;
+            continue;
+        }
+        auto labelStart = record.path.rfind(';');
+        TraceEvent event;
+        event.label = labelStart == string::npos
+                          ? std::move(record.path)
+                          : record.path.substr(labelStart + 1);
+        event.startNanos = record.startNanos - epochNanos_;
+        event.durationNanos = record.durationNanos;
+        event.bytes = record.bytes;
+        event.threadId = threadId;
+        traceEvents_.emplace_back(std::move(event));
+    }
+}
+
+vector<ProfileEntry> RenderProfiler::entries() const
+{
+    vector<ProfileEntry> result;
+    lock_guard<mutex> lock(mutex_);
+    result.reserve(paths_.size());
+    for (const auto &[path, entry] : paths_)
+    {
+        result.emplace_back(entry);
+    }
+    return result;
+}
+
+string RenderProfiler::foldedStacks(ProfileMetric metric) const
+{
+    string result;
+    for (const auto &entry : entries())
+    {
+        auto value =
+            metric == ProfileMetric::Nanoseconds ? entry.nanos : entry.bytes;
+        if (value == 0)
+        {
+            continue;
+        }
+        result += entry.path;
+        result += ' ';
+        result += to_string(value);
+        result += '\n';
+    }
+    return result;
+}
+
+string RenderProfiler::chromeTrace() const
+{
+    Json::Value trace;
+    auto &events = trace["traceEvents"];
+    events = Json::arrayValue;
+    lock_guard<mutex> lock(mutex_);
+    for (const auto &event : traceEvents_)
+    {
+        Json::Value json;
+        json["name"] = event.label;
+        json["cat"] = "sql";
+        json["ph"] = "X";
+        json["ts"] = event.startNanos / 1e3;
+        json["dur"] = event.durationNanos / 1e3;
+        json["pid"] = 1;
+        json["tid"] = event.threadId;
+        json["args"]["bytes"] = Json::UInt64(event.bytes);
+        events.append(std::move(json));
+    }
+    trace["displayTimeUnit"] = "ns";
+    trace["otherData"]["dropped_events"] = Json::UInt64(droppedEvents_);
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, trace);
+}
+
+void RenderProfiler::clear()
+{
+    lock_guard<mutex> lock(mutex_);
+    paths_.clear();
+    traceEvents_.clear();
+    droppedEvents_ = 0;
+}
@@ -0,0 +1,214 @@
+/**
+ * @file RenderProfiler.h
+ * @brief Hierarchical render profiler of the SqlGenerator plugin.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.15
+ *
+ * This header file contains the RenderProfiler class. While a profiled SQL
+ * statement is rendered, every sub-SQL call, `@if`, `@for` and printed
+ * expression opens a frame. Render time and output bytes are attributed to the
+ * path of frames, and can be exported as folded stacks for flame graphs or as
+ * a Chrome trace-event file.
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace tl::sql
+{
+
+/**
+ * @enum ProfileMetric
+ * @brief The value written after each folded stack.
+ * @date 2026-10-17
+ * @since 0.6.9
+ */
+enum class ProfileMetric
+{
+    Nanoseconds,  ///< Self time of the frame path.
+    OutputBytes   ///< Self output bytes of the frame path.
+};
+
+/**
+ * @struct ProfileEntry
+ * @brief Aggregated self cost of one path of frames.
+ *
+ * "Self" excludes the frames called from the path, so the entries of a render
+ * add up to its total time and output size.
+ *
+ * @date 2026-10-17
+ * @since 0.6.9
+ */
+struct ProfileEntry
+{
+    std::string path;     ///< Frame labels joined by ';', root first.
+    uint64_t calls{0};    ///< Number of times the path was entered.
+    uint64_t nanos{0};    ///< Self time in nanoseconds.
+    uint64_t bytes{0};    ///< Self output bytes.
+};
+
+/**
+ * @class RenderProfiler
+ * @brief Instrumentation-based profiler of SQL rendering.
+ *
+ * The frames of a render are kept by the rendering thread and merged into the
+ * profiler under a mutex when the render ends. When the calling thread is not
+ * rendering a profiled SQL statement, a Scope only reads one thread-local
+ * pointer.
+ *
+ * At most `maxTraceEvents` events are kept for the Chrome trace, later events
+ * are dropped and counted. The folded stacks are not limited.
+ *
+ * @date 2026-10-17
+ * @since 0.6.9
+ */
+class RenderProfiler
+{
+    struct Session;
+
+  public:
+    explicit RenderProfiler(size_t maxTraceEvents = 100000);
+
+    /**
+     * @class Render
+     * @brief Profiles one render on the calling thread during its lifetime.
+     * The label of the root frame is the name of the SQL statement.
+     */
+    class Render
+    {
+      public:
+        Render(RenderProfiler& profiler, const std::string& name);
+
+        ~Render();
+
+        Render(const Render&) = delete;
+        Render& operator=(const Render&) = delete;
+
+        /**
+         * @brief Sets the size of the rendered SQL statement.
+         */
+        void setBytes(size_t bytes)
+        {
+            bytes_ = bytes;
+        }
+
+      private:
+        bool active_{false};
+        size_t bytes_{0};
+    };
+
+    /**
+     * @class Scope
+     * @brief A frame, opened only if the calling thread is in a Render.
+     *
+     * The label is built by calling `label()`, so it costs nothing when
+     * profiling is off. An empty label does not open a frame.
+     */
+    class Scope
+    {
+      public:
+        template <typename Label>
+        explicit Scope(Label&& label)
+        {
+            if (current_)
+            {
+                auto text = label();
+                if (!text.empty())
+                {
+                    enter(std::move(text));
+                    active_ = true;
+                }
+            }
+        }
+
+        ~Scope()
+        {
+            if (active_)
+            {
+                leave(bytes_);
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        /**
+         * @brief Sets the output size of the frame.
+         */
+        void setBytes(size_t bytes)
+        {
+            bytes_ = bytes;
+        }
+
+      private:
+        bool active_{false};
+        size_t bytes_{0};
+    };
+
+    /**
+     * @brief Returns whether the calling thread is in a profiled render.
+     * @date 2026-10-17
+     * @since 0.6.15
+     */
+    static bool active()
+    {
+        return current_ != nullptr;
+    }
+
+    /**
+     * @brief Returns the aggregated paths, sorted by path.
+     */
+    std::vector<ProfileEntry> entries() const;
+
+    /**
+     * @brief Exports the paths in the folded stack format used by
+     * flamegraph.pl and speedscope, one "path value" line per path.
+     */
+    std::string foldedStacks(
+        ProfileMetric metric = ProfileMetric::Nanoseconds) const;
+
+    /**
+     * @brief Exports the recorded frames in the Chrome trace-event format,
+     * which can be opened in chrome://tracing or Perfetto.
+     */
+    std::string chromeTrace() const;
+
+    /**
+     * @brief Discards everything recorded so far.
+     */
+    void clear();
+
+  private:
+    struct TraceEvent
+    {
+        std::string label;
+        uint64_t startNanos;
+        uint64_t durationNanos;
+        uint64_t bytes;
+        uint32_t threadId;
+    };
+
+    static void enter(std::string label);
+
+    static void leave(size_t bytes);
+
+    void merge(Session& session);
+
+    static inline thread_local Session* current_{
+        nullptr};  ///< The render of the calling thread.
+
+    size_t maxTraceEvents_;  ///< Capacity of traceEvents_.
+    uint64_t epochNanos_;    ///< Creation time, the origin of trace events.
+    mutable std::mutex mutex_;  ///< Protects the members below.
+    std::map<std::string, ProfileEntry> paths_;  ///< Aggregated paths.
+    std::vector<TraceEvent> traceEvents_;        ///< Recorded frames.
+    uint64_t droppedEvents_{0};  ///< Frames not kept in traceEvents_.
+};
+
+}  // namespace tl::sql
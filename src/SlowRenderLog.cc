@@ -0,0 +1,60 @@
+/**
+ * @file SlowRenderLog.cc
+ * @brief Implementation of the slow-render log.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.10
+ */
+#include "SlowRenderLog.h"
+
+using namespace ::std;
+using namespace ::tl::sql;
+
+SlowRenderLog::SlowRenderLog(chrono::nanoseconds threshold, size_t capacity)
+    : threshold_(threshold), capacity_(capacity == 0 ? 1 : capacity)
+{
+    renders_.reserve(capacity_);
+}
+
+void SlowRenderLog::record(SlowRender render)
+{
+    lock_guard<mutex> lock(mutex_);
+    if (renders_.size() < capacity_)
+    {
+        renders_.emplace_back(std::move(render));
+    }
+    else
+    {
+        renders_[total_ % capacity_] = std::move(render);
+    }
+    ++total_;
+}
+
+vector<SlowRender> SlowRenderLog::entries() const
+{
+    lock_guard<mutex> lock(mutex_);
+    if (renders_.size() < capacity_)
+    {
+        return renders_;
+    }
+    vector<SlowRender> result;
+    result.reserve(capacity_);
+    auto oldest = total_ % capacity_;
+    result.insert(result.end(), renders_.begin() + oldest, renders_.end());
+    result.insert(result.end(), renders_.begin(), renders_.begin() + oldest);
+    return result;
+}
+
+uint64_t SlowRenderLog::total() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return total_;
+}
+
+void SlowRenderLog::clear()
+{
+    lock_guard<mutex> lock(mutex_);
+    renders_.clear();
+    total_ = 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file SlowRenderLog.h
+ * @brief Bounded log of slow renders of the SqlGenerator plugin.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.10
+ *
+ * This header file contains the SlowRender struct and the SlowRenderLog
+ * class. Renders slower than a threshold are kept in a ring buffer together
+ * with the shape of their parameters, so that pathological inputs can be
+ * found without logging every render.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tl::sql
+{
+
+/**
+ * @struct SlowRender
+ * @brief A render which took longer than the threshold of the SlowRenderLog.
+ *
+ * @date 2026-10-17
+ * @since 0.6.10
+ */
+struct SlowRender
+{
+    std::string name;    ///< The name of the SQL statement.
+    std::chrono::system_clock::time_point time;  ///< When the render ended.
+    uint64_t nanos{0};        ///< The render time in nanoseconds.
+    size_t outputBytes{0};    ///< The size of the rendered SQL statement.
+    std::vector<std::pair<std::string, size_t>>
+        loops;  ///< Label of every executed `@for` and its total iterations.
+    std::string paramShape;  ///< The parameters with their values redacted,
+                             ///< such as `{ids: [5 x int], name: string}`.
+    size_t paramDepth{0};    ///< Nesting depth of the parameters.
+};
+
+/**
+ * @class SlowRenderLog
+ * @brief A ring buffer of the most recent slow renders.
+ *
+ * The SqlGenerator measures every render and only builds a SlowRender when
+ * the render took at least `threshold()`, so the mutex of the log is not taken
+ * on the fast path.
+ *
+ * @date 2026-10-17
+ * @since 0.6.10
+ */
+class SlowRenderLog
+{
+  public:
+    /**
+     * @param threshold Renders taking at least this long are recorded.
+     * @param capacity The number of renders kept, older ones are overwritten.
+     */
+    SlowRenderLog(std::chrono::nanoseconds threshold, size_t capacity);
+
+    std::chrono::nanoseconds threshold() const
+    {
+        return threshold_;
+    }
+
+    /**
+     * @brief Adds a slow render, overwriting the oldest one if full.
+     */
+    void record(SlowRender render);
+
+    /**
+     * @brief Returns the kept renders, oldest first.
+     */
+    std::vector<SlowRender> entries() const;
+
+    /**
+     * @brief Returns the number of slow renders recorded so far, including
+     * those which were overwritten.
+     */
+    uint64_t total() const;
+
+    /**
+     * @brief Discards all kept renders.
+     */
+    void clear();
+
+  private:
+    std::chrono::nanoseconds threshold_;  ///< Minimum render time to record.
+    size_t capacity_;                     ///< Capacity of the ring buffer.
+    mutable std::mutex mutex_;            ///< Protects the members below.
+    std::vector<SlowRender> renders_;     ///< The ring buffer.
+    uint64_t total_{0};  ///< Renders recorded, renders_[total_ % capacity_]
+                         ///< is the next to be overwritten.
+};
+
+}  // namespace tl::sql
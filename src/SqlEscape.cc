@@ -0,0 +1,187 @@
+/**
+ * @file SqlEscape.cc
+ * @brief Implementation of the escaping of printed parameters.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.29
+ */
+#include "SqlEscape.h"
+#include <cstdint>
+#include <cstring>
+
+using namespace ::std;
+using namespace ::tl::sql;
+
+namespace
+{
+constexpr uint64_t kLowBits = 0x0101010101010101;
+constexpr uint64_t kHighBits = 0x8080808080808080;
+
+/**
+ * @brief Sets the high bit of the bytes of `word` which equal `c`. Bytes above
+ * a match may be set as well, but the lowest set byte is always a match.
+ */
+inline uint64_t matchByte(uint64_t word, char c)
+{
+    auto x = word ^ (kLowBits * static_cast<unsigned char>(c));
+    return (x - kLowBits) & ~x & kHighBits;
+}
+
+/**
+ * @brief Returns the first of `specials` in [pos, end), or end. Eight bytes
+ * are tested at a time.
+ */
+const char *findSpecial(const char *pos, const char *end, string_view specials)
+{
+    if (specials.size() == 1)
+    {
+        // memchr is vectorized by the C library
+        auto found = memchr(pos, specials[0], end - pos);
+        return found ? static_cast<const char *>(found) : end;
+    }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; end - pos >= 8; pos += 8)
+    {
+        uint64_t word;
+        memcpy(&word, pos, sizeof(word));
+        uint64_t found = 0;
+        for (auto c : specials)
+        {
+            found |= matchByte(word, c);
+        }
+        if (found)
+        {
+            return pos + (__builtin_ctzll(found) >> 3);
+        }
+    }
+#endif
+    for (; pos != end; ++pos)
+    {
+        if (specials.find(*pos) != string_view::npos)
+        {
+            return pos;
+        }
+    }
+    return end;
+}
+
+/**
+ * @brief Appends `text` to `sql` with `quote` doubled and the other
+ * `specials` prefixed with \. A \ becomes \\\\ instead if
+ * `doubleBackslash` is set.
+ */
+void appendWithSpecials(string_view text,
+                        string_view specials,
+                        char quote,
+                        bool doubleBackslash,
+                        string &sql)
+{
+    auto pos = text.data();
+    auto end = pos + text.size();
+    for (;;)
+    {
+        auto special = findSpecial(pos, end, specials);
+        sql.append(pos, special);
+        if (special == end)
+        {
+            return;
+        }
+        // Quotes are doubled, backslashes and LIKE wildcards get a backslash
+        sql += *special == quote ? quote : '\\';
+        sql += *special;
+        if (*special == '\\' && doubleBackslash)
+        {
+            // Unescaped once by the literal and once by the pattern
+            sql += "\\\\";
+        }
+        pos = special + 1;
+    }
+}
+}  // namespace
+
+optional<EscapeMode> tl::sql::parseEscapeMode(string_view name)
+{
+    if (name == "none")
+    {
+        return EscapeMode::None;
+    }
+    if (name == "literal")
+    {
+        return EscapeMode::Literal;
+    }
+    if (name == "identifier")
+    {
+        return EscapeMode::Identifier;
+    }
+    if (name == "like")
+    {
+        return EscapeMode::Like;
+    }
+    if (name == "mysql_literal")
+    {
+        return EscapeMode::MysqlLiteral;
+    }
+    if (name == "mysql_like")
+    {
+        return EscapeMode::MysqlLike;
+    }
+    return nullopt;
+}
+
+const char *tl::sql::escapeModeName(EscapeMode mode)
+{
+    switch (mode)
+    {
+        case EscapeMode::None:
+            return "none";
+        case EscapeMode::Literal:
+            return "literal";
+        case EscapeMode::Identifier:
+            return "identifier";
+        case EscapeMode::Like:
+            return "like";
+        case EscapeMode::MysqlLiteral:
+            return "mysql_literal";
+        case EscapeMode::MysqlLike:
+            return "mysql_like";
+    }
+    return "";
+}
+
+void tl::sql::appendEscaped(string_view text, EscapeMode mode, string &sql)
+{
+    if (text.empty())
+    {
+        return;
+    }
+    string_view specials;
+    char quote = '\'';
+    switch (mode)
+    {
+        case EscapeMode::None:
+            sql += text;
+            return;
+        case EscapeMode::Literal:
+            specials = "'";
+            break;
+        case EscapeMode::Identifier:
+            specials = "\"";
+            quote = '"';
+            break;
+        case EscapeMode::Like:
+        case EscapeMode::MysqlLike:
+            specials = "'%_\\";
+            break;
+        case EscapeMode::MysqlLiteral:
+            specials = "'\\";
+            break;
+    }
+    appendWithSpecials(
+        text, specials, quote, mode == EscapeMode::MysqlLike, sql);
+}
+
+void tl::sql::appendLikePattern(string_view text, string &pattern)
+{
+    appendWithSpecials(text, "%_\\", '\0', false, pattern);
+}
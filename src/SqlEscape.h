@@ -0,0 +1,87 @@
+/**
+ * @file SqlEscape.h
+ * @brief Escaping of printed parameters of the SqlGenerator plugin.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.29
+ *
+ * This header file contains the EscapeMode enum and appendEscaped, which
+ * copies a string into the output with the characters that are special in a
+ * string literal, a quoted identifier or a LIKE pattern escaped. Runs of
+ * characters which need no escaping are found a word at a time and copied
+ * as a whole.
+ */
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace tl::sql
+{
+
+/**
+ * @enum EscapeMode
+ * @brief How a string printed by `${}` is escaped. The template provides the
+ * surrounding quotes, such as `'${name, escape='literal'}'`.
+ *
+ * Literal and Like follow standard SQL, where \ is an ordinary character of
+ * a string literal: they are safe on PostgreSQL with
+ * standard_conforming_strings on (the default since 9.1) and on SQLite. On
+ * MySQL and MariaDB, where \ escapes the next character of a string literal
+ * unless the NO_BACKSLASH_ESCAPES SQL mode is set, a \ of the text could
+ * close the literal, so MysqlLiteral and MysqlLike are used there, as well
+ * as on PostgreSQL with standard_conforming_strings off.
+ *
+ * @date 2026-10-17
+ * @since 0.6.18
+ */
+enum class EscapeMode
+{
+    None,          ///< Printed as it is.
+    Literal,       ///< Inside '...': ' is doubled.
+    Identifier,    ///< Inside "...": " is doubled.
+    Like,          ///< Inside '...' used as a LIKE pattern: ' is doubled and
+                   ///< %, _ and \ are prefixed with \, the default LIKE
+                   ///< escape.
+    MysqlLiteral,  ///< Inside '...' on MySQL: ' is doubled and \ is
+                   ///< prefixed with \.
+    MysqlLike,     ///< Inside '...' used as a LIKE pattern on MySQL: ' is
+                   ///< doubled, % and _ are prefixed with \ and \ becomes
+                   ///< \\\\, which the literal and the pattern unescape.
+};
+
+/**
+ * @brief Returns the mode named `name` ("none", "literal", "identifier",
+ * "like", "mysql_literal" or "mysql_like"), or nullopt if there is no such
+ * mode.
+ * @date 2026-10-17
+ * @since 0.6.18
+ */
+std::optional<EscapeMode> parseEscapeMode(std::string_view name);
+
+/**
+ * @brief Returns the name of `mode` as accepted by parseEscapeMode.
+ * @date 2026-10-17
+ * @since 0.6.18
+ */
+const char *escapeModeName(EscapeMode mode);
+
+/**
+ * @brief Appends `text` to `sql`, escaped according to `mode`.
+ * @date 2026-10-17
+ * @since 0.6.18
+ */
+void appendEscaped(std::string_view text, EscapeMode mode, std::string &sql);
+
+/**
+ * @brief Appends `text` to a LIKE pattern which is bound to a placeholder
+ * rather than printed inside quotes: %, _ and \ are prefixed with \, quotes
+ * are left as they are.
+ * @date 2026-10-17
+ * @since 0.6.29
+ */
+void appendLikePattern(std::string_view text, std::string &pattern);
+
+}  // namespace tl::sql
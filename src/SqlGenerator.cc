@@ -4,8 +4,8 @@
  * framework for generating SQL statements dynamically.
  *
  * @author tanglong3bf
- * @date 2025-02-15
- * @version 0.6.4
+ * @date 2026-10-17
+ * @version 0.6.29
  *
  * This implementation file contains the definitions for the SqlGenerator
  * library, including the Token, Lexer, Parser, and SqlGenerator classes. The
@@ -13,1453 +13,5453 @@
  * by supporting parameter substitution and sub-SQL inclusion.
  */
 #include "SqlGenerator.h"
+#include <drogon/HttpAppFramework.h>
 #include <drogon/utils/Utilities.h>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <unordered_set>
+#include <utility>
 
 using namespace ::std;
 using namespace ::tl::sql;
 using namespace ::drogon;
 using namespace ::drogon::utils;
 
-Token Lexer::next()
+#ifdef TL_SQL_INSTRUMENTATION
+namespace
 {
-    if (done())
-    {
-        return {Done};
-    }
-    static const unordered_map<char, TokenType> tokenMap = {
-        {'(', LParen},
-        {')', RParen},
-        {',', Comma},
-        {'@', At},
-        {'$', Dollar},
-        {'{', LBrace},
-        {'}', RBrace},
-        {'[', LBracket},
-        {']', RBracket},
-        {'.', Dot},
-    };
-    static const unordered_map<string, TokenType> keywordMap = {
-        {"and", And},
-        {"or", Or},
-        {"not", Not},
-        {"if", If},
-        {"else", Else},
-        {"elif", ElIf},
-        {"endif", EndIf},
-        {"for", For},
-        {"separator", Separator},
-        {"in", In},
-        {"null", Null},
-        {"endfor", EndFor},
-    };
-    auto c = sql_[pos_];
-    // Non-special syntax characters
-    if (parenDepth_ == 0)
+/**
+ * @brief Allocation counters of one thread. It must stay a trivial type, as it
+ * is used by operator new before any constructor could run.
+ */
+struct AllocationTracker
+{
+    size_t allocations;
+    size_t bytes;
+    int64_t live;  ///< Negative when freeing memory of other threads.
+    int64_t peak;
+};
+
+thread_local AllocationTracker tracker;
+thread_local RenderStats renderStats;
+
+/// Space in front of each allocation which stores its size.
+constexpr size_t kHeaderSize = alignof(max_align_t);
+
+/**
+ * @brief Runs `f` without counting the allocations it makes, so that the
+ * bookkeeping of the instrumentation does not show up in the statistics.
+ * Memory it keeps, such as the entries of renderStats, is left out of the
+ * live bytes as well.
+ */
+template <typename F>
+void uncounted(F &&f)
+{
+    auto allocations = tracker.allocations;
+    auto bytes = tracker.bytes;
+    auto live = tracker.live;
+    auto peak = tracker.peak;
+    f();
+    tracker.allocations = allocations;
+    tracker.bytes = bytes;
+    tracker.live = live;
+    tracker.peak = peak;
+}
+
+/**
+ * @brief Adds the allocations made during its lifetime to an entry of
+ * renderStats.
+ *
+ * An exclusive probe subtracts the allocations of the exclusive probes nested
+ * in it, an inclusive probe does not.
+ */
+class AllocationProbe
+{
+  public:
+    AllocationProbe(map<string, AllocationStats> *target,
+                    bool exclusive,
+                    const string &key,
+                    const string &subKey = "")
+        : target_(target), exclusive_(exclusive)
     {
-        if (c == '@')
+        uncounted([this, &key, &subKey] {
+            key_ = subKey.empty() ? key : key + "." + subKey;
+        });
+        parent_ = current_;
+        if (exclusive_)
         {
-            cancelOnceLParen_ = true;
+            current_ = this;
         }
-        if (c == '@' || c == '$')
+        allocations_ = tracker.allocations;
+        bytes_ = tracker.bytes;
+        live_ = tracker.live;
+        outerPeak_ = tracker.peak;
+        tracker.peak = tracker.live;
+    }
+
+    ~AllocationProbe()
+    {
+        AllocationStats delta;
+        delta.allocations = tracker.allocations - allocations_;
+        delta.bytes = tracker.bytes - bytes_;
+        delta.peakBytes = static_cast<size_t>(max<int64_t>(0, tracker.peak - live_));
+        tracker.peak = max(tracker.peak, outerPeak_);
+        if (exclusive_)
         {
-            ++parenDepth_;
-            ++pos_;
-            return {tokenMap.at(c)};
+            current_ = parent_;
+            if (parent_)
+            {
+                parent_->childAllocations_ += delta.allocations;
+                parent_->childBytes_ += delta.bytes;
+            }
+            delta.allocations -= childAllocations_;
+            delta.bytes -= childBytes_;
         }
-        string value;
-        while (!done() && c != '@' && c != '$')
+        uncounted([this, &delta] {
+            auto &stats = (*target_)[key_];
+            stats.allocations += delta.allocations;
+            stats.bytes += delta.bytes;
+            stats.peakBytes = max(stats.peakBytes, delta.peakBytes);
+        });
+    }
+
+  private:
+    map<string, AllocationStats> *target_;
+    string key_;
+    bool exclusive_;
+    AllocationProbe *parent_;
+    size_t allocations_;
+    size_t bytes_;
+    int64_t live_;
+    int64_t outerPeak_;
+    size_t childAllocations_{0};
+    size_t childBytes_{0};
+    static thread_local AllocationProbe *current_;
+};
+
+thread_local AllocationProbe *AllocationProbe::current_{nullptr};
+
+/**
+ * @brief Counts a reallocation if an output buffer grew during its lifetime.
+ */
+class OutputProbe
+{
+  public:
+    OutputProbe(const string &sql) : sql_(sql), capacity_(sql.capacity())
+    {
+    }
+
+    ~OutputProbe()
+    {
+        if (sql_.capacity() != capacity_)
         {
-            value += c;
-            c = sql_[++pos_];
+            ++renderStats.outputReallocations;
         }
-        return {NormalText, value};
     }
-    // Skip whitespace characters
-    while (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+
+  private:
+    const string &sql_;
+    size_t capacity_;
+};
+
+/**
+ * @brief Resets renderStats when a render starts and fills in its total when
+ * the render ends.
+ */
+class RenderProbe
+{
+  public:
+    RenderProbe(const string &name)
     {
-        c = sql_[++pos_];
+        uncounted([&name] {
+            renderStats.name = name;
+            renderStats.byNodeType.clear();
+            renderStats.bySubSql.clear();
+        });
+        renderStats.outputReallocations = 0;
+        allocations_ = tracker.allocations;
+        bytes_ = tracker.bytes;
+        live_ = tracker.live;
+        outerPeak_ = tracker.peak;
+        tracker.peak = tracker.live;
     }
 
-    // Single character token
-    switch (c)
+    ~RenderProbe()
     {
-        case '@':
-            cancelOnceLParen_ = true;
-            [[fallthrough]];
-        case '$':
-            ++parenDepth_;
-            goto label;
-        case '(':
-            if (!cancelOnceLParen_)
-            {
-                ++parenDepth_;
-            }
-            cancelOnceLParen_ = false;
-            goto label;
-        case ')':
-        case '}':
-            --parenDepth_;
-            [[fallthrough]];
-        case ',':
-        case '{':
-        case '.':
-        case '[':
-        case ']':
-        label:
-            return {tokenMap.at(sql_[pos_++])};
+        renderStats.total.allocations = tracker.allocations - allocations_;
+        renderStats.total.bytes = tracker.bytes - bytes_;
+        renderStats.total.peakBytes =
+            static_cast<size_t>(max<int64_t>(0, tracker.peak - live_));
+        tracker.peak = max(tracker.peak, outerPeak_);
     }
 
-    // ! or !=
-    if (c == '!')
+  private:
+    size_t allocations_;
+    size_t bytes_;
+    int64_t live_;
+    int64_t outerPeak_;
+};
+}  // namespace
+
+void *operator new(size_t size)
+{
+    auto ptr = static_cast<char *>(malloc(size + kHeaderSize));
+    if (!ptr)
     {
-        if (pos_ + 1 < sql_.size() && sql_[pos_ + 1] == '=')
-        {
-            pos_ += 2;
-            return {NEQ};
-        }
-        else
-        {
-            ++pos_;
-            return {Not};
-        }
+        throw bad_alloc();
     }
-    // = or ==
-    else if (c == '=')
+    *reinterpret_cast<size_t *>(ptr) = size;
+    ++tracker.allocations;
+    tracker.bytes += size;
+    tracker.live += size;
+    tracker.peak = max(tracker.peak, tracker.live);
+    return ptr + kHeaderSize;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    if (ptr)
     {
-        if (pos_ + 1 < sql_.size() && sql_[pos_ + 1] == '=')
+        auto base = static_cast<char *>(ptr) - kHeaderSize;
+        tracker.live -= *reinterpret_cast<size_t *>(base);
+        free(base);
+    }
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+#define TL_SQL_PROBE_RENDER(name) RenderProbe renderProbe(name)
+#define TL_SQL_PROBE_NODE(type) \
+    AllocationProbe nodeProbe(&renderStats.byNodeType, true, type)
+#define TL_SQL_PROBE_SUB_SQL(name, subSqlName) \
+    AllocationProbe subSqlProbe(&renderStats.bySubSql, false, name, subSqlName)
+#define TL_SQL_PROBE_OUTPUT(sql) OutputProbe outputProbe(sql)
+#else
+#define TL_SQL_PROBE_RENDER(name)
+#define TL_SQL_PROBE_NODE(type)
+#define TL_SQL_PROBE_SUB_SQL(name, subSqlName)
+#define TL_SQL_PROBE_OUTPUT(sql)
+#endif
+
+namespace
+{
+/**
+ * @brief The iterations of every @for executed by the render on the current
+ * thread. Only collected while the slow-render log is enabled.
+ */
+thread_local vector<pair<const ASTNode *, size_t>> *loopIterations{nullptr};
+
+/**
+ * @brief Appends the shape of a JSON value to `shape`, without its values.
+ * Arrays are described by their size and their first element.
+ * @return The nesting depth of the value.
+ */
+size_t describeShape(const Json::Value &value, string &shape)
+{
+    switch (value.type())
+    {
+        case Json::nullValue:
+            shape += "null";
+            return 0;
+        case Json::intValue:
+        case Json::uintValue:
+            shape += "int";
+            return 0;
+        case Json::realValue:
+            shape += "double";
+            return 0;
+        case Json::stringValue:
+            shape += "string";
+            return 0;
+        case Json::booleanValue:
+            shape += "bool";
+            return 0;
+        case Json::arrayValue:
         {
-            pos_ += 2;
-            return {EQ};
+            if (value.empty())
+            {
+                shape += "[]";
+                return 1;
+            }
+            shape += '[' + std::to_string(value.size()) + " x ";
+            auto depth = describeShape(value[0], shape);
+            shape += ']';
+            return depth + 1;
         }
-        else
+        case Json::objectValue:
         {
-            ++pos_;
-            return {Assign};
+            size_t depth = 0;
+            shape += '{';
+            for (const auto &key : value.getMemberNames())
+            {
+                if (shape.back() != '{')
+                {
+                    shape += ", ";
+                }
+                shape += key + ": ";
+                depth = max(depth, describeShape(value[key], shape));
+            }
+            shape += '}';
+            return depth + 1;
         }
     }
-    // &&
-    else if (c == '&' && pos_ + 1 < sql_.size() && sql_[pos_ + 1] == '&')
+    return 0;
+}
+
+/**
+ * @brief Describes a ColumnBatch like a JSON array of objects, such as
+ * `[2 x {id: int64, name: string}]`.
+ */
+[[maybe_unused]] void describeColumns(const ColumnBatch &batch,
+                                      string &shape)
+{
+    static const char *const kTypes[] = {
+        "int", "int64", "double", "string", "bool"};
+    shape += '[' + std::to_string(batch.rows()) + " x {";
+    for (const auto &[name, column] : batch.columns())
     {
-        pos_ += 2;
-        return {And};
+        if (shape.back() != '{')
+        {
+            shape += ", ";
+        }
+        shape += name + ": " + kTypes[column.index()];
     }
-    // ||
-    else if (c == '|' && pos_ + 1 < sql_.size() && sql_[pos_ + 1] == '|')
+    shape += "}]";
+}
+
+/**
+ * @brief Describes the parameters of a render with their values redacted,
+ * such as `{ids: [5 x int], name: string}`.
+ * @return The shape and the nesting depth of the parameters.
+ */
+template <typename Params>
+pair<string, size_t> describeParams(const Params &params)
+{
+    vector<const typename Params::value_type *> sorted;
+    for (const auto &param : params)
     {
-        pos_ += 2;
-        return {Or};
+        sorted.emplace_back(&param);
     }
-    // Parameter value, string format
-    else if (c == '\'' || c == '"')
+    sort(sorted.begin(), sorted.end(), [](auto a, auto b) {
+        return a->first < b->first;
+    });
+    string shape = "{";
+    size_t depth = 0;
+    for (auto param : sorted)
     {
-        ++pos_;
-        string str;
-        while (!done() && sql_[pos_] != c)
+        if (shape.size() > 1)
         {
-            str += sql_[pos_++];
+            shape += ", ";
         }
-        if (done())
+        shape += param->first;
+        shape += ": ";
+        if (holds_alternative<int32_t>(param->second))
         {
-            throw runtime_error("Invalid expression. Unclosed string.");
+            shape += "int";
         }
-        ++pos_;
-        return {String, str};
-    }
-    // Sub-SQL name or parameter name or keyword
-    else if (isalpha(c) || c == '_' || c & 0x80)
-    {
-        string identifier;
-        while (!done() &&
-               (isalnum(sql_[pos_]) || sql_[pos_] == '_' || sql_[pos_] & 0x80))
+        else if (holds_alternative<int64_t>(param->second))
         {
-            identifier += sql_[pos_++];
+            shape += "int64";
         }
-        if (keywordMap.count(identifier))
+        else if (holds_alternative<double>(param->second))
         {
-            if (identifier == "else" || identifier == "endif" ||
-                identifier == "endfor")
-            {
-                --parenDepth_;
-            }
-            return {keywordMap.at(identifier)};
+            shape += "double";
         }
-        return {Identifier, identifier};
-    }
-    // Parameter value, integer format
-    else if (isdigit(c))
-    {
-        string num;
-        while (!done() && (isdigit(sql_[pos_])))
+        else if (holds_alternative<bool>(param->second))
         {
-            num += sql_[pos_++];
+            shape += "bool";
         }
-        if (num.size() == 1)
+        else if (holds_alternative<string>(param->second))
         {
-            return {Integer, num};
+            shape += "string";
         }
-        else if (num.size() > 1 && num[0] == '0')
+        else if (holds_alternative<IntArray>(param->second))
         {
-            size_t i = 1;
-            for (; i < num.size() && num[i] == '0'; ++i)
-                ;
-            return {Integer, i == num.size() ? "0" : num.substr(i)};
+            shape += '[' + std::to_string(get<IntArray>(param->second).size()) +
+                     " x int]";
+            depth = max<size_t>(depth, 1);
+        }
+        else if (holds_alternative<Int64Array>(param->second))
+        {
+            shape +=
+                '[' + std::to_string(get<Int64Array>(param->second).size()) +
+                " x int64]";
+            depth = max<size_t>(depth, 1);
+        }
+        else if (holds_alternative<ColumnBatch>(param->second))
+        {
+            describeColumns(get<ColumnBatch>(param->second), shape);
+            depth = max<size_t>(depth, 2);
+        }
+        else if (holds_alternative<ColumnRow>(param->second))
+        {
+            shape += "row";
+        }
+        else
+        {
+            depth = max(depth,
+                        describeShape(get<Json::Value>(param->second), shape));
         }
     }
-
-    throw runtime_error("Invalid expression(" + std::to_string(pos_) +
-                        "): " + sql_.substr(pos_));
+    shape += '}';
+    return {std::move(shape), depth + 1};
 }
 
-bool tl::sql::toBool(const ParamItem &value)
+/**
+ * @brief The binding storage of the scope stacks of one thread.
+ *
+ * Frames are handed out and returned in stack order. A returned frame keeps
+ * its bindings, so that names and string values bound by the next render reuse
+ * their capacity. JSON values and arrays are dropped, as assigning one copies
+ * it anyway.
+ */
+class RenderContext
 {
-    if (!value)
-    {
-        return false;
-    }
-    if (holds_alternative<int32_t>(*value))
-    {
-        return get<int32_t>(*value) != 0;
-    }
-    else if (holds_alternative<string>(*value))
+  public:
+    vector<ParamScope::Binding> *acquire()
     {
-        return get<string>(*value) != "";
+        if (depth_ == frames_.size())
+        {
+            frames_.emplace_back(make_unique<vector<ParamScope::Binding>>());
+        }
+        return frames_[depth_++].get();
     }
-    // Json::Value
-    return true;
-}
 
-string ASTNode::generateSql(const ParamList &params) const
-{
-    auto value = getValue(params);
-    string result;
-    if (value)
+    void release(vector<ParamScope::Binding> *bindings)
     {
-        if (holds_alternative<string>(*value))
+        assert(depth_ > 0 && frames_[depth_ - 1].get() == bindings);
+        --depth_;
+        if (depth_ >= ParamScope::kMaxPooledFrames)
         {
-            result = get<string>(*value);
+            frames_.pop_back();
+            return;
         }
-        else if (holds_alternative<int32_t>(*value))
+        // Keep the high-water memory of the pool bounded
+        auto bytes = bindings->capacity() * sizeof(ParamScope::Binding);
+        for (auto &binding : *bindings)
         {
-            result = std::to_string(get<int32_t>(*value));
+            if (holds_alternative<Json::Value>(binding.second) ||
+                holds_alternative<IntArray>(binding.second) ||
+                holds_alternative<Int64Array>(binding.second) ||
+                holds_alternative<ColumnBatch>(binding.second))
+            {
+                binding.second = 0;
+            }
+            bytes += binding.first.capacity();
+            if (holds_alternative<string>(binding.second))
+            {
+                bytes += get<string>(binding.second).capacity();
+            }
         }
-        // JSon::Value (objectValue or arrayValue) is not supported to be
-        // converted to string
-    }
-    if (nextSibling_)
-    {
-        result += nextSibling_->generateSql(params);
-    }
-    return result;
-}
-
-ParamItem VariableNode::getValue(const ParamList &params) const
-{
-    if (params.count(name_) == 0)
-    {
-        return nullopt;
-    }
-    auto value = params.at(name_);
-    if (holds_alternative<int32_t>(value))
-    {
-        return get<int32_t>(value);
-    }
-    else if (holds_alternative<string>(value))
-    {
-        return get<string>(value);
-    }
-    else  // Json::Value
-    {
-        return get<Json::Value>(value);
-    }
-}
-
-ParamItem MemberNode::getValue(const ParamList &params) const
-{
-    auto value = left_->getValue(params);
-    if (value && holds_alternative<Json::Value>(*value))
-    {
-        auto json = get<Json::Value>(*value);
-        auto memberName = get<string>(*right_->getValue());
-        if (json.isObject() && json.isMember(memberName))
+        if (bytes > ParamScope::kMaxPooledFrameBytes)
         {
-            auto result = json[memberName];
-            if (result.isInt())
-            {
-                return result.asInt();
-            }
-            else if (result.isString())
-            {
-                return result.asString();
-            }
-            else  // object or array
-            {
-                return result;
-            }
+            vector<ParamScope::Binding>().swap(*bindings);
         }
     }
-    return nullopt;
-}
 
-ParamItem ArrayNode::getValue(const ParamList &params) const
-{
-    auto value = left_->getValue(params);
-    if (value && holds_alternative<Json::Value>(*value))
+    /**
+     * @brief Lends the empty output buffer of SqlGenerator::renderInto for
+     * its lifetime, and trims the buffer when returned, also when the render
+     * throws.
+     */
+    class OutputLease
     {
-        auto json = get<Json::Value>(*value);
-        Json::Value result;
-        auto rightValue = right_->getValue(params);
-        if (holds_alternative<int32_t>(*rightValue))
+      public:
+        explicit OutputLease(RenderContext &context)
+            : output_(context.output_)
         {
-            auto index = get<int32_t>(*rightValue);
-            if (json.isArray() && index >= 0 &&
-                index < static_cast<int>(json.size()))
-            {
-                result = json[index];
-            }
+            output_.clear();
         }
-        else if (holds_alternative<string>(*rightValue))
+
+        ~OutputLease()
         {
-            auto memberName = get<string>(*rightValue);
-            if (json.isObject() && json.isMember(memberName))
+            if (output_.capacity() > SqlGenerator::kMaxPooledOutputBytes)
             {
-                result = json[memberName];
+                string().swap(output_);
             }
         }
-        if (result.isInt())
-        {
-            return result.asInt();
-        }
-        else if (result.isString())
-        {
-            return result.asString();
-        }
-        else  // object or array
+
+        OutputLease(const OutputLease &) = delete;
+        OutputLease &operator=(const OutputLease &) = delete;
+
+        string &output()
         {
-            return result;
+            return output_;
         }
-    }
-    return nullopt;
-}
 
-ParamItem SubSqlNode::getValue(const ParamList &params) const
+      private:
+        string &output_;
+    };
+
+  private:
+    vector<unique_ptr<vector<ParamScope::Binding>>> frames_;
+    size_t depth_{0};  ///< Frames in use.
+    string output_;
+};
+
+thread_local RenderContext renderContext;
+
+void assignString(ParamValue &target, const char *begin, const char *end)
 {
-    ParamList subParams;
-    for (const auto &param : params_)
+    if (holds_alternative<string>(target))
     {
-        auto paramValue = param.second->getValue(params);
-        if (paramValue)
-        {
-            subParams.emplace(param.first, *paramValue);
-        }
-        else
-        {
-            LOG_ERROR << "Parameter " << param.first << " not found";
-        }
+        get<string>(target).assign(begin, end);
+    }
+    else
+    {
+        target.emplace<string>(begin, end);
     }
-    return subSqlGetter_(name_, subParams);
 }
 
-ParamItem AndNode::getValue(const ParamList &params) const
+/**
+ * @brief Assigns a JSON value like it would be converted to a ParamItem:
+ * scalars are unwrapped. Integral numbers become int32_t if they fit and
+ * int64_t otherwise, integers beyond int64_t stay JSON values so that they
+ * print exactly, and other numbers become double.
+ */
+void assignJson(ParamValue &target, const Json::Value &json)
 {
-    auto leftValue = left_->getValue(params);
-    auto rightValue = right_->getValue(params);
-    if (!toBool(leftValue))
+    const char *begin;
+    const char *end;
+    if (json.isInt())
     {
-        return 0;  // false
+        target = json.asInt();
+    }
+    else if (json.isInt64())
+    {
+        target = json.asInt64();
+    }
+    else if (json.isUInt64())
+    {
+        target = json;
+    }
+    else if (json.isDouble())
+    {
+        target = json.asDouble();
+    }
+    else if (json.isBool())
+    {
+        target = json.asBool();
+    }
+    else if (json.isString() && json.getString(&begin, &end))
+    {
+        assignString(target, begin, end);
+    }
+    else  // null, object or array
+    {
+        target = json;
     }
-    return toBool(rightValue);
 }
 
-ParamItem OrNode::getValue(const ParamList &params) const
+ParamItem jsonToParamItem(const Json::Value &json)
 {
-    auto leftValue = left_->getValue(params);
-    auto rightValue = right_->getValue(params);
-    if (toBool(leftValue))
-    {
-        return 1;  // true
-    }
-    return toBool(rightValue);
+    ParamValue value;
+    assignJson(value, json);
+    return value;
 }
 
-ParamItem EQNode::getValue(const ParamList &params) const
+void appendBool(bool value, string &sql)
 {
-    auto leftValue = left_->getValue(params);
-    auto rightValue = right_->getValue(params);
-    if (!leftValue && !rightValue)
+    sql += value ? "TRUE" : "FALSE";
+}
+
+/**
+ * @brief Prints the scalars of a JSON value like their ParamItem. Null,
+ * objects and arrays print nothing.
+ */
+void appendJson(const Json::Value &json, string &sql)
+{
+    TL_SQL_PROBE_OUTPUT(sql);
+    const char *begin;
+    const char *end;
+    if (json.isInt64())
     {
-        return 1;  // true
+        appendDecimal(json.asInt64(), sql);
     }
-    if (!leftValue || !rightValue)
+    else if (json.isUInt64())
     {
-        return 0;  // false
+        char digits[kMaxDecimalBytes];
+        sql.append(digits,
+                   to_chars(digits, digits + sizeof(digits), json.asUInt64())
+                       .ptr);
     }
-    if (holds_alternative<int32_t>(*leftValue) &&
-        holds_alternative<int32_t>(*rightValue))
+    else if (json.isDouble())
     {
-        return get<int32_t>(*leftValue) == get<int32_t>(*rightValue);
+        appendDouble(json.asDouble(), sql);
     }
-    else if (holds_alternative<string>(*leftValue) &&
-             holds_alternative<string>(*rightValue))
+    else if (json.isBool())
     {
-        return get<string>(*leftValue) == get<string>(*rightValue);
+        appendBool(json.asBool(), sql);
     }
-    else if (holds_alternative<Json::Value>(*leftValue) &&
-             holds_alternative<Json::Value>(*rightValue))
+    else if (json.isString() && json.getString(&begin, &end))
     {
-        return get<Json::Value>(*leftValue) == get<Json::Value>(*rightValue);
+        sql.append(begin, end);
     }
-    return 0;  // false
 }
 
-ParamItem NEQNode::getValue(const ParamList &params) const
+void appendValue(const ParamValue &value, string &sql)
 {
-    auto leftValue = left_->getValue(params);
-    auto rightValue = right_->getValue(params);
-    if (!leftValue && !rightValue)
+    if (auto json = get_if<Json::Value>(&value))
     {
-        return 0;  // false
+        appendJson(*json, sql);
+        return;
     }
-    if (!leftValue || !rightValue)
+    TL_SQL_PROBE_OUTPUT(sql);
+    if (holds_alternative<string>(value))
     {
-        return 1;  // true
+        sql += get<string>(value);
+    }
+    else if (holds_alternative<int32_t>(value))
+    {
+        appendDecimal(get<int32_t>(value), sql);
     }
-    if (holds_alternative<int32_t>(*leftValue) &&
-        holds_alternative<int32_t>(*rightValue))
+    else if (holds_alternative<int64_t>(value))
     {
-        return get<int32_t>(*leftValue) != get<int32_t>(*rightValue);
+        appendDecimal(get<int64_t>(value), sql);
     }
-    else if (holds_alternative<string>(*leftValue) &&
-             holds_alternative<string>(*rightValue))
+    else if (holds_alternative<double>(value))
     {
-        return get<string>(*leftValue) != get<string>(*rightValue);
+        appendDouble(get<double>(value), sql);
     }
-    else if (holds_alternative<Json::Value>(*leftValue) &&
-             holds_alternative<Json::Value>(*rightValue))
+    else if (holds_alternative<bool>(value))
     {
-        return get<Json::Value>(*leftValue) != get<Json::Value>(*rightValue);
+        appendBool(get<bool>(value), sql);
     }
-    return 1;  // true
+    // Arrays and column batches are not supported to be converted to string
 }
 
-ParamItem IfStmtNode::getValue(const ParamList &params) const
+/**
+ * @brief Prints the cell of a ColumnBatch like appendValue prints its value.
+ */
+void appendCell(const Column &column, size_t row, string &sql)
 {
-    auto condition = condition_->getValue(params);
-    if (toBool(condition))
+    TL_SQL_PROBE_OUTPUT(sql);
+    visit(
+        [row, &sql](const auto &cells) {
+            using T = typename decay_t<decltype(cells)>::value_type;
+            if constexpr (is_same_v<T, string>)
+            {
+                sql += cells[row];
+            }
+            else if constexpr (is_same_v<T, double>)
+            {
+                appendDouble(cells[row], sql);
+            }
+            else if constexpr (is_same_v<T, bool>)
+            {
+                appendBool(cells[row], sql);
+            }
+            else
+            {
+                appendDecimal(cells[row], sql);
+            }
+        },
+        column);
+}
+
+/**
+ * @brief Assigns the cell of a ColumnBatch, reusing the string of `target`.
+ */
+void assignCell(const Column &column, size_t row, ParamValue &target)
+{
+    if (auto strings = get_if<vector<string>>(&column))
     {
-        return ifStmt_->generateSql(params);
+        const auto &cell = (*strings)[row];
+        assignString(target, cell.data(), cell.data() + cell.size());
+        return;
     }
-    for (const auto &elseIfStmt : elIfStmts_)
+    visit(
+        [row, &target](const auto &cells) {
+            using T = typename decay_t<decltype(cells)>::value_type;
+            if constexpr (!is_same_v<T, string>)
+            {
+                target = static_cast<T>(cells[row]);
+            }
+        },
+        column);
+}
+
+/**
+ * @brief Returns the value of an integer or boolean parameter.
+ */
+optional<int64_t> integralValue(const ParamValue &value)
+{
+    if (holds_alternative<int32_t>(value))
     {
-        auto elseIfCondition = elseIfStmt.first->getValue(params);
-        if (toBool(elseIfCondition))
-        {
-            return elseIfStmt.second->generateSql(params);
-        }
+        return get<int32_t>(value);
     }
-    if (elseStmt_)
+    else if (holds_alternative<int64_t>(value))
+    {
+        return get<int64_t>(value);
+    }
+    else if (holds_alternative<bool>(value))
     {
-        return elseStmt_->generateSql(params);
+        return get<bool>(value);
     }
     return nullopt;
 }
 
-ParamItem ForLoopNode::getValue(const ParamList &params) const
+/**
+ * @brief Compares two parameters by value. Numbers and booleans compare
+ * equal across their types, such as 1 and true, other values only to values
+ * of the same type.
+ */
+bool valuesEqual(const ParamValue &left, const ParamValue &right)
+{
+    auto leftIntegral = integralValue(left);
+    auto rightIntegral = integralValue(right);
+    if (leftIntegral && rightIntegral)
+    {
+        return *leftIntegral == *rightIntegral;
+    }
+    auto leftDouble = get_if<double>(&left);
+    auto rightDouble = get_if<double>(&right);
+    if ((leftIntegral || leftDouble) && (rightIntegral || rightDouble))
+    {
+        return (leftDouble ? *leftDouble : *leftIntegral) ==
+               (rightDouble ? *rightDouble : *rightIntegral);
+    }
+    return left == right;
+}
+
+EscapeMode parseEscape(const Json::Value &config)
+{
+    auto name = config.asString();
+    auto mode = parseEscapeMode(name);
+    if (!mode)
+    {
+        throw runtime_error("Unknown escape mode: " + name);
+    }
+    return *mode;
+}
+
+/**
+ * @brief Replaces the values printed by `${}` with placeholders while a
+ * statement is rendered, see SqlGenerator::getStatement.
+ *
+ * The output is scanned for string literals as it grows. A value printed
+ * inside a literal, such as `'%${title}%'`, turns the whole literal into one
+ * placeholder whose argument is the text between the quotes. The text after
+ * the value is moved into the argument when the output is scanned next.
+ * Identifiers cannot be bound, so a value printed inside `"..."` or escaped
+ * as an identifier stays text.
+ *
+ * While enumerating shapes, the branches of `@if` and `@switch` are chosen by
+ * a sequence of choices instead of their conditions, and the arguments are
+ * the sources of the values, such as `${author.name}`.
+ */
+class PlaceholderSink
 {
-    auto newParams = params;
-    auto collection = collection_->getValue(params);
-    auto collectionJson =
-        collection ? get<Json::Value>(*collection) : Json::Value{};
-    auto separator = separator_ ? separator_->getValue(params) : nullopt;
-    auto separatorStr = separator ? std::get<std::string>(*separator) : "";
+  public:
+    PlaceholderSink(PlaceholderStyle style,
+                    const string &output,
+                    const vector<size_t> *choices = nullptr)
+        : style_(style), output_(&output), choices_(choices)
+    {
+    }
+
+    /**
+     * @brief Whether `sql` is the statement, rather than a temporary such as
+     * the value of a `@let`, whose values are printed as text.
+     */
+    bool owns(const string &sql) const
+    {
+        return &sql == output_;
+    }
+
+    bool enumerating() const
+    {
+        return choices_ != nullptr;
+    }
 
-    auto setParamAndIndex = [this](ParamList &newParams,
-                                   const Json::Value &collectionJson,
-                                   const auto &index) {
-        const auto &valueJson = collectionJson[index];
-        if (valueJson.isInt())
+    /**
+     * @brief Prints the value of `node`, escaped by `mode`, as a placeholder.
+     * Of the escaping only that of a LIKE pattern applies to an argument.
+     * @return false if the value is to be printed as text.
+     */
+    bool print(const ASTNode &node,
+               const ParamScope &scope,
+               EscapeMode mode,
+               string &sql)
+    {
+        scan(sql);
+        ParamItem value;
+        string source;
+        if (enumerating())
+        {
+            source = "${" + node.sourceText() + "}";
+        }
+        if (inIdentifier_ || mode == EscapeMode::Identifier)
         {
-            newParams.erase(valueName_);
-            newParams.emplace(valueName_, valueJson.asInt());
+            if (!enumerating())
+            {
+                return false;
+            }
+            sql += source;
+            scanned_ = sql.size();
+            return true;
+        }
+        if (!enumerating())
+        {
+            value = node.getValue(scope);
+            if ((mode == EscapeMode::Like || mode == EscapeMode::MysqlLike) &&
+                value && holds_alternative<string>(*value))
+            {
+                string pattern;
+                appendLikePattern(get<string>(*value), pattern);
+                value = std::move(pattern);
+            }
+        }
+        if (inQuote_ && !absorbing_)
+        {
+            string literal;
+            unquote(sql, quoteStart_ + 1, sql.size(), literal);
+            sql.resize(quoteStart_);
+            appendMarker(sql);
+            args_.emplace_back(std::move(literal));
+            inQuote_ = false;
+            absorbing_ = true;
         }
-        else if (valueJson.isString())
+        if (absorbing_)
         {
-            newParams.erase(valueName_);
-            newParams.emplace(valueName_, valueJson.asString());
+            auto &literal = get<string>(args_.back());
+            if (enumerating())
+            {
+                literal += source;
+            }
+            else if (value)
+            {
+                appendValue(*value, literal);
+            }
+            scanned_ = sql.size();
+            return true;
+        }
+        appendMarker(sql);
+        if (enumerating())
+        {
+            args_.emplace_back(std::move(source));
         }
         else
         {
-            newParams.erase(valueName_);
-            newParams.emplace(valueName_, valueJson);
+            args_.emplace_back(value ? std::move(*value)
+                                     : ParamValue(Json::Value()));
         }
-        if (!indexName_.empty())
+        scanned_ = sql.size();
+        return true;
+    }
+
+    /**
+     * @brief Scans the output printed since the last call.
+     */
+    void scan(string &sql)
+    {
+        auto pos = scanned_;
+        if (absorbing_)
         {
-            newParams.erase(indexName_);
-            newParams.emplace(indexName_, index);
+            // The rest of the literal, up to its closing quote, belongs to
+            // the argument
+            auto end = pos;
+            while (end < sql.size())
+            {
+                if (sql[end] == '\'' && isEscapedQuote(sql, end))
+                {
+                    end += 2;
+                    continue;
+                }
+                if (sql[end] == '\'')
+                {
+                    absorbing_ = false;
+                    break;
+                }
+                ++end;
+            }
+            unquote(sql, pos, end, get<string>(args_.back()));
+            sql.erase(pos, end + (absorbing_ ? 0 : 1) - pos);
         }
-    };
-    std::string result;
-    auto appendResult =
-        [this, &result, &separatorStr](const ParamList &params,
-                                       const Json::Value &collectionJson,
-                                       const int i) {
-            result += loopBody_->generateSql(params);
-            if (static_cast<size_t>(i) + 1 != collectionJson.size())
+        for (; pos < sql.size(); ++pos)
+        {
+            auto c = sql[pos];
+            auto next = pos + 1 < sql.size() ? sql[pos + 1] : '\0';
+            if (lineComment_)
             {
-                result += separatorStr;
+                lineComment_ = c != '\n';
             }
-        };
-    if (collectionJson.isArray())
+            else if (blockComment_)
+            {
+                if (c == '*' && next == '/')
+                {
+                    blockComment_ = false;
+                    ++pos;
+                }
+            }
+            else if (inQuote_)
+            {
+                if (c == '\'' && isEscapedQuote(sql, pos))
+                {
+                    ++pos;
+                }
+                else if (c == '\'')
+                {
+                    inQuote_ = false;
+                }
+            }
+            else if (inIdentifier_)
+            {
+                // A doubled quote closes and reopens the identifier
+                inIdentifier_ = c != '"';
+            }
+            else if (c == '\'')
+            {
+                inQuote_ = true;
+                quoteStart_ = pos;
+            }
+            else if (c == '"')
+            {
+                inIdentifier_ = true;
+            }
+            else if ((c == '-' && next == '-') || (c == '/' && next == '*'))
+            {
+                (c == '-' ? lineComment_ : blockComment_) = true;
+                ++pos;
+            }
+        }
+        scanned_ = sql.size();
+    }
+
+    /**
+     * @brief Moves the positions after `pos` when `count` characters of the
+     * output are removed there, as by `@where`.
+     */
+    void erased(size_t pos, size_t count)
     {
-        for (int i = 0; static_cast<size_t>(i) < collectionJson.size(); ++i)
+        for (auto index : {&scanned_, &quoteStart_})
         {
-            setParamAndIndex(newParams, collectionJson, i);
-            appendResult(newParams, collectionJson, i);
+            if (*index >= pos + count)
+            {
+                *index -= count;
+            }
+            else if (*index > pos)
+            {
+                *index = pos;
+            }
         }
     }
-    else if (collectionJson.isObject())
+
+    /**
+     * @brief Returns the branch to take among `options`: the next of the
+     * choices, or the first branch past their end.
+     */
+    size_t choose(size_t options)
+    {
+        auto choice =
+            taken_.size() < choices_->size() ? (*choices_)[taken_.size()] : 0;
+        taken_.push_back(choice);
+        options_.push_back(options);
+        return choice;
+    }
+
+    /**
+     * @brief Turns the choices taken by the render into the choices of the
+     * next combination of branches.
+     * @return false if all combinations have been rendered.
+     */
+    bool nextChoices(vector<size_t> &choices)
     {
-        auto memberNames = collectionJson.getMemberNames();
-        for (int i = 0; static_cast<size_t>(i) < memberNames.size(); ++i)
+        while (!taken_.empty() && taken_.back() + 1 >= options_.back())
+        {
+            taken_.pop_back();
+            options_.pop_back();
+        }
+        if (taken_.empty())
         {
-            setParamAndIndex(newParams, collectionJson, memberNames[i]);
-            appendResult(newParams, collectionJson, i);
+            return false;
         }
+        ++taken_.back();
+        choices = taken_;
+        return true;
     }
-    return result;
-}
 
-void ASTNode::print(vector<int> &indentFlags, bool isFirstLevel) const
-{
-    if (isFirstLevel)
+    vector<ParamValue> &args()
     {
-        indentFlags.back() = !!nextSibling_;
+        return args_;
     }
-    printIndent(indentFlags);
-    printInner(indentFlags);
-    if (nextSibling_)
+
+    bool unknownLoop{false};  ///< Whether a loop over a missing collection
+                              ///< was skipped while enumerating.
+
+  private:
+    /**
+     * @brief Whether the quote at `pos` is the first of a doubled quote.
+     */
+    static bool isEscapedQuote(const string &sql, size_t pos)
     {
-        nextSibling_->print(indentFlags, true);
+        return pos + 1 < sql.size() && sql[pos + 1] == '\'';
     }
-}
 
-void ASTNode::printIndent(vector<int> &indentFlags) const
-{
-    for (int i = 0; i < indentFlags.size(); ++i)
+    /**
+     * @brief Appends the text of [begin, end) to `literal` with doubled
+     * quotes undone.
+     */
+    static void unquote(const string &sql,
+                        size_t begin,
+                        size_t end,
+                        string &literal)
     {
-        const auto &flag = indentFlags[i];
-        if (flag == 0)
+        for (auto pos = begin; pos < end; ++pos)
         {
-            if (i + 1 == indentFlags.size())
-            {
-                cout << "└── ";
-            }
-            else
+            literal += sql[pos];
+            if (sql[pos] == '\'' && pos + 1 < end)
             {
-                cout << "    ";
+                ++pos;
             }
         }
-        else if (flag == 1)
+    }
+
+    void appendMarker(string &sql)
+    {
+        if (style_ == PlaceholderStyle::Question)
         {
-            if (i + 1 == indentFlags.size())
-            {
-                cout << "├── ";
-            }
-            else
-            {
-                cout << "│   ";
-            }
+            sql += '?';
+            return;
         }
+        sql += '$';
+        appendDecimal(args_.size() + 1, sql);
     }
-}
 
-void NormalTextNode::printInner(vector<int> indentFlags) const
-{
-    cout << "\033[38;5;46m"
-            "["
-         << nodeName()
-         << "]"
-            "\033[0m"
-            "(value: "
-            "\033[38;5;46m"
-            "\""
-         << text_
-         << "\""
-            "\033[0m"
-            ")"
-         << endl;
-}
+    PlaceholderStyle style_;
+    const string *output_;
+    const vector<size_t> *choices_;  ///< Choices to replay, or nullptr.
+    vector<size_t> taken_;           ///< The choice made at every branch.
+    vector<size_t> options_;         ///< The number of options of each.
+    vector<ParamValue> args_;
+    size_t scanned_{0};     ///< Length of the output already scanned.
+    size_t quoteStart_{0};  ///< Position of the quote opening the literal.
+    bool inQuote_{false};
+    bool inIdentifier_{false};  ///< Whether inside a quoted identifier.
+    bool absorbing_{false};     ///< Whether the literal is an argument.
+    bool lineComment_{false};
+    bool blockComment_{false};
+};
 
-void NumberNode::printInner(vector<int> indentFlags) const
-{
-    cout << "\033[38;5;202m"
-            "["
-         << nodeName()
-         << "]"
-            "\033[0m"
-            "(value: "
-            "\033[38;5;202m"
-         << value_
-         << "\033[0m"
-            ")"
-         << endl;
-}
+/**
+ * @brief The placeholders of the statement rendered on the current thread,
+ * nullptr while values are printed as text.
+ */
+thread_local PlaceholderSink *placeholderSink{nullptr};
 
-void StringNode::printInner(vector<int> indentFlags) const
+/**
+ * @brief The fingerprint of the statement rendered into an output.
+ */
+struct FingerprintSink
 {
-    cout << "\033[38;5;46m"
-            "["
-         << nodeName()
-         << "]"
-            "\033[0m"
-            "(value: "
-            "\033[38;5;46m"
-            "\""
-         << value_
-         << "\""
-            "\033[0m"
-            ")"
-         << endl;
-}
+    explicit FingerprintSink(const string &output) : output(&output)
+    {
+    }
 
-void NullNode::printInner(vector<int> indentFlags) const
-{
-    cout << "\033[38;5;196m"
-            "["
-         << nodeName()
-         << "]"
-            "\033[0m"
-         << endl;
-}
+    const string *output;
+    StatementFingerprint fingerprint;
+};
 
-void VariableNode::printInner(vector<int> indentFlags) const
+/**
+ * @brief The fingerprint computed on the current thread, nullptr if renders
+ * are not fingerprinted.
+ */
+thread_local FingerprintSink *fingerprintSink{nullptr};
+
+/**
+ * @brief Returns the fingerprint of the statement rendered into `sql`, or
+ * nullptr if `sql` is not fingerprinted, such as the value of a `@let`.
+ */
+inline StatementFingerprint *fingerprintOf(const string &sql)
 {
-    cout << "\033[38;5;105m"
-            "["
-         << nodeName()
-         << "]"
-            "\033[0m"
-            "(name: "
-            "\033[38;5;105m"
-         << name_
-         << "\033[0m"
-            ")"
-         << endl;
+    if (!fingerprintSink || fingerprintSink->output != &sql)
+    {
+        return nullptr;
+    }
+    return &fingerprintSink->fingerprint;
 }
 
-void BinaryOpNode::printInner(vector<int> indentFlags) const
+/**
+ * @brief Installs a thread-local sink until destroyed.
+ */
+template <typename Sink>
+class SinkScope
 {
-    cout << "\033[38;5;202m"
-            "["
-         << nodeName()
-         << "]"
-            "\033[0m"
-         << endl;
+  public:
+    SinkScope(Sink *&current, Sink &sink)
+        : current_(current), previous_(current)
+    {
+        current = &sink;
+    }
 
-    indentFlags.emplace_back(1);
-    left_->print(indentFlags);
+    ~SinkScope()
+    {
+        current_ = previous_;
+    }
 
-    indentFlags.back() = 0;
-    right_->print(indentFlags);
-}
+  private:
+    Sink *&current_;
+    Sink *previous_;
+};
 
-void SubSqlNode::printInner(vector<int> indentFlags) const
+/**
+ * @brief Adds a value printed into `sql` to its fingerprint, and prints it as
+ * a placeholder if a statement is rendered into `sql`.
+ * @return false if the value is to be printed as text.
+ */
+bool interceptValue(const ASTNode &node,
+                    const ParamScope &scope,
+                    string &sql,
+                    EscapeMode mode = EscapeMode::None)
 {
-    cout << "\033[38;5;226m"
-            "["
-         << nodeName()
-         << "]"
-            "\033[0m"
-            "(name: "
-            "\033[38;5;226m"
-         << name_
-         << "\033[0m"
-            ")"
-         << endl;
+    if (auto fingerprint = fingerprintOf(sql))
+    {
+        fingerprint->addValue();
+    }
+    if (!placeholderSink || !placeholderSink->owns(sql))
+    {
+        return false;
+    }
+    return placeholderSink->print(node, scope, mode, sql);
+}
+}  // namespace
 
-    if (params_.size() > 0)
+ParamScope::~ParamScope()
+{
+    if (bindings_)
     {
-        indentFlags.emplace_back(0);
-        printIndent(indentFlags);
-        cout << "\033[38;5;208m"
-                "[Parameters]"
-                "\033[0m"
-             << endl;
+        renderContext.release(bindings_);
+    }
+}
 
-        indentFlags.emplace_back(1);  // 此值会被覆盖，随意设置
-        size_t i = 0;
-        for (const auto &pair : params_)
+const ParamValue *ParamScope::find(const string &name) const
+{
+    for (auto scope = this; scope; scope = scope->parent_)
+    {
+        for (size_t i = 0; i < scope->bindingCount_; ++i)
         {
-            indentFlags.back() = i + 1 < params_.size();
-            printIndent(indentFlags);
-            cout << "\033[38;5;201m"
-                    "["
-                 << pair.first
-                 << "]"
-                    "\033[0m"
-                 << endl;
-
-            indentFlags.emplace_back(0);
-            pair.second->print(indentFlags);
-
-            ++i;
-            indentFlags.resize(indentFlags.size() - 1);
+            const auto &binding = (*scope->bindings_)[i];
+            if (binding.first == name)
+            {
+                return &binding.second;
+            }
+        }
+        if (scope->params_)
+        {
+            auto it = scope->params_->find(name);
+            if (it != scope->params_->end())
+            {
+                return &it->second;
+            }
+        }
+        if (scope->pmrParams_)
+        {
+            auto it = scope->pmrParams_->find(string_view(name));
+            if (it != scope->pmrParams_->end())
+            {
+                return &it->second;
+            }
+        }
+        if (scope->defaults_)
+        {
+            auto it = scope->defaults_->find(name);
+            if (it != scope->defaults_->end())
+            {
+                return &it->second;
+            }
         }
     }
+    return nullptr;
 }
 
-void NotNode::printInner(vector<int> indentFlags) const
+ParamValue &ParamScope::bind(const string &name)
 {
-    cout << "\033[38;5;202m"
-            "["
-         << nodeName()
-         << "]"
-            "\033[0m"
-         << endl;
-    indentFlags.emplace_back(1);
-    left_->print(indentFlags);
+    if (!bindings_)
+    {
+        bindings_ = renderContext.acquire();
+    }
+    for (size_t i = 0; i < bindingCount_; ++i)
+    {
+        if ((*bindings_)[i].first == name)
+        {
+            return (*bindings_)[i].second;
+        }
+    }
+    if (bindingCount_ == bindings_->size())
+    {
+        bindings_->emplace_back(name, 0);
+    }
+    else
+    {
+        (*bindings_)[bindingCount_].first = name;
+    }
+    return (*bindings_)[bindingCount_++].second;
 }
 
-void IfStmtNode::printInner(vector<int> indentFlags) const
+void ParamScope::unbind(const string &name)
 {
-    // [IfStatementNode]
-    cout << "\033[38;5;224m"
-            "["
-         << nodeName()
-         << "]"
-            "\033[0m"
-         << endl;
-
-    // [if_condition]
-    indentFlags.emplace_back(1);
-    printIndent(indentFlags);
-    cout << "\033[38;5;121m"
-            "[if_condition]"
-            "\033[0m"
-         << endl;
-    indentFlags.emplace_back(0);
-    condition_->print(indentFlags);
-
-    // [if_statement]
-    indentFlags.resize(indentFlags.size() - 1);
-    printIndent(indentFlags);
-    cout << "\033[38;5;203m"
-            "[if_statement]"
-            "\033[0m"
-         << endl;
-    indentFlags.emplace_back(0);
-    ifStmt_->print(indentFlags, true);
-
-    indentFlags.resize(indentFlags.size() - 1);
-    size_t i = 0;
-    for (const auto &pair : elIfStmts_)
+    for (size_t i = 0; i < bindingCount_; ++i)
     {
-        // [else_if_condition]
-        printIndent(indentFlags);
-        cout << "\033[38;5;121m"
-                "[else_if_condition]"
-                "\033[0m"
-             << endl;
-        indentFlags.emplace_back(elseStmt_ && i + 1 < elIfStmts_.size());
-        pair.first->print(indentFlags);
-
-        // [else_if_statement]
-        indentFlags.resize(indentFlags.size() - 1);
-        printIndent(indentFlags);
-        cout << "\033[38;5;203m"
-                "[else_if_statement]"
-                "\033[0m"
-             << endl;
-        indentFlags.emplace_back(elseStmt_ && i + 1 < elIfStmts_.size());
-        pair.second->print(indentFlags, true);
-
-        ++i;
-        indentFlags.resize(indentFlags.size() - 1);
+        if ((*bindings_)[i].first == name)
+        {
+            swap((*bindings_)[i], (*bindings_)[--bindingCount_]);
+            return;
+        }
     }
-    // [else_statement]
-    if (elseStmt_)
+}
+
+ParamList ParamScope::bindings() const
+{
+    ParamList result;
+    for (size_t i = 0; i < bindingCount_; ++i)
     {
-        indentFlags.resize(indentFlags.size() - 1);
-        indentFlags.emplace_back(0);
-        printIndent(indentFlags);
-        cout << "\033[38;5;203m"
-                "[else_statement]"
-                "\033[0m"
-             << endl;
-        indentFlags.emplace_back(0);
-        elseStmt_->print(indentFlags, true);
+        result.emplace((*bindings_)[i]);
     }
+    return result;
 }
 
-void ForLoopNode::printInner(vector<int> indentFlags) const
+Token Lexer::next()
 {
-    // [ForLoopNode]
-    cout << "\033[38;5;218m"
-            "["
-         << nodeName()
-         << "]"
-            "\033[0m"
+    if (done())
+    {
+        return {Done};
+    }
+    static const unordered_map<char, TokenType> tokenMap = {
+        {'(', LParen},
+        {')', RParen},
+        {',', Comma},
+        {'@', At},
+        {'$', Dollar},
+        {'{', LBrace},
+        {'}', RBrace},
+        {'[', LBracket},
+        {']', RBracket},
+        {'.', Dot},
+    };
+    static const unordered_map<string, TokenType> keywordMap = {
+        {"and", And},
+        {"or", Or},
+        {"not", Not},
+        {"if", If},
+        {"else", Else},
+        {"elif", ElIf},
+        {"endif", EndIf},
+        {"for", For},
+        {"separator", Separator},
+        {"in", In},
+        {"null", Null},
+        {"endfor", EndFor},
+    };
+    // Keywords of directives added later, which are only keywords right after
+    // `@`, so that templates may still use them as names, as in `${default}`
+    static const unordered_map<string, TokenType> directiveMap = {
+        {"switch", Switch},
+        {"case", Case},
+        {"default", Default},
+        {"endswitch", EndSwitch},
+        {"let", Let},
+        {"where", Where},
+        {"endwhere", EndWhere},
+        {"set", Set},
+        {"endset", EndSet},
+    };
+    auto afterAt = afterAt_;
+    afterAt_ = false;
+    auto c = sql_[pos_];
+    // Non-special syntax characters
+    if (parenDepth_ == 0)
+    {
+        if (c == '@')
+        {
+            cancelOnceLParen_ = true;
+        }
+        if (c == '@' || c == '$')
+        {
+            afterAt_ = c == '@';
+            ++parenDepth_;
+            ++pos_;
+            return {tokenMap.at(c)};
+        }
+        string value;
+        while (!done() && c != '@' && c != '$')
+        {
+            value += c;
+            c = sql_[++pos_];
+        }
+        return {NormalText, value};
+    }
+    // Skip whitespace characters
+    while (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+    {
+        c = sql_[++pos_];
+    }
+
+    // Single character token
+    switch (c)
+    {
+        case '@':
+            cancelOnceLParen_ = true;
+            afterAt_ = true;
+            [[fallthrough]];
+        case '$':
+            ++parenDepth_;
+            goto label;
+        case '(':
+            if (!cancelOnceLParen_)
+            {
+                ++parenDepth_;
+            }
+            cancelOnceLParen_ = false;
+            goto label;
+        case ')':
+        case '}':
+            --parenDepth_;
+            [[fallthrough]];
+        case ',':
+        case '{':
+        case '.':
+        case '[':
+        case ']':
+        label:
+            return {tokenMap.at(sql_[pos_++])};
+    }
+
+    // ! or !=
+    if (c == '!')
+    {
+        if (pos_ + 1 < sql_.size() && sql_[pos_ + 1] == '=')
+        {
+            pos_ += 2;
+            return {NEQ};
+        }
+        else
+        {
+            ++pos_;
+            return {Not};
+        }
+    }
+    // = or ==
+    else if (c == '=')
+    {
+        if (pos_ + 1 < sql_.size() && sql_[pos_ + 1] == '=')
+        {
+            pos_ += 2;
+            return {EQ};
+        }
+        else
+        {
+            ++pos_;
+            return {Assign};
+        }
+    }
+    // &&
+    else if (c == '&' && pos_ + 1 < sql_.size() && sql_[pos_ + 1] == '&')
+    {
+        pos_ += 2;
+        return {And};
+    }
+    // ||
+    else if (c == '|' && pos_ + 1 < sql_.size() && sql_[pos_ + 1] == '|')
+    {
+        pos_ += 2;
+        return {Or};
+    }
+    // Parameter value, string format
+    else if (c == '\'' || c == '"')
+    {
+        ++pos_;
+        string str;
+        while (!done() && sql_[pos_] != c)
+        {
+            str += sql_[pos_++];
+        }
+        if (done())
+        {
+            throw runtime_error("Invalid expression. Unclosed string.");
+        }
+        ++pos_;
+        return {String, str};
+    }
+    // Sub-SQL name or parameter name or keyword
+    else if (isalpha(c) || c == '_' || c & 0x80)
+    {
+        string identifier;
+        while (!done() &&
+               (isalnum(sql_[pos_]) || sql_[pos_] == '_' || sql_[pos_] & 0x80))
+        {
+            identifier += sql_[pos_++];
+        }
+        if (afterAt)
+        {
+            auto directive = directiveMap.find(identifier);
+            // `@where(` and `@set(` call sub-SQL statements of these names
+            auto call = directive != directiveMap.end() &&
+                        (directive->second == Where ||
+                         directive->second == Set) &&
+                        !done() && sql_[pos_] == '(';
+            if (directive != directiveMap.end() && !call)
+            {
+                if (directive->second != Switch &&
+                    directive->second != Case && directive->second != Let)
+                {
+                    --parenDepth_;
+                }
+                return {directive->second};
+            }
+        }
+        if (keywordMap.count(identifier))
+        {
+            if (identifier == "else" || identifier == "endif" ||
+                identifier == "endfor")
+            {
+                --parenDepth_;
+            }
+            return {keywordMap.at(identifier)};
+        }
+        return {Identifier, identifier};
+    }
+    // Parameter value, integer format
+    else if (isdigit(c))
+    {
+        string num;
+        while (!done() && (isdigit(sql_[pos_])))
+        {
+            num += sql_[pos_++];
+        }
+        if (num.size() == 1)
+        {
+            return {Integer, num};
+        }
+        else if (num.size() > 1 && num[0] == '0')
+        {
+            size_t i = 1;
+            for (; i < num.size() && num[i] == '0'; ++i)
+                ;
+            return {Integer, i == num.size() ? "0" : num.substr(i)};
+        }
+    }
+
+    throw runtime_error("Invalid expression(" + std::to_string(pos_) +
+                        "): " + sql_.substr(pos_));
+}
+
+ColumnBatch &ColumnBatch::add(string name, Column column)
+{
+    auto rows = visit([](const auto &cells) { return cells.size(); }, column);
+    if (!columns_.empty() && rows != rows_)
+    {
+        throw runtime_error("Column " + name + " has " + std::to_string(rows) +
+                            " rows instead of " + std::to_string(rows_));
+    }
+    if (this->column(name))
+    {
+        throw runtime_error("Duplicate column: " + name);
+    }
+    rows_ = rows;
+    columns_.emplace_back(std::move(name), std::move(column));
+    return *this;
+}
+
+bool tl::sql::toBool(const ParamItem &value)
+{
+    if (!value)
+    {
+        return false;
+    }
+    if (holds_alternative<int32_t>(*value))
+    {
+        return get<int32_t>(*value) != 0;
+    }
+    else if (holds_alternative<string>(*value))
+    {
+        return get<string>(*value) != "";
+    }
+    else if (holds_alternative<int64_t>(*value))
+    {
+        return get<int64_t>(*value) != 0;
+    }
+    else if (holds_alternative<double>(*value))
+    {
+        return get<double>(*value) != 0;
+    }
+    else if (holds_alternative<bool>(*value))
+    {
+        return get<bool>(*value);
+    }
+    // Json::Value or an array
+    return true;
+}
+
+string ASTNode::generateSql(const ParamList &params) const
+{
+    string result;
+    generateSql(params, result);
+    return result;
+}
+
+void ASTNode::generateSql(const ParamList &params, string &sql) const
+{
+    generateSql(ParamScope(params), sql);
+}
+
+void ASTNode::generateSql(const ParamScope &scope, string &sql) const
+{
+    for (auto node = this; node; node = node->nextSibling_.get())
+    {
+        TL_SQL_PROBE_NODE(node->nodeName());
+        RenderProfiler::Scope profile([node] { return node->profileLabel(); });
+        auto size = sql.size();
+        node->appendSql(scope, sql);
+        profile.setBytes(sql.size() - size);
+    }
+}
+
+bool ASTNode::assignValue(const ParamScope &scope, ParamValue &target) const
+{
+    auto value = getValue(scope);
+    if (!value)
+    {
+        return false;
+    }
+    target = std::move(*value);
+    return true;
+}
+
+void ASTNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    if (interceptValue(*this, scope, sql))
+    {
+        return;
+    }
+    auto value = getValue(scope);
+    if (value)
+    {
+        appendValue(*value, sql);
+    }
+}
+
+void ASTNode::analyze(AstStats &stats, size_t loopDepth) const
+{
+    for (auto node = this; node; node = node->nextSibling_.get())
+    {
+        node->analyzeInner(stats, loopDepth);
+    }
+}
+
+void ASTNode::canonicalizeWhitespace(WhitespaceState &state)
+{
+    for (auto node = this; node; node = node->nextSibling_.get())
+    {
+        node->canonicalizeInner(state);
+    }
+}
+
+void ASTNode::analyzeInner(AstStats &stats, size_t loopDepth) const
+{
+    ++stats.nodes;
+    stats.addBytes(AstStats::kPrintedValueBytes, loopDepth);
+}
+
+size_t ASTNode::countNodes(const ASTNodePtr &expr)
+{
+    if (!expr)
+    {
+        return 0;
+    }
+    AstStats stats;
+    expr->analyze(stats);
+    return stats.nodes;
+}
+
+void NormalTextNode::appendSql(const ParamScope &, string &sql) const
+{
+    TL_SQL_PROBE_OUTPUT(sql);
+    if (auto fingerprint = fingerprintOf(sql))
+    {
+        fingerprint->addText(text_);
+    }
+    sql += text_;
+}
+
+void NormalTextNode::analyzeInner(AstStats &stats, size_t loopDepth) const
+{
+    ++stats.nodes;
+    stats.literalBytes += text_.size();
+    stats.addBytes(text_.size(), loopDepth);
+}
+
+namespace
+{
+inline bool isWhitespace(char c)
+{
+    return isspace(static_cast<unsigned char>(c));
+}
+}  // namespace
+
+void NormalTextNode::canonicalizeInner(WhitespaceState &state)
+{
+    string text;
+    text.reserve(text_.size());
+    auto size = text_.size();
+    for (size_t i = 0; i < size; ++i)
+    {
+        auto c = text_[i];
+        auto next = i + 1 < size ? text_[i + 1] : '\0';
+        if (state.quote)
+        {
+            // A backslash escape is kept verbatim as well
+            text += c;
+            if (c == '\\' && next)
+            {
+                text += next;
+                ++i;
+            }
+            else if (c == state.quote)
+            {
+                state.quote = 0;
+            }
+            continue;
+        }
+        if (state.lineComment)
+        {
+            text += c;
+            if (c == '\n')
+            {
+                // The newline ends the comment, so it is the separating space
+                state.lineComment = false;
+                state.afterSpace = true;
+            }
+            continue;
+        }
+        if (state.blockComment)
+        {
+            text += c;
+            if (c == '*' && next == '/')
+            {
+                text += next;
+                ++i;
+                state.blockComment = false;
+            }
+            continue;
+        }
+        if (isWhitespace(c))
+        {
+            while (i + 1 < size && isWhitespace(text_[i + 1]))
+            {
+                ++i;
+            }
+            if (!state.afterSpace)
+            {
+                text += ' ';
+                state.afterSpace = true;
+            }
+            continue;
+        }
+        text += c;
+        state.afterSpace = false;
+        if (c == '\'' || c == '"' || c == '`')
+        {
+            state.quote = c;
+        }
+        else if (c == '-' && next == '-')
+        {
+            text += next;
+            ++i;
+            state.lineComment = true;
+        }
+        else if (c == '/' && next == '*')
+        {
+            text += next;
+            ++i;
+            state.blockComment = true;
+        }
+    }
+    text_ = move(text);
+}
+
+void NormalTextNode::trimEnd()
+{
+    auto end = text_.find_last_not_of(" \t\n\r\f\v");
+    text_.erase(end == string::npos ? 0 : end + 1);
+}
+
+bool ASTNode::usesNames(const vector<string> &names) const
+{
+    return usesName([&names](const string &name) {
+        return find(names.begin(), names.end(), name) != names.end();
+    });
+}
+
+bool BinaryOpNode::usesName(const NamePredicate &predicate) const
+{
+    return (left_ && left_->usesName(predicate)) ||
+           (right_ && right_->usesName(predicate));
+}
+
+bool SubSqlNode::usesName(const NamePredicate &predicate) const
+{
+    return any_of(params_.begin(),
+                  params_.end(),
+                  [&predicate](const auto &param) {
+                      return param.second->usesName(predicate);
+                  });
+}
+
+void BinaryOpNode::analyzeInner(AstStats &stats, size_t loopDepth) const
+{
+    ASTNode::analyzeInner(stats, loopDepth);
+    stats.nodes += countNodes(left_) + countNodes(right_);
+}
+
+void SubSqlNode::analyzeInner(AstStats &stats, size_t loopDepth) const
+{
+    ++stats.nodes;
+    for (const auto &param : params_)
+    {
+        // A parameter may be a sub-SQL call itself
+        AstStats paramStats;
+        param.second->analyze(paramStats, loopDepth);
+        stats.nodes += paramStats.nodes;
+        stats.subSqlCalls.insert(stats.subSqlCalls.end(),
+                                 paramStats.subSqlCalls.begin(),
+                                 paramStats.subSqlCalls.end());
+    }
+    stats.subSqlCalls.emplace_back(name_, loopDepth);
+}
+
+ParamItem VariableNode::getValue(const ParamScope &scope) const
+{
+    ParamValue value;
+    if (!assignValue(scope, value))
+    {
+        return nullopt;
+    }
+    return value;
+}
+
+bool VariableNode::assignValue(const ParamScope &scope,
+                               ParamValue &target) const
+{
+    auto value = scope.find(name_);
+    if (!value)
+    {
+        return false;
+    }
+    // A JSON scalar is unwrapped like a member of a JSON object
+    if (auto json = get_if<Json::Value>(value))
+    {
+        assignJson(target, *json);
+    }
+    else
+    {
+        target = *value;
+    }
+    return true;
+}
+
+const Json::Value *VariableNode::findJson(const ParamScope &scope) const
+{
+    auto value = scope.find(name_);
+    return value && holds_alternative<Json::Value>(*value)
+               ? &get<Json::Value>(*value)
+               : nullptr;
+}
+
+const ParamValue *VariableNode::findValue(const ParamScope &scope) const
+{
+    return scope.find(name_);
+}
+
+bool VariableNode::usesName(const NamePredicate &predicate) const
+{
+    return predicate(name_);
+}
+
+void VariableNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    if (interceptValue(*this, scope, sql))
+    {
+        return;
+    }
+    auto value = scope.find(name_);
+    if (value)
+    {
+        appendValue(*value, sql);
+    }
+}
+
+const Json::Value *MemberNode::findJson(const ParamScope &scope) const
+{
+    auto json = left_->findJson(scope);
+    if (json && json->isObject())
+    {
+        return json->find(memberName_.data(),
+                          memberName_.data() + memberName_.size());
+    }
+    return nullptr;
+}
+
+const Column *MemberNode::findCell(const ParamScope &scope,
+                                   size_t &row) const
+{
+    auto value = left_->findValue(scope);
+    auto columnRow = value ? get_if<ColumnRow>(value) : nullptr;
+    if (!columnRow)
+    {
+        return nullptr;
+    }
+    row = columnRow->row;
+    return columnRow->batch->column(memberName_);
+}
+
+ParamItem MemberNode::getValue(const ParamScope &scope) const
+{
+    ParamValue value;
+    if (!assignValue(scope, value))
+    {
+        return nullopt;
+    }
+    return value;
+}
+
+bool MemberNode::assignValue(const ParamScope &scope, ParamValue &target) const
+{
+    auto result = findJson(scope);
+    if (result)
+    {
+        assignJson(target, *result);
+        return true;
+    }
+    size_t row;
+    auto column = findCell(scope, row);
+    if (!column)
+    {
+        return false;
+    }
+    assignCell(*column, row, target);
+    return true;
+}
+
+void MemberNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    if (interceptValue(*this, scope, sql))
+    {
+        return;
+    }
+    auto result = findJson(scope);
+    if (result)
+    {
+        appendJson(*result, sql);
+        return;
+    }
+    // A cell of a ColumnBatch is printed from its column
+    size_t row;
+    if (auto column = findCell(scope, row))
+    {
+        appendCell(*column, row, sql);
+    }
+}
+
+string MemberNode::sourceText() const
+{
+    return left_->sourceText() + "." + memberName_;
+}
+
+const Json::Value *ArrayNode::findJson(const ParamScope &scope) const
+{
+    auto json = left_->findJson(scope);
+    if (!json)
+    {
+        return nullptr;
+    }
+    const Json::Value *result = nullptr;
+    auto rightValue = right_->getValue(scope);
+    if (holds_alternative<int32_t>(*rightValue))
+    {
+        auto index = get<int32_t>(*rightValue);
+        if (json->isArray() && index >= 0 &&
+            index < static_cast<int>(json->size()))
+        {
+            result = &(*json)[index];
+        }
+    }
+    else if (holds_alternative<string>(*rightValue))
+    {
+        const auto &memberName = get<string>(*rightValue);
+        if (json->isObject())
+        {
+            result = json->find(memberName.data(),
+                                memberName.data() + memberName.size());
+        }
+    }
+    return result ? result : &Json::Value::nullSingleton();
+}
+
+ParamItem ArrayNode::getValue(const ParamScope &scope) const
+{
+    auto result = findJson(scope);
+    if (!result)
+    {
+        return nullopt;
+    }
+    return jsonToParamItem(*result);
+}
+
+bool ArrayNode::assignValue(const ParamScope &scope, ParamValue &target) const
+{
+    auto result = findJson(scope);
+    if (!result)
+    {
+        return false;
+    }
+    assignJson(target, *result);
+    return true;
+}
+
+void ArrayNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    if (interceptValue(*this, scope, sql))
+    {
+        return;
+    }
+    auto result = findJson(scope);
+    if (result)
+    {
+        appendJson(*result, sql);
+    }
+}
+
+string ArrayNode::sourceText() const
+{
+    return left_->sourceText() + "[" + right_->sourceText() + "]";
+}
+
+ParamItem EscapeNode::getValue(const ParamScope &scope) const
+{
+    auto value = value_->getValue(scope);
+    if (value && holds_alternative<string>(*value))
+    {
+        string escaped;
+        appendEscaped(get<string>(*value), mode_, escaped);
+        return escaped;
+    }
+    return value;
+}
+
+void EscapeNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    // A bound argument keeps only the escaping of a LIKE pattern
+    if (interceptValue(*value_, scope, sql, mode_))
+    {
+        return;
+    }
+    TL_SQL_PROBE_OUTPUT(sql);
+    // Escape the parameter itself rather than a copy of it
+    auto value = value_->findValue(scope);
+    if (value && !holds_alternative<Json::Value>(*value))
+    {
+        if (holds_alternative<string>(*value))
+        {
+            appendEscaped(get<string>(*value), mode_, sql);
+        }
+        else
+        {
+            appendValue(*value, sql);
+        }
+        return;
+    }
+    if (auto json = value_->findJson(scope))
+    {
+        const char *begin;
+        const char *end;
+        if (json->isString() && json->getString(&begin, &end))
+        {
+            appendEscaped(string_view(begin, end - begin), mode_, sql);
+        }
+        else
+        {
+            appendJson(*json, sql);
+        }
+        return;
+    }
+    size_t row;
+    if (auto column = value_->findCell(scope, row))
+    {
+        if (auto strings = get_if<vector<string>>(column))
+        {
+            appendEscaped((*strings)[row], mode_, sql);
+        }
+        else
+        {
+            appendCell(*column, row, sql);
+        }
+        return;
+    }
+    auto item = value_->getValue(scope);
+    if (item && holds_alternative<string>(*item))
+    {
+        appendEscaped(get<string>(*item), mode_, sql);
+    }
+    else if (item)
+    {
+        appendValue(*item, sql);
+    }
+}
+
+void EscapeNode::analyzeInner(AstStats &stats, size_t loopDepth) const
+{
+    ++stats.nodes;
+    value_->analyze(stats, loopDepth);
+}
+
+void SubSqlNode::bindArguments(const ParamScope &scope,
+                               ParamScope &arguments) const
+{
+    for (const auto &param : params_)
+    {
+        if (!param.second->assignValue(scope, arguments.bind(param.first)))
+        {
+            arguments.unbind(param.first);
+            LOG_ERROR << "Parameter " << param.first << " not found";
+        }
+    }
+}
+
+void SubSqlNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    ParamScope arguments;
+    bindArguments(scope, arguments);
+    if (subSqlRenderer_)
+    {
+        subSqlRenderer_(name_, arguments, sql);
+        return;
+    }
+    auto subSql = subSqlGetter_(name_, arguments.bindings());
+    TL_SQL_PROBE_OUTPUT(sql);
+    if (auto fingerprint = fingerprintOf(sql))
+    {
+        // The text of the getter cannot be told apart from its values
+        fingerprint->addValue();
+    }
+    sql += subSql;
+}
+
+ParamItem SubSqlNode::getValue(const ParamScope &scope) const
+{
+    string result;
+    appendSql(scope, result);
+    return result;
+}
+
+bool SubSqlNode::assignValue(const ParamScope &scope, ParamValue &target) const
+{
+    if (!holds_alternative<string>(target))
+    {
+        target.emplace<string>();
+    }
+    auto &result = get<string>(target);
+    result.clear();
+    appendSql(scope, result);
+    return true;
+}
+
+ParamItem AndNode::getValue(const ParamScope &scope) const
+{
+    auto leftValue = left_->getValue(scope);
+    auto rightValue = right_->getValue(scope);
+    if (!toBool(leftValue))
+    {
+        return 0;  // false
+    }
+    return toBool(rightValue);
+}
+
+ParamItem OrNode::getValue(const ParamScope &scope) const
+{
+    auto leftValue = left_->getValue(scope);
+    auto rightValue = right_->getValue(scope);
+    if (toBool(leftValue))
+    {
+        return 1;  // true
+    }
+    return toBool(rightValue);
+}
+
+ParamItem EQNode::getValue(const ParamScope &scope) const
+{
+    auto leftValue = left_->getValue(scope);
+    auto rightValue = right_->getValue(scope);
+    if (!leftValue && !rightValue)
+    {
+        return 1;  // true
+    }
+    if (!leftValue || !rightValue)
+    {
+        return 0;  // false
+    }
+    return valuesEqual(*leftValue, *rightValue);
+}
+
+ParamItem NEQNode::getValue(const ParamScope &scope) const
+{
+    auto leftValue = left_->getValue(scope);
+    auto rightValue = right_->getValue(scope);
+    if (!leftValue && !rightValue)
+    {
+        return 0;  // false
+    }
+    if (!leftValue || !rightValue)
+    {
+        return 1;  // true
+    }
+    return !valuesEqual(*leftValue, *rightValue);
+}
+
+const ASTNodePtr *IfStmtNode::selectBranch(const ParamScope &scope) const
+{
+    if (placeholderSink && placeholderSink->enumerating())
+    {
+        // Every branch, and taking none of them without an else branch
+        auto choice = placeholderSink->choose(elIfStmts_.size() + 2);
+        if (choice == 0)
+        {
+            return &ifStmt_;
+        }
+        if (choice <= elIfStmts_.size())
+        {
+            return &elIfStmts_[choice - 1].second;
+        }
+        return elseStmt_ ? &elseStmt_ : nullptr;
+    }
+    auto condition = condition_->getValue(scope);
+    if (toBool(condition))
+    {
+        return &ifStmt_;
+    }
+    for (const auto &elseIfStmt : elIfStmts_)
+    {
+        auto elseIfCondition = elseIfStmt.first->getValue(scope);
+        if (toBool(elseIfCondition))
+        {
+            return &elseIfStmt.second;
+        }
+    }
+    if (elseStmt_)
+    {
+        return &elseStmt_;
+    }
+    return nullptr;
+}
+
+ParamItem IfStmtNode::getValue(const ParamScope &scope) const
+{
+    auto branch = selectBranch(scope);
+    if (!branch)
+    {
+        return nullopt;
+    }
+    string result;
+    if (*branch)
+    {
+        (*branch)->generateSql(scope, result);
+    }
+    return result;
+}
+
+void IfStmtNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    auto branch = selectBranch(scope);
+    if (branch && *branch)
+    {
+        (*branch)->generateSql(scope, sql);
+    }
+}
+
+void IfStmtNode::canonicalizeInner(WhitespaceState &state)
+{
+    // Every branch starts where the statement starts, and the statement ends
+    // with whitespace only if every branch, or skipping them all, does
+    auto entry = state;
+    auto afterSpace = true;
+    auto visit = [&entry, &state, &afterSpace](const ASTNodePtr &branch) {
+        state = entry;
+        if (branch)
+        {
+            branch->canonicalizeWhitespace(state);
+        }
+        afterSpace = afterSpace && state.afterSpace;
+    };
+    visit(ifStmt_);
+    for (const auto &elseIfStmt : elIfStmts_)
+    {
+        visit(elseIfStmt.second);
+    }
+    // Without an else branch, none of the branches may be taken
+    visit(elseStmt_);
+    state.afterSpace = afterSpace;
+}
+
+void IfStmtNode::analyzeInner(AstStats &stats, size_t loopDepth) const
+{
+    ++stats.nodes;
+    stats.nodes += countNodes(condition_);
+    size_t baseBytes = 0;
+    size_t perIterationBytes = 0;
+    auto addBranch = [&](const ASTNodePtr &branch) {
+        if (!branch)
+        {
+            return;
+        }
+        AstStats branchStats;
+        branch->analyze(branchStats, loopDepth);
+        stats.nodes += branchStats.nodes;
+        stats.literalBytes += branchStats.literalBytes;
+        stats.loopDepth = max(stats.loopDepth, branchStats.loopDepth);
+        stats.subSqlCalls.insert(stats.subSqlCalls.end(),
+                                 branchStats.subSqlCalls.begin(),
+                                 branchStats.subSqlCalls.end());
+        baseBytes = max(baseBytes, branchStats.baseBytes);
+        perIterationBytes =
+            max(perIterationBytes, branchStats.perIterationBytes);
+    };
+    addBranch(ifStmt_);
+    for (const auto &elseIfStmt : elIfStmts_)
+    {
+        stats.nodes += countNodes(elseIfStmt.first);
+        addBranch(elseIfStmt.second);
+    }
+    addBranch(elseStmt_);
+    stats.baseBytes += baseBytes;
+    stats.perIterationBytes += perIterationBytes;
+}
+
+void SwitchStmtNode::addCase(const vector<ASTNodePtr> &labels,
+                             const ASTNodePtr &branch)
+{
+    auto index = cases_.size();
+    for (const auto &label : labels)
+    {
+        auto value = dynamic_cast<const NumberNode *>(label.get()) ||
+                             dynamic_cast<const StringNode *>(label.get())
+                         ? label->getValue()
+                         : nullopt;
+        if (!value)
+        {
+            throw runtime_error(
+                "Invalid expression. The label of a @case must be an integer "
+                "or a string: " +
+                label->sourceText());
+        }
+        auto inserted =
+            holds_alternative<string>(*value)
+                ? stringCases_.emplace(get<string>(*value), index).second
+                : integerCases_.emplace(get<int32_t>(*value), index).second;
+        if (!inserted)
+        {
+            throw runtime_error("Invalid expression. Duplicate @case label: " +
+                                label->sourceText());
+        }
+    }
+    cases_.emplace_back(labels, branch);
+}
+
+const ASTNodePtr *SwitchStmtNode::selectBranch(const ParamScope &scope) const
+{
+    if (placeholderSink && placeholderSink->enumerating())
+    {
+        auto choice = placeholderSink->choose(cases_.size() + 1);
+        if (choice < cases_.size())
+        {
+            return &cases_[choice].second;
+        }
+        return hasDefault_ ? &default_ : nullptr;
+    }
+    // Look the subject up in place rather than copy it
+    ParamItem copy;
+    auto value = subject_->findValue(scope);
+    if (!value)
+    {
+        copy = subject_->getValue(scope);
+        value = copy ? &*copy : nullptr;
+    }
+    const ASTNodePtr *branch = hasDefault_ ? &default_ : nullptr;
+    if (!value)
+    {
+        return branch;
+    }
+    if (auto text = get_if<string>(value))
+    {
+        auto it = stringCases_.find(*text);
+        return it == stringCases_.end() ? branch : &cases_[it->second].second;
+    }
+    auto integral = integralValue(*value);
+    if (auto number = get_if<double>(value))
+    {
+        // A double matches an integer label of the same value, as in `==`
+        if (*number >= -0x1p63 && *number < 0x1p63 &&
+            *number == static_cast<double>(static_cast<int64_t>(*number)))
+        {
+            integral = static_cast<int64_t>(*number);
+        }
+    }
+    if (!integral)
+    {
+        return branch;
+    }
+    auto it = integerCases_.find(*integral);
+    return it == integerCases_.end() ? branch : &cases_[it->second].second;
+}
+
+ParamItem SwitchStmtNode::getValue(const ParamScope &scope) const
+{
+    auto branch = selectBranch(scope);
+    if (!branch)
+    {
+        return nullopt;
+    }
+    string result;
+    if (*branch)
+    {
+        (*branch)->generateSql(scope, result);
+    }
+    return result;
+}
+
+void SwitchStmtNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    auto branch = selectBranch(scope);
+    if (branch && *branch)
+    {
+        (*branch)->generateSql(scope, sql);
+    }
+}
+
+void SwitchStmtNode::canonicalizeInner(WhitespaceState &state)
+{
+    // As with @if, every branch starts where the statement starts
+    auto entry = state;
+    auto afterSpace = true;
+    auto visit = [&entry, &state, &afterSpace](const ASTNodePtr &branch) {
+        state = entry;
+        if (branch)
+        {
+            branch->canonicalizeWhitespace(state);
+        }
+        afterSpace = afterSpace && state.afterSpace;
+    };
+    for (const auto &switchCase : cases_)
+    {
+        visit(switchCase.second);
+    }
+    visit(default_);
+    state.afterSpace = afterSpace;
+}
+
+void SwitchStmtNode::analyzeInner(AstStats &stats, size_t loopDepth) const
+{
+    ++stats.nodes;
+    stats.nodes += countNodes(subject_);
+    size_t baseBytes = 0;
+    size_t perIterationBytes = 0;
+    auto addBranch = [&](const ASTNodePtr &branch) {
+        if (!branch)
+        {
+            return;
+        }
+        AstStats branchStats;
+        branch->analyze(branchStats, loopDepth);
+        stats.nodes += branchStats.nodes;
+        stats.literalBytes += branchStats.literalBytes;
+        stats.loopDepth = max(stats.loopDepth, branchStats.loopDepth);
+        stats.subSqlCalls.insert(stats.subSqlCalls.end(),
+                                 branchStats.subSqlCalls.begin(),
+                                 branchStats.subSqlCalls.end());
+        baseBytes = max(baseBytes, branchStats.baseBytes);
+        perIterationBytes =
+            max(perIterationBytes, branchStats.perIterationBytes);
+    };
+    for (const auto &switchCase : cases_)
+    {
+        stats.nodes += switchCase.first.size();
+        addBranch(switchCase.second);
+    }
+    addBranch(default_);
+    stats.baseBytes += baseBytes;
+    stats.perIterationBytes += perIterationBytes;
+}
+
+ParamItem LetNode::getValue(const ParamScope &scope) const
+{
+    string result;
+    appendSql(scope, result);
+    return result;
+}
+
+void LetNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    // The value is assigned into the pooled slot of a child frame
+    ParamScope letScope(&scope);
+    if (!value_->assignValue(scope, letScope.bind(name_)))
+    {
+        letScope.unbind(name_);
+    }
+    if (body_)
+    {
+        body_->generateSql(letScope, sql);
+    }
+}
+
+void LetNode::canonicalizeInner(WhitespaceState &state)
+{
+    // The binding prints nothing
+    if (body_)
+    {
+        body_->canonicalizeWhitespace(state);
+    }
+}
+
+void LetNode::analyzeInner(AstStats &stats, size_t loopDepth) const
+{
+    ++stats.nodes;
+    AstStats valueStats;
+    value_->analyze(valueStats, loopDepth);
+    stats.nodes += valueStats.nodes;
+    stats.subSqlCalls.insert(stats.subSqlCalls.end(),
+                             valueStats.subSqlCalls.begin(),
+                             valueStats.subSqlCalls.end());
+    if (body_)
+    {
+        body_->analyze(stats, loopDepth);
+    }
+}
+
+namespace
+{
+/**
+ * @brief Returns the length of `word` if `text` starts with it, ignoring
+ * case, and the word ends there, 0 otherwise.
+ */
+size_t leadingWord(string_view text, string_view word)
+{
+    if (text.size() < word.size())
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < word.size(); ++i)
+    {
+        if (toupper(static_cast<unsigned char>(text[i])) != word[i])
+        {
+            return 0;
+        }
+    }
+    if (text.size() > word.size() && !isWhitespace(text[word.size()]) &&
+        text[word.size()] != '(')
+    {
+        return 0;
+    }
+    return word.size();
+}
+}  // namespace
+
+ParamItem TrimBlockNode::getValue(const ParamScope &scope) const
+{
+    string result;
+    appendSql(scope, result);
+    return result;
+}
+
+void TrimBlockNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    auto start = sql.size();
+    {
+        TL_SQL_PROBE_OUTPUT(sql);
+        if (auto fingerprint = fingerprintOf(sql))
+        {
+            fingerprint->addText(keyword());
+        }
+        sql += keyword();
+    }
+    auto bodyStart = sql.size();
+    if (body_)
+    {
+        body_->generateSql(scope, sql);
+    }
+    auto sink = placeholderSink && placeholderSink->owns(sql) ? placeholderSink
+                                                              : nullptr;
+    if (sink)
+    {
+        // The block is trimmed after the arguments are taken out of it
+        sink->scan(sql);
+    }
+    // Only the two ends of the block are examined
+    auto begin = bodyStart;
+    auto end = sql.size();
+    auto isTrimmed = [this](char c) {
+        return isWhitespace(c) || (kind_ == Kind::Set && c == ',');
+    };
+    while (begin < end && isTrimmed(sql[begin]))
+    {
+        ++begin;
+    }
+    if (kind_ == Kind::Where)
+    {
+        string_view rest(sql.data() + begin, end - begin);
+        auto word = leadingWord(rest, "AND");
+        begin += word ? word : leadingWord(rest, "OR");
+        while (begin < end && isWhitespace(sql[begin]))
+        {
+            ++begin;
+        }
+    }
+    while (end > begin && isTrimmed(sql[end - 1]))
+    {
+        --end;
+    }
+    if (begin == end)
+    {
+        if (sink)
+        {
+            sink->erased(start, sql.size() - start);
+        }
+        sql.resize(start);
+        return;
+    }
+    if (sink)
+    {
+        sink->erased(end, sql.size() - end);
+        sink->erased(bodyStart, begin - bodyStart);
+    }
+    sql.resize(end);
+    sql.erase(bodyStart, begin - bodyStart);
+}
+
+bool TrimBlockNode::usesName(const NamePredicate &predicate) const
+{
+    for (auto node = body_.get(); node; node = node->nextSibling())
+    {
+        if (node->usesName(predicate))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TrimBlockNode::canonicalizeInner(WhitespaceState &state)
+{
+    auto entry = state;
+    // The keyword ends with a space, and the block is trimmed at runtime
+    state.afterSpace = true;
+    if (body_)
+    {
+        body_->canonicalizeWhitespace(state);
+    }
+    // Without a body the keyword is removed again
+    state.afterSpace = entry.afterSpace && !body_;
+}
+
+void TrimBlockNode::analyzeInner(AstStats &stats, size_t loopDepth) const
+{
+    ++stats.nodes;
+    stats.literalBytes += keyword().size();
+    stats.addBytes(keyword().size(), loopDepth);
+    if (body_)
+    {
+        body_->analyze(stats, loopDepth);
+    }
+}
+
+ParamItem HoistedValueNode::getValue(const ParamScope &scope) const
+{
+    auto text = scope.find(slot_);
+    if (!text)
+    {
+        return nullopt;
+    }
+    return *text;
+}
+
+void HoistedValueNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    // Placeholders are numbered per print, so the value is printed in place
+    if (placeholderSink)
+    {
+        original_->generateSql(scope, sql);
+        return;
+    }
+    auto text = scope.find(slot_);
+    if (auto fingerprint = fingerprintOf(sql))
+    {
+        auto hoisted = scope.find(fingerprintSlot_);
+        fingerprint->addFingerprint(
+            hoisted ? static_cast<uint64_t>(get<int64_t>(*hoisted)) : 0);
+    }
+    if (text)
+    {
+        TL_SQL_PROBE_OUTPUT(sql);
+        sql += get<string>(*text);
+    }
+}
+
+ParamItem ForLoopNode::getValue(const ParamScope &scope) const
+{
+    string result;
+    appendSql(scope, result);
+    return result;
+}
+
+void ForLoopNode::appendSql(const ParamScope &scope, string &sql) const
+{
+    // Iterate over the parameter itself rather than over a copy of it
+    ParamItem collection;
+    auto collectionJson = collection_->findJson(scope);
+    auto collectionValue =
+        collectionJson ? nullptr : collection_->findValue(scope);
+    if (!collectionJson && !collectionValue)
+    {
+        collection = collection_->getValue(scope);
+        collectionValue = collection ? &*collection : nullptr;
+    }
+    auto ints = collectionValue ? get_if<IntArray>(collectionValue) : nullptr;
+    auto int64s =
+        collectionValue ? get_if<Int64Array>(collectionValue) : nullptr;
+    auto batch =
+        collectionValue ? get_if<ColumnBatch>(collectionValue) : nullptr;
+    if (!collectionJson && !ints && !int64s && !batch)
+    {
+        collectionJson = collectionValue ? &get<Json::Value>(*collectionValue)
+                                         : &Json::Value::nullSingleton();
+    }
+    if (placeholderSink && placeholderSink->enumerating() && collectionJson &&
+        collectionJson->isNull())
+    {
+        // The number of iterations of a missing collection is unknown
+        placeholderSink->unknownLoop = true;
+    }
+    size_t iterations = 0;
+    if (ints)
+    {
+        iterations = ints->size();
+    }
+    else if (int64s)
+    {
+        iterations = int64s->size();
+    }
+    else if (batch)
+    {
+        iterations = batch->rows();
+    }
+    else if (collectionJson->isArray() || collectionJson->isObject())
+    {
+        iterations = collectionJson->size();
+    }
+    auto start = sql.size();
+    if (iterations > 0)
+    {
+        TL_SQL_PROBE_OUTPUT(sql);
+        sql.reserve(start + iterations * iterationSize_.estimate());
+    }
+    if (loopIterations)
+    {
+        auto loop = find_if(loopIterations->begin(),
+                            loopIterations->end(),
+                            [this](const auto &item) {
+                                return item.first == this;
+                            });
+        if (loop == loopIterations->end())
+        {
+            loopIterations->emplace_back(this, iterations);
+        }
+        else
+        {
+            loop->second += iterations;
+        }
+    }
+    if (iterations == 0)
+    {
+        return;
+    }
+    // Profiled renders take the general path, which reports every frame,
+    // and so do statements, which print a placeholder per element, and rows,
+    // which print nothing
+    if (join_ && !batch && !RenderProfiler::active() && !placeholderSink)
+    {
+        TL_SQL_PROBE_NODE("ForLoopNode.join");
+        TL_SQL_PROBE_OUTPUT(sql);
+        if (auto fingerprint = fingerprintOf(sql))
+        {
+            // The same text as the general path prints
+            string element = joinPrefix_;
+            element += '\0';
+            element += joinSuffix_;
+            fingerprint->addText(element);
+            element.insert(0, separatorText_);
+            fingerprint->addRepeated(element, iterations - 1);
+        }
+        if (ints)
+        {
+            appendDecimals(ints->data(), iterations, joinFormat(), sql);
+        }
+        else if (int64s)
+        {
+            appendDecimals(int64s->data(), iterations, joinFormat(), sql);
+        }
+        else
+        {
+            appendJoined(*collectionJson, sql);
+        }
+        iterationSize_.observe((sql.size() - start) / iterations);
+        return;
+    }
+
+    // The loop variables are bound in a child frame and reassigned in place
+    ParamScope loopScope(&scope);
+    auto fingerprinted = fingerprintOf(sql) != nullptr;
+    for (const auto &[slot, node] : hoisted_)
+    {
+        // A statement prints the hoisted values in place
+        if (placeholderSink)
+        {
+            break;
+        }
+        auto &text = loopScope.bind(slot);
+        if (!holds_alternative<string>(text))
+        {
+            text.emplace<string>();
+        }
+        get<string>(text).clear();
+        if (!fingerprinted)
+        {
+            node->generateSql(scope, get<string>(text));
+            continue;
+        }
+        // Every print adds the fingerprint of the hoisted text
+        FingerprintSink hoisted(get<string>(text));
+        {
+            SinkScope install(fingerprintSink, hoisted);
+            node->generateSql(scope, get<string>(text));
+        }
+        loopScope.bind(HoistedValueNode::fingerprintSlot(slot)) =
+            static_cast<int64_t>(hoisted.fingerprint.digest());
+    }
+    loopScope.bind(valueName_);
+    auto index = indexName_.empty() ? nullptr : &loopScope.bind(indexName_);
+    auto &value = loopScope.bind(valueName_);
+    auto appendIteration = [this, &loopScope, iterations, &sql](size_t i) {
+        if (loopBody_)
+        {
+            loopBody_->generateSql(loopScope, sql);
+        }
+        if (i + 1 != iterations)
+        {
+            TL_SQL_PROBE_OUTPUT(sql);
+            if (auto fingerprint = fingerprintOf(sql))
+            {
+                fingerprint->addText(separatorText_);
+            }
+            sql += separatorText_;
+        }
+    };
+    if (ints || int64s || batch)
+    {
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            if (ints)
+            {
+                value = (*ints)[i];
+            }
+            else if (int64s)
+            {
+                value = (*int64s)[i];
+            }
+            else
+            {
+                // A view of the row, whose members are read from the columns
+                value = ColumnRow{batch, i};
+            }
+            if (index)
+            {
+                *index = static_cast<int32_t>(i);
+            }
+            appendIteration(i);
+        }
+        iterationSize_.observe((sql.size() - start) / iterations);
+        return;
+    }
+    auto isArray = collectionJson->isArray();
+    size_t i = 0;
+    // Iterators avoid a lookup of every array index
+    for (auto it = collectionJson->begin(); it != collectionJson->end();
+         ++it, ++i)
+    {
+        assignJson(value, *it);
+        if (index && isArray)
+        {
+            *index = static_cast<int32_t>(i);
+        }
+        else if (index)
+        {
+            const char *end;
+            auto begin = it.memberName(&end);
+            assignString(*index, begin, end);
+        }
+        appendIteration(i);
+    }
+    iterationSize_.observe((sql.size() - start) / iterations);
+}
+
+void ForLoopNode::hoistInvariants()
+{
+    vector<string> loopNames{valueName_};
+    if (!indexName_.empty())
+    {
+        loopNames.push_back(indexName_);
+    }
+    vector<ASTNodePtr> body;
+    for (auto node = loopBody_; node; node = node->takeNextSibling())
+    {
+        body.push_back(node);
+    }
+    for (auto &node : body)
+    {
+        // Text is constant anyway, and most statements report that they use
+        // any name, as they may bind names of their own
+        if (!dynamic_cast<const NormalTextNode *>(node.get()) &&
+            !node->usesNames(loopNames))
+        {
+            auto slot = "#" + std::to_string(hoisted_.size());
+            hoisted_.emplace_back(slot, node);
+            node = make_shared<HoistedValueNode>(slot, node);
+        }
+    }
+    for (size_t i = 1; i < body.size(); ++i)
+    {
+        body[i - 1]->setNextSibling(body[i]);
+    }
+    loopBody_ = body.empty() ? nullptr : body.front();
+}
+
+void ForLoopNode::detectJoin()
+{
+    const ASTNode *node = loopBody_.get();
+    auto text = dynamic_cast<const NormalTextNode *>(node);
+    if (text)
+    {
+        joinPrefix_ = text->text();
+        node = node->nextSibling();
+    }
+    auto variable = dynamic_cast<const VariableNode *>(node);
+    if (!variable || variable->name() != valueName_)
+    {
+        joinPrefix_.clear();
+        return;
+    }
+    node = node->nextSibling();
+    text = dynamic_cast<const NormalTextNode *>(node);
+    if (text)
+    {
+        joinSuffix_ = text->text();
+        node = node->nextSibling();
+    }
+    join_ = node == nullptr;
+    if (!join_)
+    {
+        joinPrefix_.clear();
+        joinSuffix_.clear();
+    }
+}
+
+void ForLoopNode::appendJoined(const Json::Value &collection,
+                               string &sql) const
+{
+    // Same conversions as printing ${value} in the loop body
+    constexpr size_t kBatchSize = 256;
+    int32_t batch[kBatchSize];
+    size_t batched = 0;
+    size_t printed = 0;  // Elements before the batch
+    auto flush = [this, &batch, &batched, &printed, &sql] {
+        if (batched == 0)
+        {
+            return;
+        }
+        if (printed > 0)
+        {
+            sql += separatorText_;
+        }
+        appendDecimals(batch, batched, joinFormat(), sql);
+        printed += batched;
+        batched = 0;
+    };
+    for (const auto &element : collection)
+    {
+        if (element.isInt())
+        {
+            batch[batched++] = element.asInt();
+            if (batched == kBatchSize)
+            {
+                flush();
+            }
+            continue;
+        }
+        flush();
+        if (printed > 0)
+        {
+            sql += separatorText_;
+        }
+        sql += joinPrefix_;
+        appendJson(element, sql);
+        sql += joinSuffix_;
+        ++printed;
+    }
+    flush();
+}
+
+void ForLoopNode::canonicalizeInner(WhitespaceState &state)
+{
+    auto entry = state.afterSpace;
+    // Every iteration but the first follows the separator, or the end of the
+    // previous iteration, which is only known after the body is done
+    state.afterSpace = entry && !separatorText_.empty() &&
+                       isWhitespace(separatorText_.back());
+    if (loopBody_)
+    {
+        loopBody_->canonicalizeWhitespace(state);
+    }
+    // There may be no iterations at all
+    state.afterSpace = entry && state.afterSpace;
+    // The text around the value has changed
+    join_ = false;
+    joinPrefix_.clear();
+    joinSuffix_.clear();
+    detectJoin();
+}
+
+void ForLoopNode::analyzeInner(AstStats &stats, size_t loopDepth) const
+{
+    ++stats.nodes;
+    // Hoisted values are rendered once per loop, not once per iteration
+    for (const auto &hoisted : hoisted_)
+    {
+        hoisted.second->analyze(stats, loopDepth);
+    }
+    stats.nodes += countNodes(collection_) + countNodes(separator_);
+    if (separator_)
+    {
+        auto separator = separator_->getValue();
+        auto bytes = separator ? get<string>(*separator).size() : 0;
+        stats.literalBytes += bytes;
+        stats.addBytes(bytes, loopDepth + 1);
+    }
+    stats.loopDepth = max(stats.loopDepth, loopDepth + 1);
+    if (loopBody_)
+    {
+        loopBody_->analyze(stats, loopDepth + 1);
+    }
+}
+
+void ASTNode::print(vector<int> &indentFlags, bool isFirstLevel) const
+{
+    if (isFirstLevel)
+    {
+        indentFlags.back() = !!nextSibling_;
+    }
+    printIndent(indentFlags);
+    printInner(indentFlags);
+    if (nextSibling_)
+    {
+        nextSibling_->print(indentFlags, true);
+    }
+}
+
+void ASTNode::printIndent(vector<int> &indentFlags) const
+{
+    for (int i = 0; i < indentFlags.size(); ++i)
+    {
+        const auto &flag = indentFlags[i];
+        if (flag == 0)
+        {
+            if (i + 1 == indentFlags.size())
+            {
+                cout << "└── ";
+            }
+            else
+            {
+                cout << "    ";
+            }
+        }
+        else if (flag == 1)
+        {
+            if (i + 1 == indentFlags.size())
+            {
+                cout << "├── ";
+            }
+            else
+            {
+                cout << "│   ";
+            }
+        }
+    }
+}
+
+void NormalTextNode::printInner(vector<int> indentFlags) const
+{
+    cout << "\033[38;5;46m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+            "(value: "
+            "\033[38;5;46m"
+            "\""
+         << text_
+         << "\""
+            "\033[0m"
+            ")"
+         << endl;
+}
+
+void NumberNode::printInner(vector<int> indentFlags) const
+{
+    cout << "\033[38;5;202m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+            "(value: "
+            "\033[38;5;202m"
+         << value_
+         << "\033[0m"
+            ")"
+         << endl;
+}
+
+void StringNode::printInner(vector<int> indentFlags) const
+{
+    cout << "\033[38;5;46m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+            "(value: "
+            "\033[38;5;46m"
+            "\""
+         << value_
+         << "\""
+            "\033[0m"
+            ")"
+         << endl;
+}
+
+void NullNode::printInner(vector<int> indentFlags) const
+{
+    cout << "\033[38;5;196m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+         << endl;
+}
+
+void VariableNode::printInner(vector<int> indentFlags) const
+{
+    cout << "\033[38;5;105m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+            "(name: "
+            "\033[38;5;105m"
+         << name_
+         << "\033[0m"
+            ")"
+         << endl;
+}
+
+void BinaryOpNode::printInner(vector<int> indentFlags) const
+{
+    cout << "\033[38;5;202m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+         << endl;
+
+    indentFlags.emplace_back(1);
+    left_->print(indentFlags);
+
+    indentFlags.back() = 0;
+    right_->print(indentFlags);
+}
+
+void SubSqlNode::printInner(vector<int> indentFlags) const
+{
+    cout << "\033[38;5;226m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+            "(name: "
+            "\033[38;5;226m"
+         << name_
+         << "\033[0m"
+            ")"
+         << endl;
+
+    if (params_.size() > 0)
+    {
+        indentFlags.emplace_back(0);
+        printIndent(indentFlags);
+        cout << "\033[38;5;208m"
+                "[Parameters]"
+                "\033[0m"
+             << endl;
+
+        indentFlags.emplace_back(1);  // 此值会被覆盖，随意设置
+        size_t i = 0;
+        for (const auto &pair : params_)
+        {
+            indentFlags.back() = i + 1 < params_.size();
+            printIndent(indentFlags);
+            cout << "\033[38;5;201m"
+                    "["
+                 << pair.first
+                 << "]"
+                    "\033[0m"
+                 << endl;
+
+            indentFlags.emplace_back(0);
+            pair.second->print(indentFlags);
+
+            ++i;
+            indentFlags.resize(indentFlags.size() - 1);
+        }
+    }
+}
+
+void EscapeNode::printInner(vector<int> indentFlags) const
+{
+    cout << "\033[38;5;202m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+            "(mode: "
+         << escapeModeName(mode_) << ")" << endl;
+    indentFlags.emplace_back(0);
+    value_->print(indentFlags);
+}
+
+void NotNode::printInner(vector<int> indentFlags) const
+{
+    cout << "\033[38;5;202m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+         << endl;
+    indentFlags.emplace_back(1);
+    left_->print(indentFlags);
+}
+
+void IfStmtNode::printInner(vector<int> indentFlags) const
+{
+    // [IfStatementNode]
+    cout << "\033[38;5;224m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+         << endl;
+
+    // [if_condition]
+    indentFlags.emplace_back(1);
+    printIndent(indentFlags);
+    cout << "\033[38;5;121m"
+            "[if_condition]"
+            "\033[0m"
+         << endl;
+    indentFlags.emplace_back(0);
+    condition_->print(indentFlags);
+
+    // [if_statement]
+    indentFlags.resize(indentFlags.size() - 1);
+    printIndent(indentFlags);
+    cout << "\033[38;5;203m"
+            "[if_statement]"
+            "\033[0m"
+         << endl;
+    indentFlags.emplace_back(0);
+    ifStmt_->print(indentFlags, true);
+
+    indentFlags.resize(indentFlags.size() - 1);
+    size_t i = 0;
+    for (const auto &pair : elIfStmts_)
+    {
+        // [else_if_condition]
+        printIndent(indentFlags);
+        cout << "\033[38;5;121m"
+                "[else_if_condition]"
+                "\033[0m"
+             << endl;
+        indentFlags.emplace_back(elseStmt_ && i + 1 < elIfStmts_.size());
+        pair.first->print(indentFlags);
+
+        // [else_if_statement]
+        indentFlags.resize(indentFlags.size() - 1);
+        printIndent(indentFlags);
+        cout << "\033[38;5;203m"
+                "[else_if_statement]"
+                "\033[0m"
+             << endl;
+        indentFlags.emplace_back(elseStmt_ && i + 1 < elIfStmts_.size());
+        pair.second->print(indentFlags, true);
+
+        ++i;
+        indentFlags.resize(indentFlags.size() - 1);
+    }
+    // [else_statement]
+    if (elseStmt_)
+    {
+        indentFlags.resize(indentFlags.size() - 1);
+        indentFlags.emplace_back(0);
+        printIndent(indentFlags);
+        cout << "\033[38;5;203m"
+                "[else_statement]"
+                "\033[0m"
+             << endl;
+        indentFlags.emplace_back(0);
+        elseStmt_->print(indentFlags, true);
+    }
+}
+
+void SwitchStmtNode::printInner(vector<int> indentFlags) const
+{
+    // [SwitchStatementNode]
+    cout << "\033[38;5;224m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+         << endl;
+
+    // [switch_subject]
+    indentFlags.emplace_back(!cases_.empty() || hasDefault_);
+    printIndent(indentFlags);
+    cout << "\033[38;5;121m"
+            "[switch_subject]"
+            "\033[0m"
+         << endl;
+    indentFlags.emplace_back(0);
+    subject_->print(indentFlags);
+    indentFlags.resize(indentFlags.size() - 1);
+
+    for (size_t i = 0; i < cases_.size(); ++i)
+    {
+        const auto &labels = cases_[i].first;
+        const auto &branch = cases_[i].second;
+        // [case_labels]
+        indentFlags.back() = 1;
+        printIndent(indentFlags);
+        cout << "\033[38;5;121m"
+                "[case_labels]"
+                "\033[0m"
+             << endl;
+        indentFlags.emplace_back(0);
+        for (size_t j = 0; j < labels.size(); ++j)
+        {
+            indentFlags.back() = j + 1 < labels.size();
+            labels[j]->print(indentFlags);
+        }
+        indentFlags.resize(indentFlags.size() - 1);
+
+        // [case_statement]
+        indentFlags.back() = i + 1 < cases_.size() || hasDefault_;
+        printIndent(indentFlags);
+        cout << "\033[38;5;203m"
+                "[case_statement]"
+                "\033[0m"
+             << endl;
+        if (branch)
+        {
+            indentFlags.emplace_back(0);
+            branch->print(indentFlags, true);
+            indentFlags.resize(indentFlags.size() - 1);
+        }
+    }
+
+    // [default_statement]
+    if (hasDefault_)
+    {
+        indentFlags.back() = 0;
+        printIndent(indentFlags);
+        cout << "\033[38;5;203m"
+                "[default_statement]"
+                "\033[0m"
+             << endl;
+        if (default_)
+        {
+            indentFlags.emplace_back(0);
+            default_->print(indentFlags, true);
+        }
+    }
+}
+
+void LetNode::printInner(vector<int> indentFlags) const
+{
+    // [LetNode]
+    cout << "\033[38;5;218m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+            "(name: "
+            "\033[38;5;155m"
+         << name_
+         << "\033[0m"
+            ")"
+         << endl;
+
+    // [value]
+    indentFlags.emplace_back(!!body_);
+    printIndent(indentFlags);
+    cout << "\033[38;5;121m"
+            "[value]"
+            "\033[0m"
+         << endl;
+    indentFlags.emplace_back(0);
+    value_->print(indentFlags);
+    indentFlags.resize(indentFlags.size() - 1);
+
+    // [let_body]
+    if (body_)
+    {
+        indentFlags.back() = 0;
+        printIndent(indentFlags);
+        cout << "\033[38;5;203m"
+                "[let_body]"
+                "\033[0m"
+             << endl;
+        indentFlags.emplace_back(0);
+        body_->print(indentFlags, true);
+    }
+}
+
+void TrimBlockNode::printInner(vector<int> indentFlags) const
+{
+    // [TrimBlockNode]
+    cout << "\033[38;5;224m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+            "(keyword: "
+            "\033[38;5;201m"
+         << (kind_ == Kind::Where ? "WHERE" : "SET")
+         << "\033[0m"
+            ")"
+         << endl;
+
+    if (body_)
+    {
+        indentFlags.emplace_back(0);
+        body_->print(indentFlags, true);
+    }
+}
+
+void HoistedValueNode::printInner(vector<int> indentFlags) const
+{
+    // [HoistedValueNode]
+    cout << "\033[38;5;218m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+            "(slot: "
+            "\033[38;5;155m"
+         << slot_
+         << "\033[0m"
+            ")"
+         << endl;
+
+    indentFlags.emplace_back(0);
+    original_->print(indentFlags);
+}
+
+void ForLoopNode::printInner(vector<int> indentFlags) const
+{
+    // [ForLoopNode]
+    cout << "\033[38;5;218m"
+            "["
+         << nodeName()
+         << "]"
+            "\033[0m"
+         << endl;
+
+    // [parameters]
+    indentFlags.emplace_back(1);
+    printIndent(indentFlags);
+    cout << "\033[38;5;123m"
+            "[parameters]"
+            "\033[0m"
+         << endl;
+
+    // [variable_declaration]
+    indentFlags.emplace_back(1);
+    printIndent(indentFlags);
+    cout << "\033[38;5;34m"
+            "[variable_declaration]"
+            "\033[0m"
+         << endl;
+
+    // [item]
+    indentFlags.emplace_back(indexName_.empty() ? 0 : 1);
+    printIndent(indentFlags);
+    cout << "\033[38;5;155m"
+            "[item]"
+            "\033[0m"
+            "(name: "
+            "\033[38;5;155m"
+         << valueName_
+         << "\033[0m"
+            ")"
+         << endl;
+
+    // [index]
+    if (!indexName_.empty())
+    {
+        indentFlags.back() = 0;
+        printIndent(indentFlags);
+        cout << "\033[38;5;155m"
+                "[index]"
+                "\033[0m"
+                "(name: "
+                "\033[38;5;155m"
+             << indexName_
+             << "\033[0m"
+                ")"
+             << endl;
+    }
+
+    // [collection]
+    indentFlags.resize(indentFlags.size() - 1);
+    indentFlags.back() = separator_ ? 1 : 0;
+    printIndent(indentFlags);
+    cout << "\033[38;5;34m"
+            "[collection]"
+            "\033[0m"
+         << endl;
+    indentFlags.emplace_back(0);
+    collection_->print(indentFlags);
+
+    // [separator]
+    if (separator_)
+    {
+        indentFlags.resize(indentFlags.size() - 1);
+        indentFlags.back() = 0;
+        printIndent(indentFlags);
+        cout << "\033[38;5;34m"
+                "[separator]"
+                "\033[0m"
+             << endl;
+
+        indentFlags.emplace_back(0);
+        separator_->print(indentFlags);
+    }
+
+    // [loop_body]
+    indentFlags.resize(indentFlags.size() - 2);
+    indentFlags.back() = 0;
+    printIndent(indentFlags);
+    cout << "\033[38;5;123m"
+            "[loop_body]"
+            "\033[0m"
          << endl;
 
-    // [parameters]
-    indentFlags.emplace_back(1);
-    printIndent(indentFlags);
-    cout << "\033[38;5;123m"
-            "[parameters]"
-            "\033[0m"
-         << endl;
+    indentFlags.emplace_back(0);
+    loopBody_->print(indentFlags, true);
+}
+
+void Parser::printTokens()
+{
+    reset();
+    size_t parenDepth = 0;
+    auto printToken = [&parenDepth](const Token &token) {
+        std::array<string, 40> colors{
+            "\033[38;5;46m",   // NormalText
+            "\033[38;5;208m",  // At
+            "\033[38;5;105m",  // Identifier
+            "\033[38;5;105m",  // LParen
+            "\033[38;5;226m",  // Assign
+            "\033[38;5;46m",   // String
+            "\033[38;5;202m",  // Integer
+            "\033[38;5;105m",  // Comma
+            "\033[38;5;105m",  // RParen
+            "\033[38;5;208m",  // Dollar
+            "\033[38;5;105m",  // LBrace
+            "\033[38;5;105m",  // RBrace
+            "\033[38;5;105m",  // Dot
+            "\033[38;5;105m",  // LBracket
+            "\033[38;5;105m",  // RBracket
+            "\033[38;5;201m",  // If
+            "\033[38;5;208m",  // And
+            "\033[38;5;196m",  // Or
+            "\033[38;5;196m",  // Not
+            "\033[38;5;226m",  // EQ
+            "\033[38;5;226m",  // NEQ
+            "\033[38;5;244m",  // Null
+            "\033[38;5;201m",  // Else
+            "\033[38;5;201m",  // ElIf
+            "\033[38;5;201m",  // EndIf
+            "\033[38;5;201m",  // For
+            "\033[38;5;201m",  // Separator
+            "\033[38;5;201m",  // In
+            "\033[38;5;201m",  // EndFor
+            "\033[38;5;201m",  // Switch
+            "\033[38;5;201m",  // Case
+            "\033[38;5;201m",  // Default
+            "\033[38;5;201m",  // EndSwitch
+            "\033[38;5;201m",  // Let
+            "\033[38;5;201m",  // Where
+            "\033[38;5;201m",  // EndWhere
+            "\033[38;5;201m",  // Set
+            "\033[38;5;201m",  // EndSet
+            "\033[38;5;255m",  // Done
+            "\033[38;5;196m",  // Unknown
+        };
+        std::array<string, 3> parenColors{
+            "\033[38;5;105m",
+            "\033[38;5;214m",
+            "\033[38;5;76m",
+        };
+        if (token.type() != Done)
+        {
+            parenDepth += (token.type() == LParen || token.type() == LBrace ||
+                           token.type() == LBracket);
+            auto color = colors[token.type()];
+            if (token.type() == LParen || token.type() == RParen ||
+                token.type() == LBrace || token.type() == RBrace ||
+                token.type() == LBracket || token.type() == RBracket ||
+                token.type() == Dot || token.type() == Comma)
+            {
+                color = parenColors[parenDepth % parenColors.size()];
+            }
+            cout << color << "[" << token.type() << "]"
+                 << "\033[0m";
+            if (token.value() != "")
+            {
+                cout << "<" << color << token.value()
+                     << "\033[0m"
+                        ">";
+            }
+            cout << endl;
+            parenDepth -= (token.type() == RParen || token.type() == RBrace ||
+                           token.type() == RBracket);
+        }
+    };
+    for (; !lexer_.done(); nextToken())
+    {
+        printToken(ahead_.front());
+    }
+    printToken(ahead_.front());
+    printToken(ahead_.back());
+}
+
+void Parser::printAST()
+{
+    compile();
+    cout << "\033[37m"
+         << "[root]"
+         << "\033[0m" << endl;
+    vector<int> indentFlags{1};
+    root_->print(indentFlags, true);
+}
+
+void Parser::compile()
+{
+    if (root_)
+    {
+        return;
+    }
+    auto start = chrono::steady_clock::now();
+    reset();
+    root_ = sql();
+    if (!lexer_.done())
+    {
+        root_.reset();
+        throw runtime_error("Invalid expression.");
+    }
+    // An empty SQL statement has no nodes at all
+    if (!root_)
+    {
+        root_ = makeNode<NormalTextNode>("");
+    }
+    if (canonicalWhitespace_)
+    {
+        WhitespaceState state;
+        state.afterSpace = trimWhitespace_;
+        root_->canonicalizeWhitespace(state);
+        auto last = root_.get();
+        while (last->nextSibling())
+        {
+            last = last->nextSibling();
+        }
+        auto text = dynamic_cast<NormalTextNode *>(last);
+        if (trimWhitespace_ && text && !state.quote)
+        {
+            text->trimEnd();
+        }
+    }
+    compileNanos_ = chrono::duration_cast<chrono::nanoseconds>(
+                        chrono::steady_clock::now() - start)
+                        .count();
+}
+
+string Parser::parse()
+{
+    compile();
+    return root_->generateSql(params_);
+}
+
+string Parser::generateSql(const ParamList &params) const
+{
+    string sql;
+    generateSql(ParamScope(params), sql);
+    return sql;
+}
+
+void Parser::generateSql(const ParamScope &scope, string &sql) const
+{
+    assert(root_);
+    auto start = sql.size();
+    if (start == 0)
+    {
+        sql.reserve(outputSize_.estimate());
+    }
+    root_->generateSql(scope, sql);
+    outputSize_.observe(sql.size() - start);
+}
+AstStats Parser::analyze() const
+{
+    assert(root_);
+    AstStats stats;
+    root_->analyze(stats);
+    return stats;
+}
+size_t Parser::tokenCount() const
+{
+    auto lexer = lexer_;
+    lexer.reset();
+    size_t count = 0;
+    while (lexer.next().type() != Done)
+    {
+        ++count;
+    }
+    return count;
+}
+
+template <typename F>
+auto Parser::withFoldScope(F &&f) const
+{
+    ParamScope params(boundParams_);
+    ParamScope locals(&params);
+    // Later bindings of a name replace the earlier ones
+    for (const auto &[name, value] : locals_)
+    {
+        if (value)
+        {
+            locals.bind(name) = *value;
+        }
+    }
+    return f(locals);
+}
+
+// sql ::= [NormalText] {(sub_sql|print_expr|if_stmt|for_loop) [NormalText]}
+ASTNodePtr Parser::sql()
+{
+    ASTNodePtr head;
+    ASTNode *tail = nullptr;
+    auto addNode = [&](const ASTNodePtr &node) {
+        appendNode(head, tail, node);
+    };
+    if (ahead_[0].type() == NormalText)
+    {
+        auto normalText = match(NormalText);
+        auto normalTextNode = makeNode<NormalTextNode>(normalText);
+        addNode(normalTextNode);
+    }
+    while (true)
+    {
+        if (ahead_[0].type() == At)
+        {
+            if (ahead_[1].type() == Identifier)
+            {
+                addNode(fold(subSql()));
+            }
+            else if (ahead_[1].type() == If)
+            {
+                addNode(ifStmt());
+            }
+            else if (ahead_[1].type() == Switch)
+            {
+                addNode(switchStmt());
+            }
+            else if (ahead_[1].type() == For)
+            {
+                addNode(forLoop());
+            }
+            else if (ahead_[1].type() == Where || ahead_[1].type() == Set)
+            {
+                addNode(trimBlock());
+            }
+            else if (ahead_[1].type() == Let)
+            {
+                // The rest of the block is the body of the binding
+                addNode(letStmt());
+                return head;
+            }
+            else
+            {
+                return head;
+            }
+        }
+        else if (ahead_[0].type() == Dollar)
+        {
+            addNode(printExpr());
+        }
+        else
+        {
+            return head;
+        }
+        if (ahead_[0].type() == NormalText)
+        {
+            auto normalText = match(NormalText);
+            auto normalTextNode = makeNode<NormalTextNode>(normalText);
+            addNode(normalTextNode);
+        }
+    }
+}
+
+// print_expr ::= "$" "{" expr "}"
+ASTNodePtr Parser::printExpr()
+{
+    match(Dollar);
+    match(LBrace);
+    auto result = expr();
+    auto mode = escapeMode_;
+    if (ahead_[0].type() == Comma)
+    {
+        match(Comma);
+        auto option = match(Identifier);
+        if (option != "escape")
+        {
+            throw runtime_error("Invalid expression. Unknown option: " +
+                                option);
+        }
+        match(Assign);
+        auto name = match(String);
+        auto parsed = parseEscapeMode(name);
+        if (!parsed)
+        {
+            throw runtime_error("Unknown escape mode: " + name);
+        }
+        mode = *parsed;
+    }
+    match(RBrace);
+    if (mode != EscapeMode::None)
+    {
+        result = makeNode<EscapeNode>(result, mode);
+    }
+    return fold(result);
+}
+
+// expr ::= 'null' | Integer | String | Identifier {param_suffix}
+ASTNodePtr Parser::expr()
+{
+    if (ahead_[0].type() == Null)
+    {
+        match(Null);
+        return makeNode<NullNode>();
+    }
+    else if (ahead_[0].type() == Integer)
+    {
+        auto integer = fromString<int32_t>(match(Integer));
+        return makeNode<NumberNode>(integer);
+    }
+    else if (ahead_[0].type() == String)
+    {
+        return makeNode<StringNode>(match(String));
+    }
+    else if (ahead_[0].type() == Identifier)
+    {
+        auto paramName = match(Identifier);
+        ASTNodePtr variableNode = makeNode<VariableNode>(paramName);
+        while (ahead_[0].type() == Dot || ahead_[0].type() == LBracket)
+        {
+            paramSuffix(variableNode);
+        }
+        return variableNode;
+    }
+    throw runtime_error("Invalid expression. Unexpected token: " +
+                        to_string(ahead_[0].type()));
+}
+
+// param_suffix ::= "[" expr "]" | "." Identifier
+void Parser::paramSuffix(ASTNodePtr &param)
+{
+    if (ahead_[0].type() == LBracket)
+    {
+        match(LBracket);
+        auto indexNode = expr();
+        match(RBracket);
+        param = makeNode<ArrayNode>(param, indexNode);
+    }
+    else if (ahead_[0].type() == Dot)
+    {
+        match(Dot);
+        auto memberName = match(Identifier);
+        param =
+            makeNode<MemberNode>(param, makeNode<StringNode>(memberName));
+    }
+}
+
+// sub_sql ::= "@" Identifier "(" [param_list] ")"
+ASTNodePtr Parser::subSql()
+{
+    match(At);
+    auto subSqlName = match(Identifier);
+    match(LParen);
+    unordered_map<string, ASTNodePtr> params = {};
+    if (ahead_[0].type() == Identifier)
+    {
+        params = paramList();
+    }
+    match(RParen);
+    return makeNode<SubSqlNode>(subSqlName,
+                                   subSqlGetter_,
+                                   params,
+                                   subSqlRenderer_);
+}
+
+// param_list ::= param_item { "," param_item }
+unordered_map<string, ASTNodePtr> Parser::paramList()
+{
+    unordered_map<string, ASTNodePtr> result;
+    result.emplace(paramItem());
+    while (true)
+    {
+        if (ahead_[0].type() == Comma)
+        {
+            match(Comma);
+            result.emplace(paramItem());
+        }
+        else
+        {
+            return result;
+        }
+    }
+}
+
+// param_item ::= Identifier ["=" param_value]
+pair<string, ASTNodePtr> Parser::paramItem()
+{
+    auto paramName = match(Identifier);
+    ASTNodePtr param;
+    if (ahead_[0].type() == Assign)
+    {
+        match(Assign);
+        param = paramValue();
+    }
+    else
+    {
+        param = makeNode<VariableNode>(paramName);
+    }
+    return {paramName, param};
+}
+
+// param_value ::= expr | sub_sql
+ASTNodePtr Parser::paramValue()
+{
+    if (ahead_[0].type() == At)
+    {
+        return subSql();
+    }
+    else
+    {
+        return expr();
+    }
+}
+
+// if_stmt ::= "@" "if" "(" bool_expr ")" sql
+//            {"@" "elif" "(" bool_expr ")" sql}
+//            ["@" "else" sql]
+//             "@" "endif"
+ASTNodePtr Parser::ifStmt()
+{
+    match(At);
+    match(If);
+    match(LParen);
+    auto condition = boolExpr();
+    match(RParen);
+    auto ifStmt = sql();
+    vector<pair<ASTNodePtr, ASTNodePtr>> elIfStmts;
+    while (ahead_[0].type() == At && ahead_[1].type() == ElIf)
+    {
+        match(At);
+        match(ElIf);
+        match(LParen);
+        auto elIfCondition = boolExpr();
+        match(RParen);
+        auto elIfStmt = sql();
+        elIfStmts.emplace_back(elIfCondition, elIfStmt);
+    }
+    ASTNodePtr elseStmt;
+    if (ahead_[0].type() == At && ahead_[1].type() == Else)
+    {
+        match(At);
+        match(Else);
+        elseStmt = sql();
+    }
+    match(At);
+    match(EndIf);
+    if (specializing_)
+    {
+        // A false bound condition drops its branch, a true one ends the
+        // statement as its else branch
+        elIfStmts.emplace(elIfStmts.begin(), condition, ifStmt);
+        vector<pair<ASTNodePtr, ASTNodePtr>> branches;
+        for (auto &branch : elIfStmts)
+        {
+            if (!isConstant(branch.first))
+            {
+                branches.push_back(std::move(branch));
+                continue;
+            }
+            auto taken = withFoldScope([&branch](const ParamScope &scope) {
+                return toBool(branch.first->getValue(scope));
+            });
+            if (taken)
+            {
+                elseStmt = branch.second;
+                break;
+            }
+        }
+        if (branches.empty())
+        {
+            return elseStmt;
+        }
+        condition = branches.front().first;
+        ifStmt = branches.front().second;
+        elIfStmts.assign(branches.begin() + 1, branches.end());
+    }
+    auto ifNode = makeNode<IfStmtNode>(condition, ifStmt, elseStmt);
+    for (const auto &elIfStmt : elIfStmts)
+    {
+        ifNode->addElIfStmt(elIfStmt.first, elIfStmt.second);
+    }
+    return ifNode;
+}
+
+// switch_stmt ::= "@" "switch" "(" expr ")" [Whitespace]
+//                {"@" "case" "(" case_label {"," case_label} ")" sql}
+//                ["@" "default" sql]
+//                 "@" "endswitch"
+ASTNodePtr Parser::switchStmt()
+{
+    match(At);
+    match(Switch);
+    match(LParen);
+    auto switchNode = makeNode<SwitchStmtNode>(expr());
+    match(RParen);
+    // The text before the first @case would belong to no branch
+    if (ahead_[0].type() == NormalText)
+    {
+        auto text = match(NormalText);
+        if (text.find_first_not_of(" \t\r\n") != string::npos)
+        {
+            throw runtime_error(
+                "Invalid expression. Text before the first @case: " + text);
+        }
+    }
+    while (ahead_[0].type() == At && ahead_[1].type() == Case)
+    {
+        match(At);
+        match(Case);
+        match(LParen);
+        vector<ASTNodePtr> labels{expr()};
+        while (ahead_[0].type() == Comma)
+        {
+            match(Comma);
+            labels.push_back(expr());
+        }
+        match(RParen);
+        switchNode->addCase(labels, sql());
+    }
+    if (ahead_[0].type() == At && ahead_[1].type() == Default)
+    {
+        match(At);
+        match(Default);
+        switchNode->setDefault(sql());
+    }
+    match(At);
+    match(EndSwitch);
+    if (isConstant(switchNode->subject()))
+    {
+        auto branch = withFoldScope([&switchNode](const ParamScope &scope) {
+            return switchNode->selectBranch(scope);
+        });
+        return branch ? *branch : nullptr;
+    }
+    return switchNode;
+}
+
+// let_stmt ::= "@" "let" "(" Identifier "=" param_value ")" sql
+ASTNodePtr Parser::letStmt()
+{
+    match(At);
+    match(Let);
+    match(LParen);
+    auto name = match(Identifier);
+    match(Assign);
+    auto value = paramValue();
+    match(RParen);
+    if (isConstant(value))
+    {
+        auto constant = withFoldScope([&value](const ParamScope &scope) {
+            return value->getValue(scope);
+        });
+        // Without a value the name keeps its outer meaning
+        if (!constant)
+        {
+            return sql();
+        }
+        locals_.emplace_back(name, std::move(constant));
+        auto body = sql();
+        locals_.pop_back();
+        return body;
+    }
+    locals_.emplace_back(name, nullopt);
+    auto body = sql();
+    locals_.pop_back();
+    return makeNode<LetNode>(name, value, body);
+}
+
+// trim_block ::= "@" "where" sql "@" "endwhere"
+//              | "@" "set" sql "@" "endset"
+ASTNodePtr Parser::trimBlock()
+{
+    match(At);
+    if (ahead_[0].type() == Where)
+    {
+        match(Where);
+        auto body = sql();
+        match(At);
+        match(EndWhere);
+        return fold(makeNode<TrimBlockNode>(TrimBlockNode::Kind::Where, body));
+    }
+    match(Set);
+    auto body = sql();
+    match(At);
+    match(EndSet);
+    return fold(makeNode<TrimBlockNode>(TrimBlockNode::Kind::Set, body));
+}
+
+// bool_expr ::= term {("or"|"||") term}
+ASTNodePtr Parser::boolExpr()
+{
+    auto root = term();
+    while (true)
+    {
+        if (ahead_[0].type() == Or)
+        {
+            match(Or);
+            root = makeNode<OrNode>(root, term());
+        }
+        else
+        {
+            return root;
+        }
+    }
+}
+
+// term ::= factor {("and"|"&&") factor}
+ASTNodePtr Parser::term()
+{
+    auto root = factor();
+    while (true)
+    {
+        if (ahead_[0].type() == And)
+        {
+            match(And);
+            root = makeNode<AndNode>(root, factor());
+        }
+        else
+        {
+            return root;
+        }
+    }
+}
+
+// factor ::= ["!"|"not"] ("(" bool_expr ")" | comp_expr)
+ASTNodePtr Parser::factor()
+{
+    auto isNegated = false;
+    if (ahead_[0].type() == Not)
+    {
+        match(Not);
+        isNegated = true;
+    }
+    if (ahead_[0].type() == LParen)
+    {
+        match(LParen);
+        auto boolNode = boolExpr();
+        match(RParen);
+        if (isNegated)
+        {
+            return makeNode<NotNode>(boolNode);
+        }
+        return boolNode;
+    }
+    auto compNode = compExpr();
+    if (isNegated)
+    {
+        return makeNode<NotNode>(compNode);
+    }
+    return compNode;
+}
+
+// comp_expr ::= expr [("=="|"!=") expr]
+ASTNodePtr Parser::compExpr()
+{
+    auto result1 = expr();
+    ASTNodePtr result2;
+    if (ahead_[0].type() == EQ)
+    {
+        match(EQ);
+        result2 = expr();
+        return makeNode<EQNode>(result1, result2);
+    }
+    else if (ahead_[0].type() == NEQ)
+    {
+        match(NEQ);
+        result2 = expr();
+        return makeNode<NEQNode>(result1, result2);
+    }
+    // `param` means `param != null`
+    return result1;
+}
+
+// for_loop ::= "@" "for" "("
+//              (Identifier|"(" Identifier "," Identifier ")") "in" expr
+//              ["," "separator" "=" String]
+//              ")" sql "@" "endif"
+ASTNodePtr Parser::forLoop()
+{
+    match(At);
+    match(For);
+    match(LParen);
+    string varName;
+    string indexName;
+    if (ahead_[0].type() == LParen)
+    {
+        match(LParen);
+        varName = match(Identifier);
+        match(Comma);
+        indexName = match(Identifier);
+        match(RParen);
+    }
+    else if (ahead_[0].type() == Identifier)
+    {
+        varName = match(Identifier);
+    }
+    match(In);
+    auto collection = this->expr();
+    ASTNodePtr separator{nullptr};
+    string separatorText;
+    if (ahead_[0].type() == Comma)
+    {
+        match(Comma);
+        match(Separator);
+        match(Assign);
+        separatorText = match(String);
+        separator = makeNode<StringNode>(separatorText);
+    }
+    match(RParen);
+    if (isConstant(collection))
+    {
+        auto unrolled =
+            unrollLoop(varName, indexName, collection, separatorText);
+        if (unrolled)
+        {
+            match(At);
+            match(EndFor);
+            return *unrolled;
+        }
+    }
+    locals_.emplace_back(varName, nullopt);
+    if (!indexName.empty())
+    {
+        locals_.emplace_back(indexName, nullopt);
+    }
+    auto loopBody = sql();
+    locals_.resize(locals_.size() - (indexName.empty() ? 1 : 2));
+    match(At);
+    match(EndFor);
+    return makeNode<ForLoopNode>(
+        varName, indexName, collection, separator, loopBody);
+}
+
+optional<ASTNodePtr> Parser::unrollLoop(const string &valueName,
+                                        const string &indexName,
+                                        const ASTNodePtr &collection,
+                                        const string &separator)
+{
+    auto value = withFoldScope([&collection](const ParamScope &scope) {
+        return collection->getValue(scope);
+    });
+    // The value and the index of every element, as a render binds them
+    vector<pair<ParamValue, ParamValue>> elements;
+    if (!value)
+    {
+        // Iterated as a null JSON value, without any element
+    }
+    else if (auto ints = get_if<IntArray>(&*value))
+    {
+        for (size_t i = 0; i < ints->size(); ++i)
+        {
+            elements.emplace_back((*ints)[i], static_cast<int32_t>(i));
+        }
+    }
+    else if (auto int64s = get_if<Int64Array>(&*value))
+    {
+        for (size_t i = 0; i < int64s->size(); ++i)
+        {
+            elements.emplace_back((*int64s)[i], static_cast<int32_t>(i));
+        }
+    }
+    else if (auto json = get_if<Json::Value>(&*value))
+    {
+        size_t i = 0;
+        for (auto it = json->begin(); it != json->end(); ++it, ++i)
+        {
+            elements.emplace_back(0, static_cast<int32_t>(i));
+            assignJson(elements.back().first, *it);
+            if (json->isObject())
+            {
+                const char *end;
+                auto begin = it.memberName(&end);
+                assignString(elements.back().second, begin, end);
+            }
+        }
+    }
+    else
+    {
+        return nullopt;
+    }
 
-    // [variable_declaration]
-    indentFlags.emplace_back(1);
-    printIndent(indentFlags);
-    cout << "\033[38;5;34m"
-            "[variable_declaration]"
-            "\033[0m"
-         << endl;
+    // Every copy of the body is parsed from the same tokens
+    auto lexer = lexer_;
+    auto ahead = ahead_;
+    ASTNodePtr head;
+    ASTNode *tail = nullptr;
+    for (size_t i = 0; i < elements.size(); ++i)
+    {
+        lexer_ = lexer;
+        ahead_ = ahead;
+        // The separator is text of the template, unlike a printed value
+        if (i > 0 && !separator.empty())
+        {
+            appendNode(head, tail, makeNode<NormalTextNode>(separator));
+        }
+        locals_.emplace_back(valueName, std::move(elements[i].first));
+        if (!indexName.empty())
+        {
+            locals_.emplace_back(indexName, std::move(elements[i].second));
+        }
+        appendNode(head, tail, sql());
+        locals_.resize(locals_.size() - (indexName.empty() ? 1 : 2));
+    }
+    if (elements.empty())
+    {
+        // The body is still skipped, with the loop variables unknown
+        locals_.emplace_back(valueName, nullopt);
+        if (!indexName.empty())
+        {
+            locals_.emplace_back(indexName, nullopt);
+        }
+        sql();
+        locals_.resize(locals_.size() - (indexName.empty() ? 1 : 2));
+    }
+    return head;
+}
 
-    // [item]
-    indentFlags.emplace_back(indexName_.empty() ? 0 : 1);
-    printIndent(indentFlags);
-    cout << "\033[38;5;155m"
-            "[item]"
-            "\033[0m"
-            "(name: "
-            "\033[38;5;155m"
-         << valueName_
-         << "\033[0m"
-            ")"
-         << endl;
+void Parser::appendNode(ASTNodePtr &head, ASTNode *&tail, ASTNodePtr node) const
+{
+    // A folded statement may print nothing at all
+    if (!node)
+    {
+        return;
+    }
+    if (tail)
+    {
+        auto tailText = dynamic_cast<NormalTextNode *>(tail);
+        auto text = dynamic_cast<const NormalTextNode *>(node.get());
+        if (tailText && text)
+        {
+            tailText->appendText(text->text());
+            node = node->takeNextSibling();
+            if (!node)
+            {
+                return;
+            }
+        }
+        tail->setNextSibling(node);
+    }
+    else
+    {
+        head = node;
+    }
+    tail = node.get();
+    while (tail->nextSibling())
+    {
+        tail = tail->nextSibling();
+    }
+}
 
-    // [index]
-    if (!indexName_.empty())
+bool Parser::isKnown(const string &name) const
+{
+    for (auto local = locals_.rbegin(); local != locals_.rend(); ++local)
     {
-        indentFlags.back() = 0;
-        printIndent(indentFlags);
-        cout << "\033[38;5;155m"
-                "[index]"
-                "\033[0m"
-                "(name: "
-                "\033[38;5;155m"
-             << indexName_
-             << "\033[0m"
-                ")"
-             << endl;
+        if (local->first == name)
+        {
+            return local->second.has_value();
+        }
     }
+    return boundParams_.find(name) != boundParams_.end();
+}
 
-    // [collection]
-    indentFlags.resize(indentFlags.size() - 1);
-    indentFlags.back() = separator_ ? 1 : 0;
-    printIndent(indentFlags);
-    cout << "\033[38;5;34m"
-            "[collection]"
-            "\033[0m"
-         << endl;
-    indentFlags.emplace_back(0);
-    collection_->print(indentFlags);
+bool Parser::isConstant(const ASTNodePtr &node) const
+{
+    return specializing_ && !node->usesName([this](const string &name) {
+        return !isKnown(name);
+    });
+}
 
-    // [separator]
-    if (separator_)
+ASTNodePtr Parser::fold(const ASTNodePtr &node) const
+{
+    // The body of a trimmed block is canonicalized after parsing
+    if (!isConstant(node) ||
+        (canonicalWhitespace_ &&
+         dynamic_cast<const TrimBlockNode *>(node.get())))
     {
-        indentFlags.resize(indentFlags.size() - 1);
-        indentFlags.back() = 0;
-        printIndent(indentFlags);
-        cout << "\033[38;5;34m"
-                "[separator]"
-                "\033[0m"
-             << endl;
+        return node;
+    }
+    string text;
+    withFoldScope([&node, &text](const ParamScope &scope) {
+        node->generateSql(scope, text);
+    });
+    return constantText(text);
+}
 
-        indentFlags.emplace_back(0);
-        separator_->print(indentFlags);
+ASTNodePtr Parser::constantText(const string &text) const
+{
+    if (canonicalWhitespace_)
+    {
+        return makeNode<StringNode>(text);
     }
+    return makeNode<NormalTextNode>(text);
+}
 
-    // [loop_body]
-    indentFlags.resize(indentFlags.size() - 2);
-    indentFlags.back() = 0;
-    printIndent(indentFlags);
-    cout << "\033[38;5;123m"
-            "[loop_body]"
-            "\033[0m"
-         << endl;
+Parser Parser::specialize(const ParamList &bound) const
+{
+    auto parser = *this;
+    parser.root_.reset();
+    // The copy may outlive the arena of the original
+    parser.memoryResource_ = nullptr;
+    parser.specializing_ = true;
+    parser.boundParams_ = bound;
+    parser.compile();
+    parser.specializing_ = false;
+    parser.locals_.clear();
+    return parser;
+}
 
-    indentFlags.emplace_back(0);
-    loopBody_->print(indentFlags, true);
+Parser Parser::withSource(const string &sql) const
+{
+    auto parser = *this;
+    parser.lexer_ = Lexer(sql);
+    parser.root_.reset();
+    parser.reset();
+    return parser;
 }
 
-void Parser::printTokens()
+string Parser::match(TokenType type)
 {
-    reset();
-    size_t parenDepth = 0;
-    auto printToken = [&parenDepth](const Token &token) {
-        std::array<string, 31> colors{
-            "\033[38;5;46m",   // NormalText
-            "\033[38;5;208m",  // At
-            "\033[38;5;105m",  // Identifier
-            "\033[38;5;105m",  // LParen
-            "\033[38;5;226m",  // Assign
-            "\033[38;5;46m",   // String
-            "\033[38;5;202m",  // Integer
-            "\033[38;5;105m",  // Comma
-            "\033[38;5;105m",  // RParen
-            "\033[38;5;208m",  // Dollar
-            "\033[38;5;105m",  // LBrace
-            "\033[38;5;105m",  // RBrace
-            "\033[38;5;105m",  // Dot
-            "\033[38;5;105m",  // LBracket
-            "\033[38;5;105m",  // RBracket
-            "\033[38;5;201m",  // If
-            "\033[38;5;208m",  // And
-            "\033[38;5;196m",  // Or
-            "\033[38;5;196m",  // Not
-            "\033[38;5;226m",  // EQ
-            "\033[38;5;226m",  // NEQ
-            "\033[38;5;244m",  // Null
-            "\033[38;5;201m",  // Else
-            "\033[38;5;201m",  // ElIf
-            "\033[38;5;201m",  // EndIf
-            "\033[38;5;201m",  // For
-            "\033[38;5;201m",  // Separator
-            "\033[38;5;201m",  // In
-            "\033[38;5;201m",  // EndFor
-            "\033[38;5;255m",  // Done
-            "\033[38;5;196m",  // Unknown
-        };
-        std::array<string, 3> parenColors{
-            "\033[38;5;105m",
-            "\033[38;5;214m",
-            "\033[38;5;76m",
-        };
-        if (token.type() != Done)
+    assert(ahead_[0].type() == type);
+    auto value = ahead_[0].value();
+    nextToken();
+    return value;
+}
+
+void Parser::nextToken()
+{
+    ahead_.pop_front();
+    ahead_.emplace_back(lexer_.next());
+}
+
+ParamItem Parser::getParamByName(const string &paramName) const
+{
+    auto it = params_.find(paramName);
+    if (it == params_.end())
+    {
+        LOG_ERROR << "parameter \"" << paramName << "\" not found";
+        return nullopt;
+    }
+    return it->second;
+}
+
+void SqlGenerator::initAndStart(const Json::Value &config)
+{
+    assert(config.isObject());
+    assert(config.isMember("sqls"));
+    sqls_ = config["sqls"];
+    const auto &arenaConfig = config["ast_arena"];
+    if (arenaConfig.isObject() && arenaConfig.get("enabled", true).asBool())
+    {
+        astArena_ = make_unique<std::pmr::monotonic_buffer_resource>(
+            arenaConfig.get("initial_bytes", 65536).asUInt64());
+    }
+    if (config.isMember("escape"))
+    {
+        escapeMode_ = parseEscape(config["escape"]);
+    }
+    const auto &whitespaceConfig = config["canonical_whitespace"];
+    if (whitespaceConfig.isObject())
+    {
+        canonicalWhitespace_ = whitespaceConfig.get("enabled", true).asBool();
+    }
+    // Compile everything up front, so that getSql never modifies parsers_
+    for (const auto &name : sqls_.getMemberNames())
+    {
+        if (sqls_[name].isString())
         {
-            parenDepth += (token.type() == LParen || token.type() == LBrace ||
-                           token.type() == LBracket);
-            auto color = colors[token.type()];
-            if (token.type() == LParen || token.type() == RParen ||
-                token.type() == LBrace || token.type() == RBrace ||
-                token.type() == LBracket || token.type() == RBracket ||
-                token.type() == Dot || token.type() == Comma)
-            {
-                color = parenColors[parenDepth % parenColors.size()];
-            }
-            cout << color << "[" << token.type() << "]"
-                 << "\033[0m";
-            if (token.value() != "")
-            {
-                cout << "<" << color << token.value()
-                     << "\033[0m"
-                        ">";
-            }
-            cout << endl;
-            parenDepth -= (token.type() == RParen || token.type() == RBrace ||
-                           token.type() == RBracket);
+            prepareParser(name, "main");
+            continue;
         }
-    };
-    for (; !lexer_.done(); nextToken())
+        for (const auto &subSqlName : sqls_[name].getMemberNames())
+        {
+            prepareParser(name, subSqlName);
+        }
+    }
+    for (const auto &name : sqls_.getMemberNames())
     {
-        printToken(ahead_.front());
+        prepareValuesRow(name);
     }
-    printToken(ahead_.front());
-    printToken(ahead_.back());
-}
+    auto names = sqls_.getMemberNames();
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        templateIndex_.emplace(names[i], i);
+    }
+    profiled_ = make_unique<atomic<bool>[]>(names.size());
+    buildCompileStats();
 
-void Parser::printAST()
-{
-    reset();
-    if (!root_)
+    const auto &asyncConfig = config["async_render"];
+    if (asyncConfig.isObject())
+    {
+        asyncMinBytes_ = asyncConfig.get("min_bytes", 65536).asUInt64();
+        renderQueue_ = make_unique<trantor::ConcurrentTaskQueue>(
+            asyncConfig.get("threads", 1).asUInt(), "SqlRenderQueue");
+    }
+
+    const auto &profilerConfig = config["profiler"];
+    if (profilerConfig.isObject())
     {
-        root_ = sql();
-        if (!lexer_.done())
+        profiler_ = make_unique<RenderProfiler>(
+            profilerConfig.get("max_trace_events", 100000).asUInt64());
+        for (const auto &name : profilerConfig["templates"])
         {
-            throw runtime_error("Invalid expression.");
+            setProfiling(name.asString());
         }
     }
-    cout << "\033[37m"
-         << "[root]"
-         << "\033[0m" << endl;
-    vector<int> indentFlags{1};
-    root_->print(indentFlags, true);
-}
 
-string Parser::parse()
-{
-    reset();
-    if (!root_)
+    const auto &slowLogConfig = config["slow_render_log"];
+    if (slowLogConfig.isObject())
     {
-        root_ = sql();
-        if (!lexer_.done())
+        enableSlowRenderLog(
+            chrono::microseconds(
+                slowLogConfig.get("threshold_us", 1000).asUInt64()),
+            slowLogConfig.get("capacity", 128).asUInt64());
+    }
+
+    const auto &metricsConfig = config["metrics"];
+    if (metricsConfig.isObject() && metricsConfig.get("enabled", true).asBool())
+    {
+        enableMetrics(metricsConfig.get("fingerprints", false).asBool());
+        auto path = metricsConfig.get("path", "").asString();
+        if (!path.empty())
         {
-            throw runtime_error("Invalid expression.");
+            app().registerHandler(
+                path,
+                [this](const HttpRequestPtr &,
+                       function<void(const HttpResponsePtr &)> &&callback) {
+                    auto resp = HttpResponse::newHttpResponse();
+                    resp->setContentTypeString("text/plain; version=0.0.4");
+                    resp->setBody(metrics_->toPrometheus());
+                    callback(resp);
+                },
+                {Get});
         }
     }
-    return root_->generateSql(params_);
 }
 
-// sql ::= [NormalText] {(sub_sql|print_expr|if_stmt|for_loop) [NormalText]}
-ASTNodePtr Parser::sql()
+void SqlGenerator::enableMetrics(bool fingerprints)
 {
-    ASTNodePtr head;
-    ASTNodePtr tail;
-    auto addNode = [&](const ASTNodePtr &node) {
-        if (head)
-        {
-            tail->setNextSibling(node);
-            tail = node;
-        }
-        else
-        {
-            head = tail = node;
-        }
-    };
-    if (ahead_[0].type() == NormalText)
+    fingerprintMetrics_ = fingerprintMetrics_ || fingerprints;
+    if (metrics_)
     {
-        auto normalText = match(NormalText);
-        auto normalTextNode = make_shared<NormalTextNode>(normalText);
-        addNode(normalTextNode);
+        return;
     }
-    while (true)
+    // Same order as templateIndex_
+    metrics_ = make_unique<RenderMetrics>(sqls_.getMemberNames());
+}
+void SqlGenerator::buildCompileStats()
+{
+    struct Cost
     {
-        if (ahead_[0].type() == At)
+        size_t baseBytes{0};
+        size_t perIterationBytes{0};
+        size_t loopDepth{0};
+        size_t callDepth{0};
+    };
+    for (const auto &name : sqls_.getMemberNames())
+    {
+        CompileStats stats;
+        stats.name = name;
+        auto &parsers = parsers_[name];
+        unordered_map<string, AstStats> asts;
+        for (const auto &[subSqlName, parser] : parsers)
         {
-            if (ahead_[1].type() == Identifier)
-            {
-                addNode(subSql());
-            }
-            else if (ahead_[1].type() == If)
+            auto ast = parser.analyze();
+            stats.tokens += parser.tokenCount();
+            stats.astNodes += ast.nodes;
+            stats.literalBytes += ast.literalBytes;
+            stats.compileNanos += parser.compileNanos();
+            asts.emplace(subSqlName, std::move(ast));
+        }
+
+        // Follow the sub-SQL calls, a recursive call ends the chain
+        unordered_map<string, Cost> costs;
+        unordered_map<string, bool> visiting;
+        function<Cost(const string &)> visit =
+            [&](const string &subSqlName) -> Cost {
+            auto cached = costs.find(subSqlName);
+            if (cached != costs.end())
             {
-                addNode(ifStmt());
+                return cached->second;
             }
-            else if (ahead_[1].type() == For)
+            auto ast = asts.find(subSqlName);
+            if (ast == asts.end() || visiting[subSqlName])
             {
-                addNode(forLoop());
+                return {};
             }
-            else
+            visiting[subSqlName] = true;
+            Cost cost;
+            cost.baseBytes = ast->second.baseBytes;
+            cost.perIterationBytes = ast->second.perIterationBytes;
+            cost.loopDepth = ast->second.loopDepth;
+            for (const auto &[callee, loopDepth] : ast->second.subSqlCalls)
             {
-                return head;
+                auto calleeCost = visit(callee);
+                if (loopDepth == 0)
+                {
+                    cost.baseBytes += calleeCost.baseBytes;
+                    cost.perIterationBytes += calleeCost.perIterationBytes;
+                }
+                else
+                {
+                    cost.perIterationBytes +=
+                        calleeCost.baseBytes + calleeCost.perIterationBytes;
+                }
+                cost.loopDepth =
+                    max(cost.loopDepth, loopDepth + calleeCost.loopDepth);
+                cost.callDepth = max(cost.callDepth, calleeCost.callDepth + 1);
             }
-        }
-        else if (ahead_[0].type() == Dollar)
-        {
-            addNode(printExpr());
-        }
-        else
-        {
-            return head;
-        }
-        if (ahead_[0].type() == NormalText)
+            visiting[subSqlName] = false;
+            costs.emplace(subSqlName, cost);
+            return cost;
+        };
+        auto cost = visit("main");
+        stats.subSqlDepth = cost.callDepth;
+        stats.loopDepth = cost.loopDepth;
+        stats.baseBytes = cost.baseBytes;
+        stats.perIterationBytes = cost.perIterationBytes;
+        for (auto &[subSqlName, parser] : parsers)
         {
-            auto normalText = match(NormalText);
-            auto normalTextNode = make_shared<NormalTextNode>(normalText);
-            addNode(normalTextNode);
+            parser.setReserveBytes(visit(subSqlName).baseBytes);
         }
+        LOG_DEBUG << "Compiled " << name << ": " << stats.tokens << " tokens, "
+                  << stats.astNodes << " nodes, " << stats.compileNanos
+                  << " ns, estimated " << stats.baseBytes << " + "
+                  << stats.perIterationBytes << " bytes per iteration";
+        compileStats_.emplace_back(std::move(stats));
     }
 }
-
-// print_expr ::= "$" "{" expr "}"
-ASTNodePtr Parser::printExpr()
+vector<CompileStats> SqlGenerator::compileStats() const
 {
-    match(Dollar);
-    match(LBrace);
-    auto result = expr();
-    match(RBrace);
+    auto result = compileStats_;
+    stable_sort(result.begin(),
+                result.end(),
+                [](const CompileStats &a, const CompileStats &b) {
+                    return a.estimateBytes(CompileStats::kReferenceIterations) >
+                           b.estimateBytes(CompileStats::kReferenceIterations);
+                });
     return result;
 }
-
-// expr ::= 'null' | Integer | String | Identifier {param_suffix}
-ASTNodePtr Parser::expr()
+size_t SqlGenerator::estimateBytes(const string &name,
+                                   const ParamList &params) const
 {
-    if (ahead_[0].type() == Null)
-    {
-        match(Null);
-        return make_shared<NullNode>();
-    }
-    else if (ahead_[0].type() == Integer)
-    {
-        auto integer = fromString<int32_t>(match(Integer));
-        return make_shared<NumberNode>(integer);
-    }
-    else if (ahead_[0].type() == String)
+    auto index = templateIndex_.find(name);
+    if (index == templateIndex_.end())
     {
-        return make_shared<StringNode>(match(String));
+        return 0;
     }
-    else if (ahead_[0].type() == Identifier)
+    // Every element of a collection parameter may be one loop iteration
+    size_t iterations = 0;
+    auto countIterations = [&iterations](const ParamList &params) {
+        for (const auto &param : params)
+        {
+            if (holds_alternative<Json::Value>(param.second))
+            {
+                const auto &json = get<Json::Value>(param.second);
+                if (json.isArray() || json.isObject())
+                {
+                    iterations += json.size();
+                }
+            }
+            else if (holds_alternative<IntArray>(param.second))
+            {
+                iterations += get<IntArray>(param.second).size();
+            }
+            else if (holds_alternative<Int64Array>(param.second))
+            {
+                iterations += get<Int64Array>(param.second).size();
+            }
+            else if (holds_alternative<ColumnBatch>(param.second))
+            {
+                iterations += get<ColumnBatch>(param.second).rows();
+            }
+        }
+    };
+    countIterations(params);
+    auto defaults = defaultParams_.find(name);
+    if (defaults != defaultParams_.end())
     {
-        auto paramName = match(Identifier);
-        ASTNodePtr variableNode = make_shared<VariableNode>(paramName);
-        while (ahead_[0].type() == Dot || ahead_[0].type() == LBracket)
+        auto mainDefaults = defaults->second.find("main");
+        if (mainDefaults != defaults->second.end())
         {
-            paramSuffix(variableNode);
+            countIterations(mainDefaults->second);
         }
-        return variableNode;
     }
-    throw runtime_error("Invalid expression. Unexpected token: " +
-                        to_string(ahead_[0].type()));
+    return compileStats_[index->second].estimateBytes(iterations);
 }
-
-// param_suffix ::= "[" expr "]" | "." Identifier
-void Parser::paramSuffix(ASTNodePtr &param)
+void SqlGenerator::getSqlAsync(
+    const string &name,
+    ParamList params,
+    function<void(string)> &&callback,
+    function<void(const exception_ptr &)> &&exceptionCallback)
 {
-    if (ahead_[0].type() == LBracket)
+    auto big = renderQueue_ && estimateBytes(name, params) >= asyncMinBytes_;
+    auto render = [this,
+                   name,
+                   params = std::move(params),
+                   callback = std::move(callback),
+                   exceptionCallback = std::move(exceptionCallback)]() {
+        string sql;
+        try
+        {
+            sql = getSql(name, params);
+        }
+        catch (...)
+        {
+            exceptionCallback(current_exception());
+            return;
+        }
+        callback(std::move(sql));
+    };
+    if (big)
     {
-        match(LBracket);
-        auto indexNode = expr();
-        match(RBracket);
-        param = make_shared<ArrayNode>(param, indexNode);
+        renderQueue_->runTaskInQueue(std::move(render));
     }
-    else if (ahead_[0].type() == Dot)
+    else
     {
-        match(Dot);
-        auto memberName = match(Identifier);
-        param =
-            make_shared<MemberNode>(param, make_shared<StringNode>(memberName));
+        render();
     }
 }
-
-// sub_sql ::= "@" Identifier "(" [param_list] ")"
-ASTNodePtr Parser::subSql()
+void SqlGenerator::enableSlowRenderLog(chrono::nanoseconds threshold,
+                                       size_t capacity)
 {
-    match(At);
-    auto subSqlName = match(Identifier);
-    match(LParen);
-    unordered_map<string, ASTNodePtr> params = {};
-    if (ahead_[0].type() == Identifier)
-    {
-        params = paramList();
-    }
-    match(RParen);
-    return make_shared<SubSqlNode>(subSqlName, subSqlGetter_, params);
+    slowRenderLog_ = make_unique<SlowRenderLog>(threshold, capacity);
 }
-
-// param_list ::= param_item { "," param_item }
-unordered_map<string, ASTNodePtr> Parser::paramList()
+void SqlGenerator::setProfiling(const string &name, bool enabled)
 {
-    unordered_map<string, ASTNodePtr> result;
-    result.emplace(paramItem());
-    while (true)
+    auto index = templateIndex_.find(name);
+    if (index == templateIndex_.end())
     {
-        if (ahead_[0].type() == Comma)
+        throw out_of_range("SQL statement not found: " + name);
+    }
+    if (profiled_[index->second].exchange(enabled) != enabled)
+    {
+        if (enabled)
         {
-            match(Comma);
-            result.emplace(paramItem());
+            profiledCount_.fetch_add(1);
         }
         else
         {
-            return result;
+            profiledCount_.fetch_sub(1);
         }
     }
 }
 
-// param_item ::= Identifier ["=" param_value]
-pair<string, ASTNodePtr> Parser::paramItem()
+void SqlGenerator::printTokens(const string &name, const string &subSqlName)
 {
-    auto paramName = match(Identifier);
-    ASTNodePtr param;
-    if (ahead_[0].type() == Assign)
-    {
-        match(Assign);
-        param = paramValue();
-    }
-    else
-    {
-        param = make_shared<VariableNode>(paramName);
-    }
-    return {paramName, param};
+    prepareParser(name, subSqlName);
+    cout << "Tokens for " << name << "." << subSqlName << ":\n";
+    parsers_[name].at(subSqlName).printTokens();
 }
 
-// param_value ::= expr | sub_sql
-ASTNodePtr Parser::paramValue()
+void SqlGenerator::printAST(const string &name, const string &subSqlName)
 {
-    if (ahead_[0].type() == At)
+    prepareParser(name, subSqlName);
+    cout << "AST for " << name << "." << subSqlName << ":\n";
+    parsers_[name].at(subSqlName).printAST();
+}
+
+template <typename Params>
+void SqlGenerator::render(const string &name,
+                          const Params &params,
+                          string &sql,
+                          uint64_t *fingerprint)
+{
+    assert(sqls_.isMember(name));
+    [[maybe_unused]] const auto &item = std::as_const(sqls_)[name];
+    assert(item.isString() ||
+           (item.isMember("main") &&
+            (item["main"].isString() || item["main"].isObject())));
+    ParamScope scope(params);
+    instrumentRender(
+        name, params, sql, fingerprint, [this, &name, &scope, &sql] {
+            getMainSql(name, scope, sql);
+        });
+}
+
+template <typename Params, typename Body>
+void SqlGenerator::instrumentRender(const string &name,
+                                    const Params &params,
+                                    string &sql,
+                                    uint64_t *fingerprint,
+                                    Body &&body)
+{
+    TL_SQL_PROBE_RENDER(name);
+    optional<FingerprintSink> skeleton;
+    optional<SinkScope<FingerprintSink>> installSkeleton;
+    if (fingerprint || fingerprintMetrics_)
     {
-        return subSql();
+        skeleton.emplace(sql);
+        installSkeleton.emplace(fingerprintSink, *skeleton);
     }
-    else
+    if (!metrics_ && !slowRenderLog_ &&
+        profiledCount_.load(memory_order_relaxed) == 0)
     {
-        return expr();
+        body();
+        if (fingerprint)
+        {
+            *fingerprint = skeleton->fingerprint.digest();
+        }
+        return;
     }
-}
-
-// if_stmt ::= "@" "if" "(" bool_expr ")" sql
-//            {"@" "elif" "(" bool_expr ")" sql}
-//            ["@" "else" sql]
-//             "@" "endif"
-ASTNodePtr Parser::ifStmt()
-{
-    match(At);
-    match(If);
-    match(LParen);
-    auto condition = boolExpr();
-    match(RParen);
-    auto ifStmt = sql();
-    vector<pair<ASTNodePtr, ASTNodePtr>> elIfStmts;
-    while (ahead_[0].type() == At && ahead_[1].type() == ElIf)
+    auto index = templateIndex_.find(name);
+    if (index == templateIndex_.end())
     {
-        match(At);
-        match(ElIf);
-        match(LParen);
-        auto elIfCondition = boolExpr();
-        match(RParen);
-        auto elIfStmt = sql();
-        elIfStmts.emplace_back(elIfCondition, elIfStmt);
+        body();
+        if (fingerprint)
+        {
+            *fingerprint = skeleton->fingerprint.digest();
+        }
+        return;
     }
-    ASTNodePtr elseStmt;
-    if (ahead_[0].type() == At && ahead_[1].type() == Else)
+    optional<RenderProfiler::Render> profile;
+    if (profiled_[index->second].load(memory_order_relaxed))
     {
-        match(At);
-        match(Else);
-        elseStmt = sql();
+        profile.emplace(*profiler_, name);
     }
-    match(At);
-    match(EndIf);
-    auto ifNode = make_shared<IfStmtNode>(condition, ifStmt, elseStmt);
-    for (const auto &elIfStmt : elIfStmts)
+    thread_local vector<pair<const ASTNode *, size_t>> iterations;
+    if (slowRenderLog_)
     {
-        ifNode->addElIfStmt(elIfStmt.first, elIfStmt.second);
+        iterations.clear();
+        loopIterations = &iterations;
     }
-    return ifNode;
-}
-
-// bool_expr ::= term {("or"|"||") term}
-ASTNodePtr Parser::boolExpr()
-{
-    auto root = term();
-    while (true)
+    auto offset = sql.size();
+    // The slow-render log needs every duration, the metrics only a sample
+    auto timed = slowRenderLog_ || (metrics_ && RenderMetrics::sampleLatency());
+    chrono::steady_clock::time_point start;
+    if (timed)
     {
-        if (ahead_[0].type() == Or)
+        start = chrono::steady_clock::now();
+    }
+    try
+    {
+        body();
+        uint64_t nanos = RenderMetrics::kNotTimed;
+        if (timed)
         {
-            match(Or);
-            root = make_shared<OrNode>(root, term());
+            nanos = chrono::duration_cast<chrono::nanoseconds>(
+                        chrono::steady_clock::now() - start)
+                        .count();
         }
-        else
+        loopIterations = nullptr;
+        auto bytes = sql.size() - offset;
+        auto digest = skeleton ? skeleton->fingerprint.digest()
+                               : StatementFingerprint::kNone;
+        if (fingerprint)
+        {
+            *fingerprint = digest;
+        }
+        if (profile)
+        {
+            profile->setBytes(bytes);
+        }
+        if (metrics_)
+        {
+            metrics_->record(index->second,
+                             nanos,
+                             bytes,
+                             fingerprintMetrics_ ? digest
+                                                 : StatementFingerprint::kNone);
+        }
+        if (slowRenderLog_ &&
+            nanos >= static_cast<uint64_t>(
+                         slowRenderLog_->threshold().count()))
+        {
+            SlowRender slow;
+            slow.name = name;
+            slow.time = chrono::system_clock::now();
+            slow.nanos = nanos;
+            slow.outputBytes = bytes;
+            for (const auto &[loop, count] : iterations)
+            {
+                slow.loops.emplace_back(loop->profileLabel(), count);
+            }
+            tie(slow.paramShape, slow.paramDepth) = describeParams(params);
+            slowRenderLog_->record(std::move(slow));
+        }
+    }
+    catch (...)
+    {
+        loopIterations = nullptr;
+        if (metrics_)
         {
-            return root;
+            metrics_->recordError(index->second);
         }
+        throw;
     }
 }
 
-// term ::= factor {("and"|"&&") factor}
-ASTNodePtr Parser::term()
+string SqlGenerator::getSql(const string &name, const ParamList &params)
 {
-    auto root = factor();
-    while (true)
+    string sql;
+    render(name, params, sql);
+    return sql;
+}
+
+string SqlGenerator::getInsertSql(const string &name,
+                                  const vector<ParamList> &rows)
+{
+    auto split = valuesRows_.find(name);
+    if (split == valuesRows_.end())
     {
-        if (ahead_[0].type() == And)
+        if (!sqls_.isMember(name))
         {
-            match(And);
-            root = make_shared<AndNode>(root, factor());
+            throw out_of_range("SQL statement not found: " + name);
         }
-        else
+        throw runtime_error("SQL statement has no VALUES row: " + name);
+    }
+    string sql;
+    if (rows.empty())
+    {
+        return sql;
+    }
+    const auto &[head, row, tail, spaceBeforeTail] = split->second;
+    auto defaults = mainDefaults(name);
+    // Recorded like any render of the statement, described by its first row
+    instrumentRender(name, rows.front(), sql, nullptr, [&] {
+        ParamScope first(rows.front());
+        first.setDefaults(defaults);
+        head.generateSql(first, sql);
+        sql += ' ';
+        for (size_t i = 0; i < rows.size(); ++i)
         {
-            return root;
+            if (i > 0)
+            {
+                sql += ", ";
+            }
+            ParamScope scope(rows[i]);
+            scope.setDefaults(defaults);
+            row.generateSql(scope, sql);
         }
-    }
+        auto tailStart = sql.size();
+        tail.generateSql(first, sql);
+        // Canonical whitespace drops the space at the start of the tail
+        if (spaceBeforeTail && sql.size() > tailStart &&
+            !isWhitespace(sql[tailStart]))
+        {
+            sql.insert(tailStart, 1, ' ');
+        }
+    });
+    return sql;
 }
 
-// factor ::= ["!"|"not"] ("(" bool_expr ")" | comp_expr)
-ASTNodePtr Parser::factor()
+RenderResult SqlGenerator::getSqlWithFingerprint(const string &name,
+                                                 const ParamList &params)
 {
-    auto isNegated = false;
-    if (ahead_[0].type() == Not)
+    RenderResult result;
+    render(name, params, result.sql, &result.fingerprint);
+    return result;
+}
+
+Statement SqlGenerator::getStatement(const string &name,
+                                     const ParamList &params,
+                                     PlaceholderStyle style)
+{
+    Statement statement;
+    PlaceholderSink sink(style, statement.sql);
     {
-        match(Not);
-        isNegated = true;
+        SinkScope install(placeholderSink, sink);
+        render(name, params, statement.sql, &statement.fingerprint);
     }
-    if (ahead_[0].type() == LParen)
+    sink.scan(statement.sql);
+    statement.args = std::move(sink.args());
+    return statement;
+}
+
+ShapeSet SqlGenerator::enumerateShapes(const string &name,
+                                       size_t maxShapes,
+                                       PlaceholderStyle style)
+{
+    ShapeSet result;
+    unordered_set<string> seen;
+    vector<size_t> choices;
+    for (;;)
     {
-        match(LParen);
-        auto boolNode = boolExpr();
-        match(RParen);
-        if (isNegated)
+        StatementShape shape;
+        PlaceholderSink sink(style, shape.sql, &choices);
         {
-            return make_shared<NotNode>(boolNode);
+            SinkScope install(placeholderSink, sink);
+            render(name, ParamList{}, shape.sql, &shape.fingerprint);
+        }
+        sink.scan(shape.sql);
+        if (sink.unknownLoop)
+        {
+            result.complete = false;
+        }
+        auto more = sink.nextChoices(choices);
+        if (seen.insert(shape.sql).second)
+        {
+            for (auto &arg : sink.args())
+            {
+                shape.params.push_back(std::move(get<string>(arg)));
+            }
+            result.shapes.push_back(std::move(shape));
+        }
+        if (!more)
+        {
+            break;
+        }
+        if (result.shapes.size() >= maxShapes)
+        {
+            result.complete = false;
+            break;
         }
-        return boolNode;
-    }
-    auto compNode = compExpr();
-    if (isNegated)
-    {
-        return make_shared<NotNode>(compNode);
     }
-    return compNode;
+    return result;
 }
 
-// comp_expr ::= expr [("=="|"!=") expr]
-ASTNodePtr Parser::compExpr()
+template <typename Params>
+void SqlGenerator::renderIntoImpl(const string &name,
+                                  const Params &params,
+                                  std::pmr::string &sql)
 {
-    auto result1 = expr();
-    ASTNodePtr result2;
-    if (ahead_[0].type() == EQ)
-    {
-        match(EQ);
-        result2 = expr();
-        return make_shared<EQNode>(result1, result2);
-    }
-    else if (ahead_[0].type() == NEQ)
-    {
-        match(NEQ);
-        result2 = expr();
-        return make_shared<NEQNode>(result1, result2);
-    }
-    // `param` means `param != null`
-    return result1;
+    RenderContext::OutputLease lease(renderContext);
+    render(name, params, lease.output());
+    sql.append(lease.output());
 }
 
-// for_loop ::= "@" "for" "("
-//              (Identifier|"(" Identifier "," Identifier ")") "in" expr
-//              ["," "separator" "=" String]
-//              ")" sql "@" "endif"
-ASTNodePtr Parser::forLoop()
+void SqlGenerator::renderInto(const string &name,
+                              const ParamList &params,
+                              std::pmr::string &sql)
 {
-    match(At);
-    match(For);
-    match(LParen);
-    string varName;
-    string indexName;
-    if (ahead_[0].type() == LParen)
+    renderIntoImpl(name, params, sql);
+}
+
+void SqlGenerator::renderInto(const string &name,
+                              const tl::sql::pmr::ParamList &params,
+                              std::pmr::string &sql)
+{
+    renderIntoImpl(name, params, sql);
+}
+
+namespace
+{
+/**
+ * @brief Appends a string prefixed with its length to `key`.
+ */
+void appendKeyString(const char *begin, const char *end, string &key)
+{
+    appendDecimal(end - begin, key);
+    key += ':';
+    key.append(begin, end);
+}
+
+/**
+ * @brief Appends a text to `key` which differs for any two different JSON
+ * values, without the cost of a Json::StreamWriter.
+ */
+void appendJsonKey(const Json::Value &json, string &key)
+{
+    const char *begin;
+    const char *end;
+    switch (json.type())
     {
-        match(LParen);
-        varName = match(Identifier);
-        match(Comma);
-        indexName = match(Identifier);
-        match(RParen);
+        case Json::nullValue:
+            key += 'n';
+            break;
+        case Json::intValue:
+            key += 'i';
+            appendDecimal(json.asInt64(), key);
+            break;
+        case Json::uintValue:
+            key += 'u';
+            key += std::to_string(json.asUInt64());
+            break;
+        case Json::realValue:
+            key += 'r';
+            appendDouble(json.asDouble(), key);
+            break;
+        case Json::stringValue:
+            key += 's';
+            json.getString(&begin, &end);
+            appendKeyString(begin, end, key);
+            break;
+        case Json::booleanValue:
+            key += json.asBool() ? 't' : 'f';
+            break;
+        case Json::arrayValue:
+        case Json::objectValue:
+            key += json.isArray() ? '[' : '{';
+            for (auto it = json.begin(); it != json.end(); ++it)
+            {
+                if (json.isObject())
+                {
+                    begin = it.memberName(&end);
+                    appendKeyString(begin, end, key);
+                }
+                appendJsonKey(*it, key);
+                key += ',';
+            }
+            key += json.isArray() ? ']' : '}';
+            break;
     }
-    else if (ahead_[0].type() == Identifier)
+}
+
+/**
+ * @brief Appends a text to `key` which differs for any two lists of
+ * different names or values, so it identifies the bound parameters of a
+ * specialization.
+ */
+void appendParamsKey(const ParamList &params, string &key)
+{
+    vector<const ParamList::value_type *> sorted;
+    for (const auto &param : params)
     {
-        varName = match(Identifier);
+        sorted.push_back(&param);
     }
-    match(In);
-    auto collection = this->expr();
-    ASTNodePtr separator{nullptr};
-    if (ahead_[0].type() == Comma)
+    sort(sorted.begin(), sorted.end(), [](auto lhs, auto rhs) {
+        return lhs->first < rhs->first;
+    });
+    for (const auto *param : sorted)
     {
-        match(Comma);
-        match(Separator);
-        match(Assign);
-        separator = make_shared<StringNode>(match(String));
+        const auto &name = param->first;
+        appendKeyString(name.data(), name.data() + name.size(), key);
+        key += static_cast<char>('0' + param->second.index());
+        visit(
+            [&key](const auto &value) {
+                using T = decay_t<decltype(value)>;
+                if constexpr (is_same_v<T, string>)
+                {
+                    appendKeyString(value.data(),
+                                    value.data() + value.size(),
+                                    key);
+                }
+                else if constexpr (is_same_v<T, Json::Value>)
+                {
+                    appendJsonKey(value, key);
+                }
+                else if constexpr (is_same_v<T, IntArray> ||
+                                   is_same_v<T, Int64Array>)
+                {
+                    appendDecimal(value.size(), key);
+                    for (auto element : value)
+                    {
+                        key += ',';
+                        appendDecimal(element, key);
+                    }
+                }
+                else if constexpr (is_same_v<T, ColumnBatch>)
+                {
+                    appendDecimal(value.rows(), key);
+                    for (const auto &[name, column] : value.columns())
+                    {
+                        key += ',';
+                        appendKeyString(name.data(),
+                                        name.data() + name.size(),
+                                        key);
+                        auto strings = get_if<vector<string>>(&column);
+                        for (size_t row = 0; row < value.rows(); ++row)
+                        {
+                            if (strings)
+                            {
+                                const auto &cell = (*strings)[row];
+                                appendKeyString(cell.data(),
+                                                cell.data() + cell.size(),
+                                                key);
+                            }
+                            else
+                            {
+                                appendCell(column, row, key);
+                            }
+                            key += ',';
+                        }
+                    }
+                }
+                else if constexpr (is_same_v<T, ColumnRow>)
+                {
+                    // Rows only exist while a loop is rendered
+                    appendDecimal(reinterpret_cast<uintptr_t>(value.batch),
+                                  key);
+                    key += ',';
+                    appendDecimal(value.row, key);
+                }
+                else if constexpr (is_same_v<T, double>)
+                {
+                    appendDouble(value, key);
+                }
+                else
+                {
+                    appendDecimal(value, key);
+                }
+                key += ';';
+            },
+            param->second);
     }
-    match(RParen);
-    auto loopBody = sql();
-    match(At);
-    match(EndFor);
-    return make_shared<ForLoopNode>(
-        varName, indexName, collection, separator, loopBody);
 }
+}  // namespace
 
-string Parser::match(TokenType type)
+string SpecializedSql::getSql(const ParamList &params) const
 {
-    assert(ahead_[0].type() == type);
-    auto value = ahead_[0].value();
-    nextToken();
-    return value;
+    string sql;
+    generateSql(params, sql);
+    return sql;
 }
 
-void Parser::nextToken()
+void SpecializedSql::generateSql(const ParamList &params, string &sql) const
 {
-    ahead_.pop_front();
-    ahead_.emplace_back(lexer_.next());
+    // The bound parameters are found first, then the given ones
+    ParamScope given(params);
+    given.setDefaults(defaults_);
+    ParamScope scope(bound_, &given);
+    generator_.instrumentRender(
+        name_, params, sql, nullptr, [this, &scope, &sql] {
+            parser_.generateSql(scope, sql);
+        });
 }
 
-ParamItem Parser::getParamByName(const string &paramName) const
+shared_ptr<SpecializedSql> SqlGenerator::specialize(const string &name,
+                                                    const ParamList &bound)
 {
-    auto it = params_.find(paramName);
-    if (it == params_.end())
+    auto key = name;
+    key += '\0';
+    appendParamsKey(bound, key);
     {
-        LOG_ERROR << "parameter \"" << paramName << "\" not found";
-        return nullopt;
-    }
-    if (holds_alternative<string>(it->second))
-    {
-        return get<string>(it->second);
-    }
-    else if (holds_alternative<int32_t>(it->second))
-    {
-        return get<int32_t>(it->second);
+        lock_guard<mutex> lock(specializationsMutex_);
+        auto it = specializations_.find(key);
+        if (it != specializations_.end())
+        {
+            return it->second;
+        }
     }
-    else  // Json::Value
+    // Compiled without the lock, a concurrent call may compile it as well
+    const auto &parser = findParser(name, "main");
+    auto specialized = make_shared<SpecializedSql>(*this,
+                                                   name,
+                                                   parser.specialize(bound),
+                                                   bound,
+                                                   mainDefaults(name));
+    lock_guard<mutex> lock(specializationsMutex_);
+    if (specializations_.size() >= kMaxSpecializations)
     {
-        return get<Json::Value>(it->second);
+        return specialized;
     }
+    return specializations_.emplace(std::move(key), specialized).first->second;
 }
 
-void SqlGenerator::initAndStart(const Json::Value &config)
+const RenderStats &SqlGenerator::lastRenderStats()
 {
-    assert(config.isObject());
-    assert(config.isMember("sqls"));
-    sqls_ = config["sqls"];
+#ifdef TL_SQL_INSTRUMENTATION
+    return renderStats;
+#else
+    static const RenderStats empty;
+    return empty;
+#endif
 }
 
-void SqlGenerator::printTokens(const string &name, const string &subSqlName)
+AllocationStats SqlGenerator::threadAllocationStats()
 {
-    prepareParser(name, subSqlName);
-    cout << "Tokens for " << name << "." << subSqlName << ":\n";
-    parsers_[name].at(subSqlName).printTokens();
+    AllocationStats stats;
+#ifdef TL_SQL_INSTRUMENTATION
+    stats.allocations = tracker.allocations;
+    stats.bytes = tracker.bytes;
+    stats.peakBytes = static_cast<size_t>(max<int64_t>(0, tracker.peak));
+#endif
+    return stats;
 }
 
-void SqlGenerator::printAST(const string &name, const string &subSqlName)
+void SqlGenerator::getMainSql(const string &name,
+                              ParamScope &scope,
+                              string &sql)
 {
-    prepareParser(name, subSqlName);
-    cout << "AST for " << name << "." << subSqlName << ":\n";
-    parsers_[name].at(subSqlName).printAST();
+    if (std::as_const(sqls_)[name].isString())
+    {
+        getSimpleSql(name, scope, sql);
+        return;
+    }
+    getSubSql(name, "main", scope, sql);
 }
 
-string SqlGenerator::getSql(const string &name, const ParamList &params)
+void SqlGenerator::getSubSql(const string &name,
+                             const string &subSqlName,
+                             ParamScope &scope,
+                             string &sql)
 {
-    assert(sqls_.isMember(name));
-    const auto &item = sqls_[name];
-    assert(item.isString() ||
-           (item.isMember("main") &&
-            (item["main"].isString() || item["main"].isObject())));
-    return getMainSql(name, params);
+    TL_SQL_PROBE_SUB_SQL(name, subSqlName);
+    RenderProfiler::Scope profile([&subSqlName] { return subSqlName; });
+    const auto &parser = findParser(name, subSqlName);
+    auto defaults = defaultParams_.find(name);
+    if (defaults != defaultParams_.end())
+    {
+        auto subSqlDefaults = defaults->second.find(subSqlName);
+        if (subSqlDefaults != defaults->second.end())
+        {
+            scope.setDefaults(&subSqlDefaults->second);
+        }
+    }
+    auto start = sql.size();
+    parser.generateSql(scope, sql);
+    profile.setBytes(sql.size() - start);
 }
 
-string SqlGenerator::getMainSql(const string &name, ParamList params)
+void SqlGenerator::getSimpleSql(const string &name,
+                                ParamScope &scope,
+                                string &sql)
 {
-    if (sqls_[name].isString())
-    {
-        return getSimpleSql(name, params);
-    }
-    return getSubSql(name, "main", params);
+    RenderProfiler::Scope profile([] { return string("main"); });
+    auto start = sql.size();
+    findParser(name, "main").generateSql(scope, sql);
+    profile.setBytes(sql.size() - start);
 }
 
-string SqlGenerator::getSubSql(const string &name,
-                               const string &subSqlName,
-                               ParamList params)
+namespace
 {
-    prepareParser(name, subSqlName);
+/**
+ * @brief The position of the row of an `INSERT ... VALUES (...)` statement.
+ */
+struct RowBounds
+{
+    size_t headEnd;   ///< The end of the `VALUES` keyword.
+    size_t rowBegin;  ///< The opening parenthesis of the row.
+    size_t rowEnd;    ///< Past the closing parenthesis of the row.
+};
 
-    auto &subSqlJson = sqls_[name][subSqlName];
-    if (subSqlJson.isObject() && subSqlJson.isMember("params") &&
-        subSqlJson["params"].isObject())
+/**
+ * @brief Finds the first `VALUES` keyword outside of string literals which
+ * is followed by a parenthesized row. The parentheses of directives in the
+ * row are counted like those of the text.
+ */
+optional<RowBounds> findValuesRow(string_view sql)
+{
+    auto quote = false;
+    for (size_t pos = 0; pos < sql.size(); ++pos)
     {
-        auto &paramsJson = subSqlJson["params"];
-        for (const auto &paramName : paramsJson.getMemberNames())
+        if (sql[pos] == '\'')
+        {
+            // A doubled quote closes the literal and opens it again
+            quote = !quote;
+            continue;
+        }
+        if (quote ||
+            (pos > 0 && (isalnum(static_cast<unsigned char>(sql[pos - 1])) ||
+                         sql[pos - 1] == '_')))
+        {
+            continue;
+        }
+        auto word = leadingWord(sql.substr(pos), "VALUES");
+        if (!word)
+        {
+            continue;
+        }
+        RowBounds bounds{pos + word, pos + word, 0};
+        while (bounds.rowBegin < sql.size() &&
+               isWhitespace(sql[bounds.rowBegin]))
         {
-            if (params.find(paramName) == params.end())
+            ++bounds.rowBegin;
+        }
+        if (bounds.rowBegin == sql.size() || sql[bounds.rowBegin] != '(')
+        {
+            continue;
+        }
+        size_t depth = 0;
+        for (auto end = bounds.rowBegin; end < sql.size(); ++end)
+        {
+            if (sql[end] == '\'')
+            {
+                quote = !quote;
+            }
+            else if (quote)
+            {
+                continue;
+            }
+            else if (sql[end] == '(')
             {
-                switch (paramsJson[paramName].type())
+                ++depth;
+            }
+            else if (sql[end] == ')' && --depth == 0)
+            {
+                bounds.rowEnd = end + 1;
+                return bounds;
+            }
+        }
+        return nullopt;
+    }
+    return nullopt;
+}
+
+/**
+ * @brief Checks whether every block directive of a part of a template is
+ * closed in the part, so that the part compiles on its own.
+ */
+bool closesBlocks(const string &text)
+{
+    Lexer lexer(text);
+    size_t depth = 0;
+    for (auto token = lexer.next(); token.type() != Done; token = lexer.next())
+    {
+        switch (token.type())
+        {
+            case If:
+            case For:
+            case Switch:
+            case Where:
+            case Set:
+                ++depth;
+                break;
+            case EndIf:
+            case EndFor:
+            case EndSwitch:
+            case EndWhere:
+            case EndSet:
+                if (depth-- == 0)
                 {
-                    case Json::stringValue:
-                        params.emplace(paramName,
-                                       paramsJson[paramName].asString());
-                        break;
-                    case Json::intValue:
-                        params.emplace(paramName,
-                                       paramsJson[paramName].asInt());
-                        break;
-                    default:
-                        params.emplace(paramName, paramsJson[paramName]);
-                        break;
+                    return false;
                 }
-            }
+                break;
+            case Unknown:
+                return false;
+            default:
+                break;
         }
     }
+    return depth == 0;
+}
+}  // namespace
+
+void SqlGenerator::prepareValuesRow(const string &name)
+{
+    auto parsers = parsers_.find(name);
+    if (parsers == parsers_.end())
+    {
+        return;
+    }
+    auto main = parsers->second.find("main");
+    if (main == parsers->second.end())
+    {
+        return;
+    }
+    const auto &sql = main->second.source();
+    auto bounds = findValuesRow(sql);
+    if (!bounds)
+    {
+        return;
+    }
+    auto head = sql.substr(0, bounds->headEnd);
+    auto row =
+        sql.substr(bounds->rowBegin, bounds->rowEnd - bounds->rowBegin);
+    auto tail = sql.substr(bounds->rowEnd);
+    if (!closesBlocks(head) || !closesBlocks(row) || !closesBlocks(tail))
+    {
+        // The row is part of a directive, which cannot be split
+        return;
+    }
+    auto part = [&main](const string &text) {
+        auto parser = main->second.withSource(text);
+        parser.compile();
+        return parser;
+    };
+    try
+    {
+        valuesRows_.emplace(
+            name,
+            ValuesRow{part(head),
+                      part(row),
+                      part(tail),
+                      !tail.empty() && isWhitespace(tail.front())});
+    }
+    catch (const runtime_error &)
+    {
+        // A part which does not compile on its own, such as a row which
+        // ends inside a `${...}` of the head
+    }
+}
 
-    parsers_[name].at(subSqlName).setParams(params);
-    return parsers_[name].at(subSqlName).parse();
+const ParamList *SqlGenerator::mainDefaults(const string &name) const
+{
+    auto nameDefaults = defaultParams_.find(name);
+    if (nameDefaults == defaultParams_.end())
+    {
+        return nullptr;
+    }
+    auto defaults = nameDefaults->second.find("main");
+    return defaults == nameDefaults->second.end() ? nullptr
+                                                  : &defaults->second;
 }
 
-string SqlGenerator::getSimpleSql(const string &name, const ParamList &params)
+const Parser &SqlGenerator::findParser(const string &name,
+                                       const string &subSqlName) const
 {
-    prepareParser(name, "main");
-    parsers_[name].at("main").setParams(params);
-    return parsers_[name].at("main").parse();
+    return parsers_.at(name).at(subSqlName);
 }
 
 void SqlGenerator::prepareParser(const string &name, const string &subSqlName)
@@ -1481,11 +5481,18 @@ void SqlGenerator::prepareParser(const string &name, const string &subSqlName)
         if (subSqlName == "main")
         {
             parsers_[name].emplace(subSqlName, Parser(sqls_[name].asString()));
+            parsers_[name].at(subSqlName).setMemoryResource(astArena_.get());
+            parsers_[name].at(subSqlName).setEscapeMode(escapeMode_);
+            parsers_[name].at(subSqlName).setCanonicalWhitespace(
+                canonicalWhitespace_);
+            parsers_[name].at(subSqlName).compile();
         }
     }
     else if (sqls_[name].isObject() && sqls_[name].isMember(subSqlName))
     {
         string sql;
+        auto escapeMode = escapeMode_;
+        auto canonicalWhitespace = canonicalWhitespace_;
         auto &subSqlJson = sqls_[name][subSqlName];
         if (subSqlJson.isString())
         {
@@ -1497,14 +5504,39 @@ void SqlGenerator::prepareParser(const string &name, const string &subSqlName)
             {
                 sql = subSqlJson["sql"].asString();
             }
+            if (subSqlJson.isMember("escape"))
+            {
+                escapeMode = parseEscape(subSqlJson["escape"]);
+            }
+            if (subSqlJson.isMember("canonical_whitespace"))
+            {
+                canonicalWhitespace =
+                    subSqlJson["canonical_whitespace"].asBool();
+            }
+            if (subSqlJson.isMember("params") &&
+                subSqlJson["params"].isObject())
+            {
+                auto &paramsJson = subSqlJson["params"];
+                auto &defaults = defaultParams_[name][subSqlName];
+                for (const auto &paramName : paramsJson.getMemberNames())
+                {
+                    defaults.emplace(paramName,
+                                     *jsonToParamItem(paramsJson[paramName]));
+                }
+            }
         }
         parsers_[name].emplace(subSqlName, Parser(sql));
-        parsers_[name]
-            .at(subSqlName)
-            .setSubSqlGetter(
-                [this, name = std::move(name)](const string &subSqlName,
-                                               const ParamList &params) {
-                    return getSubSql(name, subSqlName, params);
-                });
+        parsers_[name].at(subSqlName).setMemoryResource(astArena_.get());
+        parsers_[name].at(subSqlName).setEscapeMode(escapeMode);
+        // Only the main statement is printed on its own
+        parsers_[name].at(subSqlName).setCanonicalWhitespace(
+            canonicalWhitespace, subSqlName == "main");
+        parsers_[name].at(subSqlName).setSubSqlRenderer(
+            [this, name](const string &subSqlName,
+                         ParamScope &scope,
+                         string &sql) {
+                getSubSql(name, subSqlName, scope, sql);
+            });
+        parsers_[name].at(subSqlName).compile();
     }
 }
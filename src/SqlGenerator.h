@@ -25,8 +25,8 @@
  * for generating SQL statements dynamically.
  *
  * @author tanglong3bf
- * @date 2025-02-15
- * @version 0.6.4
+ * @date 2026-10-17
+ * @version 0.6.29
  *
  * This header file contains the declarations for the SqlGenerator library,
  * including the Token, Lexer, Parser, and SqlGenerator classes. The
@@ -36,8 +36,22 @@
 #pragma once
 
 #include <drogon/plugins/Plugin.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include "DecimalFormat.h"
+#include "RenderMetrics.h"
+#include "RenderProfiler.h"
+#include "SlowRenderLog.h"
+#include "SqlEscape.h"
+#include "StatementFingerprint.h"
+#include <trantor/utils/ConcurrentTaskQueue.h>
+#include <memory_resource>
 #include <optional>
+#include <string_view>
 #include <variant>
+#include <vector>
 
 /**
  * @namespace tl::sql
@@ -84,6 +98,15 @@ enum TokenType
     Separator,   ///< 'separator'
     In,          ///< 'in'
     EndFor,      ///< 'endfor'
+    Switch,      ///< 'switch'
+    Case,        ///< 'case'
+    Default,     ///< 'default'
+    EndSwitch,   ///< 'endswitch'
+    Let,         ///< 'let'
+    Where,       ///< 'where'
+    EndWhere,    ///< 'endwhere'
+    Set,         ///< 'set'
+    EndSet,      ///< 'endset'
     Done,        ///< All token is processed.
     Unknown      ///< An unknown token type.
 };
@@ -132,6 +155,15 @@ inline std::string to_string(TokenType type)
         TOKEN_TYPE_CASE(In);
         TOKEN_TYPE_CASE(Null);
         TOKEN_TYPE_CASE(EndFor);
+        TOKEN_TYPE_CASE(Switch);
+        TOKEN_TYPE_CASE(Case);
+        TOKEN_TYPE_CASE(Default);
+        TOKEN_TYPE_CASE(EndSwitch);
+        TOKEN_TYPE_CASE(Let);
+        TOKEN_TYPE_CASE(Where);
+        TOKEN_TYPE_CASE(EndWhere);
+        TOKEN_TYPE_CASE(Set);
+        TOKEN_TYPE_CASE(EndSet);
         TOKEN_TYPE_CASE(Done);
         default:
             return "Unknown";
@@ -232,6 +264,17 @@ class Lexer
     {
         pos_ = 0;
         parenDepth_ = 0;
+        afterAt_ = false;
+    }
+
+    /**
+     * @brief Returns the SQL statement being tokenized.
+     * @date 2026-10-17
+     * @since 0.6.27
+     */
+    const std::string& source() const
+    {
+        return sql_;
     }
 
     /**
@@ -272,19 +315,167 @@ class Lexer
     size_t pos_{0};         ///< The current position in the SQL statement.
     size_t parenDepth_{0};  ///< The current depth of nested parentheses.
     bool cancelOnceLParen_{false};  ///< Whether to cancel the next LParen.
+    bool afterAt_{false};  ///< Whether the last token was '@', after which
+                           ///< the keywords of directives are recognized.
 };
 
-using ParamList =
-    std::unordered_map<std::string,
-                       std::variant<int32_t, std::string, Json::Value>>;
-using ParamItem =
-    std::optional<std::variant<int32_t, std::string, Json::Value>>;
+/**
+ * @brief Arrays of integers which can be passed instead of a JSON array, for
+ * example as the ids of `@for(id in ids, separator=',') ${id} @endfor`. They
+ * are iterated without a Json::Value per element.
+ * @date 2026-10-17
+ * @since 0.6.16
+ */
+using IntArray = std::vector<int32_t>;
+using Int64Array = std::vector<int64_t>;  ///< @copydoc IntArray
+
+/**
+ * @brief A column of a ColumnBatch.
+ * @date 2026-10-17
+ * @since 0.6.29
+ */
+using Column = std::variant<IntArray,
+                            Int64Array,
+                            std::vector<double>,
+                            std::vector<std::string>,
+                            std::vector<bool>>;
+
+/**
+ * @class ColumnBatch
+ * @brief Rows stored as named columns of equal length, such as the ids and
+ * names of the users of a bulk insert.
+ *
+ * `@for(user in users)` over a batch binds `user` to a ColumnRow, and
+ * `${user.name}` prints the cell of the `name` column in place, without an
+ * object per row.
+ *
+ * @code
+ * ColumnBatch users;
+ * users.add("id", Int64Array{1, 2}).add("name", std::vector<std::string>{
+ *                                                   "'a'", "'b'"});
+ * generator->getSql("insert_users", {{"users", std::move(users)}});
+ * @endcode
+ *
+ * @date 2026-10-17
+ * @since 0.6.29
+ */
+class ColumnBatch
+{
+  public:
+    /**
+     * @brief Adds a column.
+     * @throw std::runtime_error If the column has another number of rows
+     * than the columns before, or its name is taken.
+     */
+    ColumnBatch& add(std::string name, Column column);
+
+    /**
+     * @brief Returns the column `name`, or nullptr if there is none.
+     */
+    const Column* column(std::string_view name) const
+    {
+        for (const auto& column : columns_)
+        {
+            if (column.first == name)
+            {
+                return &column.second;
+            }
+        }
+        return nullptr;
+    }
+
+    const std::vector<std::pair<std::string, Column>>& columns() const
+    {
+        return columns_;
+    }
+
+    size_t rows() const
+    {
+        return rows_;
+    }
+
+    bool operator==(const ColumnBatch&) const = default;
+
+  private:
+    std::vector<std::pair<std::string, Column>> columns_;
+    size_t rows_{0};
+};
+
+/**
+ * @brief A row of a ColumnBatch, which `@for` binds to its variable. It only
+ * points into the batch.
+ * @date 2026-10-17
+ * @since 0.6.29
+ */
+struct ColumnRow
+{
+    const ColumnBatch* batch{nullptr};
+    size_t row{0};
+
+    bool operator==(const ColumnRow&) const = default;
+};
+
+/**
+ * @brief The value of a parameter. JSON scalars are unwrapped into int32_t,
+ * int64_t, double, bool or std::string when they are read, so that they are
+ * printed without a Json::Value in between.
+ *
+ * `${}` prints integers in decimal, doubles in the shortest text which reads
+ * back as the same value, booleans as TRUE or FALSE and strings as they are.
+ */
+using ParamValue = std::variant<int32_t,
+                                std::string,
+                                Json::Value,
+                                IntArray,
+                                Int64Array,
+                                int64_t,
+                                double,
+                                bool,
+                                ColumnBatch,
+                                ColumnRow>;
+using ParamList = std::unordered_map<std::string, ParamValue>;
+using ParamItem = std::optional<ParamValue>;
+
+/**
+ * @namespace tl::sql::pmr
+ * @brief Variants of the parameter types whose storage comes from a
+ * std::pmr::memory_resource.
+ */
+namespace pmr
+{
+/**
+ * @brief Hashes all string types alike, so that a ParamList can be searched
+ * without converting the key.
+ */
+struct StringHash
+{
+    using is_transparent = void;
+
+    size_t operator()(std::string_view str) const noexcept
+    {
+        return std::hash<std::string_view>{}(str);
+    }
+};
+
+/**
+ * @brief A parameter list whose nodes and keys are allocated from a memory
+ * resource, such as a std::pmr::monotonic_buffer_resource per request.
+ *
+ * The values are ParamValue as in tl::sql::ParamList, so strings longer than
+ * the small string buffer and JSON values still use the global heap.
+ *
+ * @date 2026-10-17
+ * @since 0.6.14
+ */
+using ParamList = std::pmr::
+    unordered_map<std::pmr::string, ParamValue, StringHash, std::equal_to<>>;
+}  // namespace pmr
 
 /**
  * @brief Converts a ParamItem to a boolean value.
  *
  * This function takes a ParamItem and converts it to a boolean value.
- * An empty value, 0, or an empty string are considered false.
+ * An empty value, 0, false, or an empty string are considered false.
  * All other cases are considered true.
  *
  * @param value The ParamItem to be converted.
@@ -295,6 +486,329 @@ using ParamItem =
  */
 bool toBool(const ParamItem& value);
 
+/**
+ * @class ParamScope
+ * @brief A frame of the scope stack used while rendering.
+ *
+ * A name is looked up in the bindings of the frame, then in its parameters,
+ * then in its default parameters and at last in the parent frame. A `@for`
+ * binds its variables in a child frame instead of copying the parameters, and
+ * a sub-SQL call binds its arguments in a frame without a parent.
+ *
+ * Frames live on the stack of the rendering thread and only point to the
+ * parameters. The bindings are borrowed from a thread-local pool when the
+ * first name is bound and returned when the frame is destroyed, so the bound
+ * strings keep their capacity from one render to the next. The pool keeps at
+ * most `kMaxPooledFrames` frames of at most `kMaxPooledFrameBytes` each.
+ *
+ * @date 2026-10-17
+ * @since 0.6.13
+ */
+class ParamScope
+{
+  public:
+    using Binding = std::pair<std::string, ParamValue>;
+
+    static constexpr size_t kMaxPooledFrames = 16;
+    static constexpr size_t kMaxPooledFrameBytes = 16 * 1024;
+
+    /**
+     * @brief Creates a root frame of the given parameters.
+     */
+    explicit ParamScope(const ParamList& params) : params_(&params)
+    {
+    }
+
+    /**
+     * @brief Creates a root frame of the given pmr parameters.
+     */
+    explicit ParamScope(const pmr::ParamList& params) : pmrParams_(&params)
+    {
+    }
+
+    /**
+     * @brief Creates a frame of the given parameters which falls back to
+     * `parent`.
+     * @date 2026-10-17
+     * @since 0.6.24
+     */
+    ParamScope(const ParamList& params, const ParamScope* parent)
+        : params_(&params), parent_(parent)
+    {
+    }
+
+    /**
+     * @brief Creates a frame which falls back to `parent`, or a frame without
+     * a parent.
+     */
+    explicit ParamScope(const ParamScope* parent = nullptr) : parent_(parent)
+    {
+    }
+
+    ~ParamScope();
+
+    ParamScope(const ParamScope&) = delete;
+    ParamScope& operator=(const ParamScope&) = delete;
+
+    /**
+     * @brief Returns the value of a name, or nullptr if it is not defined.
+     */
+    const ParamValue* find(const std::string& name) const;
+
+    /**
+     * @brief Binds a name in this frame and returns its value to be assigned.
+     * The value of a new binding keeps whatever a previous render left in the
+     * pooled slot. The reference is valid until another name is bound.
+     */
+    ParamValue& bind(const std::string& name);
+
+    /**
+     * @brief Removes a binding of this frame.
+     */
+    void unbind(const std::string& name);
+
+    /**
+     * @brief Sets the default parameters, used for names which are neither
+     * bound nor in the parameters.
+     */
+    void setDefaults(const ParamList* defaults)
+    {
+        defaults_ = defaults;
+    }
+
+    /**
+     * @brief Returns the bindings of this frame as a parameter list.
+     */
+    ParamList bindings() const;
+
+  private:
+    const ParamList* params_{nullptr};    ///< Parameters of the frame.
+    const pmr::ParamList* pmrParams_{nullptr};  ///< Parameters of a root
+                                                ///< frame given as pmr.
+    const ParamList* defaults_{nullptr};  ///< Default parameters.
+    const ParamScope* parent_{nullptr};   ///< The enclosing frame.
+    std::vector<Binding>* bindings_{nullptr};  ///< Pooled binding storage.
+    size_t bindingCount_{0};  ///< Used entries at the front of bindings_.
+};
+
+/**
+ * @brief Renders a sub-SQL statement with the arguments bound in a scope,
+ * appending it to the output buffer.
+ */
+using SubSqlRenderer =
+    std::function<void(const std::string&, ParamScope&, std::string&)>;
+
+/**
+ * @brief Tells whether a parameter name is of interest, such as whether it
+ * is bound by a loop.
+ * @date 2026-10-17
+ * @since 0.6.24
+ */
+using NamePredicate = std::function<bool(const std::string&)>;
+
+/**
+ * @struct AllocationStats
+ * @brief Heap allocations counted by the instrumentation mode.
+ *
+ * The instrumentation mode is enabled by compiling with the macro
+ * `TL_SQL_INSTRUMENTATION`. It replaces the global operator new and delete to
+ * count the allocations of every thread. Without the macro, all statistics
+ * stay zero and the counting code is not compiled at all.
+ *
+ * @date 2026-10-17
+ * @since 0.6.7
+ */
+struct AllocationStats
+{
+    size_t allocations{0};  ///< Number of heap allocations.
+    size_t bytes{0};        ///< Total bytes allocated.
+    size_t peakBytes{0};    ///< Peak of the live bytes allocated in the scope.
+};
+
+/**
+ * @struct RenderStats
+ * @brief Allocation statistics of a single call to SqlGenerator::getSql.
+ *
+ * `byNodeType` is exclusive: the allocations of a node do not include those
+ * of its children. Growing the output buffer is counted to the node which
+ * appends to it. `bySubSql` is inclusive and keyed by "name.subSqlName".
+ * `outputReallocations` counts how often an append or a reserve made an
+ * output buffer grow, which shows how well the buffers are presized.
+ *
+ * @date 2026-10-17
+ * @since 0.6.7
+ */
+struct RenderStats
+{
+    std::string name;       ///< The name of the rendered SQL statement.
+    AllocationStats total;  ///< All allocations made by the render.
+    std::map<std::string, AllocationStats>
+        byNodeType;  ///< Allocations by AST node type.
+    std::map<std::string, AllocationStats>
+        bySubSql;  ///< Allocations by sub-SQL statement.
+    size_t outputReallocations{0};  ///< Growths of output buffers.
+};
+
+/**
+ * @class SizeEstimator
+ * @brief A moving estimate of a high quantile of recent output sizes.
+ *
+ * A larger size moves the estimate half of the way up, a smaller one only
+ * 1/64 of the way down, so the estimate stays close to the largest recent
+ * sizes. Initial and observed sizes are clamped to kMaxEstimateBytes, so
+ * that one huge output does not make every later render reserve as much. The
+ * estimate is updated with relaxed atomic loads and stores: a concurrent
+ * update may be lost, which only delays the estimate.
+ *
+ * @date 2026-10-17
+ * @since 0.6.12
+ */
+class SizeEstimator
+{
+  public:
+    /// The largest estimate; larger outputs grow the string as they need.
+    static constexpr size_t kMaxEstimateBytes = 256 * 1024;
+
+    explicit SizeEstimator(size_t initial = 0)
+        : estimate_(std::min(initial, kMaxEstimateBytes))
+    {
+    }
+
+    SizeEstimator(const SizeEstimator& other) : estimate_(other.estimate())
+    {
+    }
+
+    SizeEstimator& operator=(const SizeEstimator& other)
+    {
+        estimate_.store(other.estimate(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    size_t estimate() const
+    {
+        return estimate_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Moves the estimate towards an observed size.
+     */
+    void observe(size_t size)
+    {
+        size = std::min(size, kMaxEstimateBytes);
+        auto estimate = this->estimate();
+        auto next = estimate;
+        if (size > estimate)
+        {
+            next += (size - estimate + 1) / 2;
+        }
+        else if (size < estimate)
+        {
+            next -= std::max<size_t>((estimate - size) / 64, 1);
+        }
+        // Avoid writing to a shared cache line when nothing changed
+        if (next != estimate)
+        {
+            estimate_.store(next, std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    std::atomic<size_t> estimate_;
+};
+
+class ASTNode;
+using ASTNodePtr = std::shared_ptr<ASTNode>;
+
+/**
+ * @struct AstStats
+ * @brief Static statistics of an AST, collected by ASTNode::analyze.
+ *
+ * The output of the AST is estimated as `baseBytes`, rendered once, plus
+ * `perIterationBytes` for every iteration of an enclosing `@for`. A printed
+ * value is estimated as kPrintedValueBytes bytes and an `@if` as its largest
+ * branch. Sub-SQL statements are not followed, their calls are listed in
+ * `subSqlCalls` instead.
+ *
+ * @date 2026-10-17
+ * @since 0.6.11
+ */
+struct AstStats
+{
+    static constexpr size_t kPrintedValueBytes = 8;
+
+    size_t nodes{0};              ///< Number of AST nodes.
+    size_t literalBytes{0};       ///< Bytes of normal text.
+    size_t loopDepth{0};          ///< Deepest nesting of `@for`.
+    size_t baseBytes{0};          ///< Estimated bytes outside of loops.
+    size_t perIterationBytes{0};  ///< Estimated bytes of one loop iteration.
+    std::vector<std::pair<std::string, size_t>>
+        subSqlCalls;  ///< Called sub-SQL statements with the loop depth of
+                      ///< each call.
+
+    /**
+     * @brief Adds estimated output rendered at the given loop depth.
+     */
+    void addBytes(size_t bytes, size_t loopDepth)
+    {
+        (loopDepth == 0 ? baseBytes : perIterationBytes) += bytes;
+    }
+};
+
+/**
+ * @struct WhitespaceState
+ * @brief The state of the whitespace canonicalization, carried through the
+ * AST in template order.
+ *
+ * @see Parser::setCanonicalWhitespace
+ * @date 2026-10-17
+ * @since 0.6.19
+ */
+struct WhitespaceState
+{
+    char quote{0};              ///< The open quote, 0 outside of quotes.
+    bool lineComment{false};    ///< Inside a `--` comment.
+    bool blockComment{false};   ///< Inside a `/*` comment.
+    bool afterSpace{true};      ///< Whether the output so far ends with
+                                ///< whitespace on every path, or is empty.
+};
+
+/**
+ * @struct CompileStats
+ * @brief Compile statistics and the render cost model of a SQL statement,
+ * collected by SqlGenerator::initAndStart.
+ *
+ * `subSqlDepth`, `loopDepth`, `baseBytes` and `perIterationBytes` follow the
+ * sub-SQL calls starting at "main". A call made inside a loop adds all of its
+ * bytes to `perIterationBytes`.
+ *
+ * @date 2026-10-17
+ * @since 0.6.11
+ */
+struct CompileStats
+{
+    /// The number of loop iterations used to rank SQL statements by cost.
+    static constexpr size_t kReferenceIterations = 100;
+
+    std::string name;             ///< The name of the SQL statement.
+    size_t tokens{0};             ///< Tokens of all sub-SQL statements.
+    size_t astNodes{0};           ///< AST nodes of all sub-SQL statements.
+    size_t subSqlDepth{0};        ///< Longest chain of sub-SQL calls.
+    size_t loopDepth{0};          ///< Deepest nesting of `@for`.
+    size_t literalBytes{0};       ///< Normal text of all sub-SQL statements.
+    uint64_t compileNanos{0};     ///< Time spent building the ASTs.
+    size_t baseBytes{0};          ///< Estimated bytes outside of loops.
+    size_t perIterationBytes{0};  ///< Estimated bytes of one loop iteration.
+
+    /**
+     * @brief Estimates the size of a render with the given number of loop
+     * iterations.
+     */
+    size_t estimateBytes(size_t iterations) const
+    {
+        return baseBytes + perIterationBytes * iterations;
+    }
+};
+
 /**
  * @class ASTNode
  *
@@ -329,6 +843,35 @@ class ASTNode
         nextSibling_ = nextSibling;
     }
 
+    /**
+     * @brief Returns the next sibling node, or nullptr.
+     * @date 2026-10-17
+     * @since 0.6.15
+     */
+    const ASTNode* nextSibling() const
+    {
+        return nextSibling_.get();
+    }
+
+    /**
+     * @overload
+     */
+    ASTNode* nextSibling()
+    {
+        return nextSibling_.get();
+    }
+
+    /**
+     * @brief Detaches and returns the next sibling node, which keeps the
+     * siblings after it.
+     * @date 2026-10-17
+     * @since 0.6.23
+     */
+    std::shared_ptr<ASTNode> takeNextSibling()
+    {
+        return std::move(nextSibling_);
+    }
+
     /**
      * @brief Generates SQL based on the node and its parameters.
      *
@@ -340,6 +883,45 @@ class ASTNode
      */
     std::string generateSql(const ParamList& params = {}) const;
 
+    /**
+     * @brief Appends the SQL of the node and its sibling nodes to `sql`.
+     *
+     * @param params A list of parameters to be used in SQL generation.
+     * @param sql The output buffer.
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    void generateSql(const ParamList& params, std::string& sql) const;
+
+    /**
+     * @brief Appends the SQL of the node and its sibling nodes to `sql`,
+     * looking up parameters in a scope.
+     *
+     * @date 2026-10-17
+     * @since 0.6.13
+     */
+    void generateSql(const ParamScope& scope, std::string& sql) const;
+
+    /**
+     * @brief Collects the statistics of the node and its sibling nodes.
+     *
+     * @param stats The statistics to add to.
+     * @param loopDepth The number of `@for` enclosing the node.
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    void analyze(AstStats& stats, size_t loopDepth = 0) const;
+
+    /**
+     * @brief Collapses the insignificant whitespace of the normal text of the
+     * node and its sibling nodes.
+     *
+     * @see Parser::setCanonicalWhitespace
+     * @date 2026-10-17
+     * @since 0.6.19
+     */
+    void canonicalizeWhitespace(WhitespaceState& state);
+
     /**
      * @brief Gets the value of the node.
      *
@@ -348,7 +930,86 @@ class ASTNode
      * @param params A list of parameters that may affect the node's value.
      * @return ParamItem The value of the node.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const = 0;
+    ParamItem getValue(const ParamList& params = {}) const
+    {
+        return getValue(ParamScope(params));
+    }
+
+    /**
+     * @brief Gets the value of the node, looking up parameters in a scope.
+     *
+     * @date 2026-10-17
+     * @since 0.6.13
+     */
+    virtual ParamItem getValue(const ParamScope& scope) const = 0;
+
+    /**
+     * @brief Assigns the value of the node to `target`, reusing the storage
+     * of `target` where possible.
+     *
+     * @return false if the node has no value, `target` is then unspecified.
+     * @date 2026-10-17
+     * @since 0.6.13
+     */
+    virtual bool assignValue(const ParamScope& scope, ParamValue& target) const;
+
+    /**
+     * @brief Returns the JSON value the node refers to without copying it, or
+     * nullptr if the node does not refer to a JSON parameter.
+     *
+     * @date 2026-10-17
+     * @since 0.6.13
+     */
+    virtual const Json::Value* findJson(const ParamScope&) const
+    {
+        return nullptr;
+    }
+
+    /**
+     * @brief Returns the parameter the node refers to without copying it, or
+     * nullptr if the node computes its value.
+     *
+     * @date 2026-10-17
+     * @since 0.6.16
+     */
+    virtual const ParamValue* findValue(const ParamScope&) const
+    {
+        return nullptr;
+    }
+
+    /**
+     * @brief Returns the column of the ColumnBatch cell the node refers to
+     * and sets `row` to its row, or returns nullptr if the node does not
+     * refer to a cell.
+     *
+     * @date 2026-10-17
+     * @since 0.6.29
+     */
+    virtual const Column* findCell(const ParamScope&, size_t&) const
+    {
+        return nullptr;
+    }
+
+    /**
+     * @brief Returns whether the value of the node may depend on a name for
+     * which `predicate` returns true. Nodes which cannot tell return true.
+     *
+     * @date 2026-10-17
+     * @since 0.6.24
+     */
+    virtual bool usesName(const NamePredicate&) const
+    {
+        return true;
+    }
+
+    /**
+     * @brief Returns whether the value of the node may depend on any of
+     * `names`.
+     *
+     * @date 2026-10-17
+     * @since 0.6.23
+     */
+    bool usesNames(const std::vector<std::string>& names) const;
 
     /**
      * @brief Print the current node and its sibling nodes
@@ -389,13 +1050,73 @@ class ASTNode
      */
     virtual std::string nodeName() const = 0;
 
+    /**
+     * @brief Returns the template source of an expression node, such as
+     * `user.name`. Other nodes return their node name.
+     *
+     * @date 2026-10-17
+     * @since 0.6.9
+     */
+    virtual std::string sourceText() const
+    {
+        return nodeName();
+    }
+
+    /**
+     * @brief Returns the label of the profiler frame opened while the node is
+     * rendered, or an empty string if the node does not open a frame.
+     *
+     * @see RenderProfiler
+     * @date 2026-10-17
+     * @since 0.6.9
+     */
+    virtual std::string profileLabel() const
+    {
+        return "";
+    }
+
+  protected:
+    /**
+     * @brief Appends the SQL of the current node alone to `sql`. By default
+     * the value of the node is converted to text.
+     *
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    virtual void appendSql(const ParamScope& scope, std::string& sql) const;
+
+    /**
+     * @brief Collects the statistics of the current node alone. By default
+     * the node counts as one printed value.
+     *
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    virtual void analyzeInner(AstStats& stats, size_t loopDepth) const;
+
+    /**
+     * @brief Canonicalizes the whitespace of the current node alone. By
+     * default the node counts as a printed value, which may end with
+     * anything.
+     *
+     * @date 2026-10-17
+     * @since 0.6.19
+     */
+    virtual void canonicalizeInner(WhitespaceState& state)
+    {
+        state.afterSpace = false;
+    }
+
+    /**
+     * @brief Returns the number of nodes of an expression, 0 for nullptr.
+     */
+    static size_t countNodes(const ASTNodePtr& expr);
+
   protected:
     std::shared_ptr<ASTNode>
         nextSibling_;  ///< Pointer to the next sibling node in the AST.
 };
 
-using ASTNodePtr = std::shared_ptr<ASTNode>;
-
 /**
  * @class NormalTextNode
  *
@@ -422,7 +1143,7 @@ class NormalTextNode : public ASTNode
      *
      * @return ParamItem The text content of the node.
      */
-    virtual ParamItem getValue(const ParamList& = {}) const override
+    virtual ParamItem getValue(const ParamScope&) const override
     {
         return text_;
     }
@@ -434,6 +1155,43 @@ class NormalTextNode : public ASTNode
         return "NormalTextNode";
     }
 
+    const std::string& text() const
+    {
+        return text_;
+    }
+
+    virtual bool usesName(const NamePredicate&) const override
+    {
+        return false;
+    }
+
+    /**
+     * @brief Appends `text` to the text of the node, which joins the texts
+     * around a statement folded by Parser::specialize.
+     * @date 2026-10-17
+     * @since 0.6.24
+     */
+    void appendText(const std::string& text)
+    {
+        text_ += text;
+    }
+
+    /**
+     * @brief Removes the whitespace at the end of the text.
+     * @date 2026-10-17
+     * @since 0.6.19
+     */
+    void trimEnd();
+
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
+    virtual void analyzeInner(AstStats& stats,
+                              size_t loopDepth) const override;
+
+    virtual void canonicalizeInner(WhitespaceState& state) override;
+
   private:
     std::string text_;  ///< The text content of the node.
 };
@@ -464,7 +1222,7 @@ class NumberNode : public ASTNode
      *
      * @return ParamItem The integer value of the node.
      */
-    virtual ParamItem getValue(const ParamList& = {}) const override
+    virtual ParamItem getValue(const ParamScope&) const override
     {
         return value_;
     }
@@ -476,6 +1234,16 @@ class NumberNode : public ASTNode
         return "NumberNode";
     }
 
+    virtual bool usesName(const NamePredicate&) const override
+    {
+        return false;
+    }
+
+    virtual std::string sourceText() const override
+    {
+        return std::to_string(value_);
+    }
+
   private:
     int32_t value_;  ///< The integer value of the node.
 };
@@ -506,7 +1274,7 @@ class StringNode : public ASTNode
      *
      * @return ParamItem The string value of the node.
      */
-    virtual ParamItem getValue(const ParamList& = {}) const override
+    virtual ParamItem getValue(const ParamScope&) const override
     {
         return value_;
     }
@@ -518,6 +1286,16 @@ class StringNode : public ASTNode
         return "StringNode";
     }
 
+    virtual bool usesName(const NamePredicate&) const override
+    {
+        return false;
+    }
+
+    virtual std::string sourceText() const override
+    {
+        return "'" + value_ + "'";
+    }
+
   private:
     std::string value_;  ///< The string value of the node.
 };
@@ -548,7 +1326,7 @@ class NullNode : public ASTNode
      *
      * @return ParamItem std::nullopt, indicating no value.
      */
-    virtual ParamItem getValue(const ParamList& = {}) const override
+    virtual ParamItem getValue(const ParamScope&) const override
     {
         return std::nullopt;
     }
@@ -559,6 +1337,16 @@ class NullNode : public ASTNode
     {
         return "NullNode";
     }
+
+    virtual bool usesName(const NamePredicate&) const override
+    {
+        return false;
+    }
+
+    virtual std::string sourceText() const override
+    {
+        return "null";
+    }
 };
 
 /**
@@ -589,12 +1377,12 @@ class VariableNode : public ASTNode
      * This method retrieves the value of the variable from the provided
      * parameter list. If the variable is not found, it returns std::nullopt.
      *
-     * @param params A list of parameters containing variable names and their
+     * @param scope The parameters in scope, containing variable names and their
      * values.
      * @return ParamItem The value of the variable, or std::nullopt if not
      * found.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override;
+    virtual ParamItem getValue(const ParamScope& scope) const override;
 
     virtual void printInner(std::vector<int> indentFlags) const override;
 
@@ -603,6 +1391,36 @@ class VariableNode : public ASTNode
         return "VariableNode";
     }
 
+    const std::string& name() const
+    {
+        return name_;
+    }
+
+    virtual std::string sourceText() const override
+    {
+        return name_;
+    }
+
+    virtual std::string profileLabel() const override
+    {
+        return "${" + name_ + "}";
+    }
+
+    virtual bool assignValue(const ParamScope& scope,
+                             ParamValue& target) const override;
+
+    virtual const Json::Value* findJson(
+        const ParamScope& scope) const override;
+
+    virtual const ParamValue* findValue(
+        const ParamScope& scope) const override;
+
+    virtual bool usesName(const NamePredicate& predicate) const override;
+
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
   private:
     std::string name_;  ///< The name of the variable.
 };
@@ -631,7 +1449,12 @@ class BinaryOpNode : public ASTNode
 
     virtual void printInner(std::vector<int> indentFlags) const override;
 
+    virtual bool usesName(const NamePredicate& predicate) const override;
+
   protected:
+    virtual void analyzeInner(AstStats& stats,
+                              size_t loopDepth) const override;
+
     ASTNodePtr left_;   ///< The left operand node.
     ASTNodePtr right_;  ///< The right operand node.
 };
@@ -674,7 +1497,8 @@ class MemberNode : public BinaryOpNode
 {
   public:
     MemberNode(const ASTNodePtr& object, const ASTNodePtr& member)
-        : BinaryOpNode(object, member)
+        : BinaryOpNode(object, member),
+          memberName_(std::get<std::string>(*member->getValue()))
     {
     }
 
@@ -686,16 +1510,43 @@ class MemberNode : public BinaryOpNode
      *
      * This method retrieves the value of the member from the object.
      *
-     * @param params A list of parameters (used to resolve variable values in
+     * @param scope The parameters in scope (used to resolve variable values in
      * the object or member).
      * @return ParamItem The value of the member.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override;
+    virtual ParamItem getValue(const ParamScope& scope) const override;
 
     virtual std::string nodeName() const override
     {
         return "MemberNode";
     }
+
+    virtual std::string sourceText() const override;
+
+    virtual std::string profileLabel() const override
+    {
+        return "${" + sourceText() + "}";
+    }
+
+    virtual bool assignValue(const ParamScope& scope,
+                             ParamValue& target) const override;
+
+    virtual const Json::Value* findJson(
+        const ParamScope& scope) const override;
+
+    /**
+     * @brief Returns the column named like the member if the object is a
+     * row bound by `@for` over a ColumnBatch.
+     */
+    virtual const Column* findCell(const ParamScope& scope,
+                                   size_t& row) const override;
+
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
+  private:
+    std::string memberName_;  ///< The name of the member.
 };
 
 /**
@@ -726,16 +1577,37 @@ class ArrayNode : public BinaryOpNode
      * This method retrieves the value of the element at the specified index in
      * the array.
      *
-     * @param params A list of parameters (used to resolve variable values in
+     * @param scope The parameters in scope (used to resolve variable values in
      * the array or index).
      * @return ParamItem The value of the array element.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override;
+    virtual ParamItem getValue(const ParamScope& scope) const override;
 
     virtual std::string nodeName() const override
     {
         return "ArrayNode";
     }
+
+    virtual std::string sourceText() const override;
+
+    virtual std::string profileLabel() const override
+    {
+        return "${" + sourceText() + "}";
+    }
+
+    virtual bool assignValue(const ParamScope& scope,
+                             ParamValue& target) const override;
+
+    /**
+     * @brief Returns the element, or a null value if the array or object has
+     * no such element.
+     */
+    virtual const Json::Value* findJson(
+        const ParamScope& scope) const override;
+
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
 };
 
 /**
@@ -756,8 +1628,13 @@ class SubSqlNode : public ASTNode
     SubSqlNode(const std::string& name,
                const std::function<std::string(const std::string&,
                                                const ParamList&)>& subSqlGetter,
-               const std::unordered_map<std::string, ASTNodePtr>& params = {})
-        : ASTNode(), name_(name), subSqlGetter_(subSqlGetter), params_(params)
+               const std::unordered_map<std::string, ASTNodePtr>& params = {},
+               const SubSqlRenderer& subSqlRenderer = {})
+        : ASTNode(),
+          name_(name),
+          subSqlGetter_(subSqlGetter),
+          subSqlRenderer_(subSqlRenderer),
+          params_(params)
     {
     }
 
@@ -770,28 +1647,123 @@ class SubSqlNode : public ASTNode
      * This method retrieves the sub-SQL query as a string using the provided
      * sub-SQL getter function and parameters.
      *
-     * @param params A list of parameters (used to resolve variable values in
+     * @param scope The parameters in scope (used to resolve variable values in
      * the sub-SQL query).
      * @return ParamItem The sub-SQL query as a string.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override;
+    virtual ParamItem getValue(const ParamScope& scope) const override;
+
+    virtual void printInner(std::vector<int> indentFlags) const override;
+
+    virtual std::string nodeName() const override
+    {
+        return "SubSqlNode";
+    }
+
+    /**
+     * @brief Renders the sub-SQL query into the string held by `target`.
+     */
+    virtual bool assignValue(const ParamScope& scope,
+                             ParamValue& target) const override;
+
+    /**
+     * @brief Returns whether an argument uses any of `names`. The sub-SQL
+     * statement itself only sees its arguments.
+     */
+    virtual bool usesName(const NamePredicate& predicate) const override;
+
+  protected:
+    /**
+     * @brief Renders the sub-SQL query directly into `sql` if a renderer was
+     * set, otherwise appends the result of the getter.
+     */
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
+    virtual void analyzeInner(AstStats& stats,
+                              size_t loopDepth) const override;
+
+  private:
+    std::string name_;  ///< The name of the sub-SQL query.
+    std::function<std::string(const std::string&, const ParamList&)>
+        subSqlGetter_;  ///< This function takes the name of the sub-SQL query
+                        ///< and a list of parameters, and returns the sub-SQL
+                        ///< query as a string.
+    SubSqlRenderer subSqlRenderer_;  ///< Renders the sub-SQL query in place,
+                                     ///< preferred over subSqlGetter_.
+    std::unordered_map<std::string, ASTNodePtr>
+        params_;  ///< Map of parameter names and their corresponding ASTNodePtr
+                  ///< values.
+
+    /**
+     * @brief Binds the arguments of the call in `arguments`.
+     */
+    void bindArguments(const ParamScope& scope, ParamScope& arguments) const;
+};
+
+/**
+ * @class EscapeNode
+ *
+ * @brief Prints the string value of an expression escaped, such as
+ * `${name, escape='literal'}`.
+ *
+ * Values other than strings are printed as they are. The string is read from
+ * the parameter itself where possible and escaped straight into the output.
+ *
+ * @see appendEscaped
+ * @date 2026-10-17
+ * @since 0.6.18
+ */
+class EscapeNode : public ASTNode
+{
+  public:
+    EscapeNode(const ASTNodePtr& value, EscapeMode mode)
+        : ASTNode(), value_(value), mode_(mode)
+    {
+    }
+
+    virtual ~EscapeNode() = default;
+
+  public:
+    /**
+     * @brief Gets the escaped string, or the value of the expression if it is
+     * not a string.
+     */
+    virtual ParamItem getValue(const ParamScope& scope) const override;
 
     virtual void printInner(std::vector<int> indentFlags) const override;
 
     virtual std::string nodeName() const override
     {
-        return "SubSqlNode";
+        return "EscapeNode";
+    }
+
+    virtual std::string sourceText() const override
+    {
+        return value_->sourceText() + ", escape='" + escapeModeName(mode_) +
+               "'";
+    }
+
+    virtual std::string profileLabel() const override
+    {
+        return "${" + sourceText() + "}";
+    }
+
+    virtual bool usesName(const NamePredicate& predicate) const override
+    {
+        return value_->usesName(predicate);
     }
 
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
+    virtual void analyzeInner(AstStats& stats,
+                              size_t loopDepth) const override;
+
   private:
-    std::string name_;  ///< The name of the sub-SQL query.
-    std::function<std::string(const std::string&, const ParamList&)>
-        subSqlGetter_;  ///< This function takes the name of the sub-SQL query
-                        ///< and a list of parameters, and returns the sub-SQL
-                        ///< query as a string.
-    std::unordered_map<std::string, ASTNodePtr>
-        params_;  ///< Map of parameter names and their corresponding ASTNodePtr
-                  ///< values.
+    ASTNodePtr value_;  ///< The printed expression.
+    EscapeMode mode_;   ///< How strings are escaped.
 };
 
 /**
@@ -819,15 +1791,15 @@ class NotNode : public LogicalOpCode
      *
      * This method returns the boolean negation of the operand's value.
      *
-     * @param params A list of parameters (used to resolve variable values in
+     * @param scope The parameters in scope (used to resolve variable values in
      * the operand).
      * @return ParamItem 1 if the operand's value is false, 0 if true.
      *
      * @see toBool
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override
+    virtual ParamItem getValue(const ParamScope& scope) const override
     {
-        return toBool(left_->getValue(params)) ? 0 : 1;
+        return toBool(left_->getValue(scope)) ? 0 : 1;
     }
 
     virtual void printInner(std::vector<int> indentFlags) const override;
@@ -866,11 +1838,11 @@ class AndNode : public LogicalOpCode
      * An empty value, 0, or an empty string are considered false.
      * All other cases are considered true.
      *
-     * @param params A list of parameters (used to resolve variable values in
+     * @param scope The parameters in scope (used to resolve variable values in
      * the operands).
      * @return ParamItem 1 if both operands' values are true, 0 otherwise.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override;
+    virtual ParamItem getValue(const ParamScope& scope) const override;
 
     virtual std::string nodeName() const override
     {
@@ -906,11 +1878,11 @@ class OrNode : public LogicalOpCode
      * An empty value, 0, or an empty string are considered false.
      * All other cases are considered true.
      *
-     * @param params A list of parameters (used to resolve variable values in
+     * @param scope The parameters in scope (used to resolve variable values in
      * the operands).
      * @return ParamItem 1 if at least one operand's value is true, 0 otherwise.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override;
+    virtual ParamItem getValue(const ParamScope& scope) const override;
 
     virtual std::string nodeName() const override
     {
@@ -945,11 +1917,11 @@ class EQNode : public BinaryOpNode
      * This method returns the result of the equality comparison between the
      * operands' values.
      *
-     * @param params A list of parameters (used to resolve variable values in
+     * @param scope The parameters in scope (used to resolve variable values in
      * the operands).
      * @return ParamItem 1 if the operands are equal, 0 otherwise.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override;
+    virtual ParamItem getValue(const ParamScope& scope) const override;
 
     virtual std::string nodeName() const override
     {
@@ -984,11 +1956,11 @@ class NEQNode : public BinaryOpNode
      * This method returns the result of the not-equality comparison between the
      * operands' values.
      *
-     * @param params A list of parameters (used to resolve variable values in
+     * @param scope The parameters in scope (used to resolve variable values in
      * the operands).
      * @return ParamItem 1 if the operands are not equal, 0 otherwise.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override;
+    virtual ParamItem getValue(const ParamScope& scope) const override;
 
     virtual std::string nodeName() const override
     {
@@ -1027,12 +1999,12 @@ class IfStmtNode : public ASTNode
      * If the condition is false and an else-statement is provided, it returns
      * the value of the else-statement. Otherwise, it returns std::nullopt.
      *
-     * @param params A list of parameters (used to resolve variable values in
+     * @param scope The parameters in scope (used to resolve variable values in
      * the condition, if-statement, or else-statement).
      * @return ParamItem The value of the if-statement or else-statement based
      * on the condition.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override;
+    virtual ParamItem getValue(const ParamScope& scope) const override;
 
     virtual void printInner(std::vector<int> indentFlags) const override;
 
@@ -1056,7 +2028,27 @@ class IfStmtNode : public ASTNode
         return "IfStatementNode";
     }
 
+    virtual std::string profileLabel() const override
+    {
+        return "@if";
+    }
+
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
+    virtual void analyzeInner(AstStats& stats,
+                              size_t loopDepth) const override;
+
+    virtual void canonicalizeInner(WhitespaceState& state) override;
+
   private:
+    /**
+     * @brief Returns the branch selected by the conditions, or nullptr if no
+     * branch is taken. The branch itself is nullptr if it is empty.
+     */
+    const ASTNodePtr* selectBranch(const ParamScope& scope) const;
+
     ASTNodePtr condition_;  ///< The condition node of the if-statement.
     ASTNodePtr ifStmt_;     ///< The if-statement node.
     std::vector<std::pair<ASTNodePtr, ASTNodePtr>>
@@ -1065,6 +2057,310 @@ class IfStmtNode : public ASTNode
     ASTNodePtr elseStmt_;  ///< The else-statement node (optional).
 };
 
+/**
+ * @class SwitchStmtNode
+ * @brief Represents a `@switch` statement node in the AST.
+ *
+ * The labels of the `@case` branches are constants, which are put into hash
+ * tables when the template is compiled. A render evaluates the subject once
+ * and looks up its branch, however many branches there are, instead of
+ * evaluating the `==` of every `@elif` in turn. The subject matches a label
+ * if `subject == label` holds, so 1, 1.0 and true all select `@case(1)`.
+ *
+ * @date 2026-10-17
+ * @since 0.6.20
+ */
+class SwitchStmtNode : public ASTNode
+{
+  public:
+    SwitchStmtNode(const ASTNodePtr& subject) : ASTNode(), subject_(subject)
+    {
+    }
+
+    virtual ~SwitchStmtNode() = default;
+
+  public:
+    /**
+     * @brief Returns the output of the selected branch, or std::nullopt if
+     * no branch is selected.
+     */
+    virtual ParamItem getValue(const ParamScope& scope) const override;
+
+    virtual void printInner(std::vector<int> indentFlags) const override;
+
+    /**
+     * @brief Adds a `@case` branch selected by any of `labels`, which are
+     * NumberNode or StringNode constants.
+     * @throw std::runtime_error if a label is not a constant or is already
+     * used by another branch.
+     */
+    void addCase(const std::vector<ASTNodePtr>& labels,
+                 const ASTNodePtr& branch);
+
+    /**
+     * @brief Sets the `@default` branch, nullptr if it is empty.
+     */
+    void setDefault(const ASTNodePtr& branch)
+    {
+        hasDefault_ = true;
+        default_ = branch;
+    }
+
+    virtual std::string nodeName() const override
+    {
+        return "SwitchStatementNode";
+    }
+
+    virtual std::string profileLabel() const override
+    {
+        return "@switch(" + subject_->sourceText() + ")";
+    }
+
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
+    virtual void analyzeInner(AstStats& stats,
+                              size_t loopDepth) const override;
+
+    virtual void canonicalizeInner(WhitespaceState& state) override;
+
+  public:
+    /**
+     * @brief Returns the branch selected by the subject, or nullptr if no
+     * branch is taken. The branch itself is nullptr if it is empty.
+     */
+    const ASTNodePtr* selectBranch(const ParamScope& scope) const;
+
+    const ASTNodePtr& subject() const
+    {
+        return subject_;
+    }
+
+  private:
+    ASTNodePtr subject_;  ///< The value the labels are compared to.
+    std::vector<std::pair<std::vector<ASTNodePtr>, ASTNodePtr>>
+        cases_;  ///< The labels and the branch of every `@case`.
+    std::unordered_map<int64_t, size_t>
+        integerCases_;  ///< Index into cases_ of every integer label.
+    std::unordered_map<std::string, size_t>
+        stringCases_;      ///< Index into cases_ of every string label.
+    ASTNodePtr default_;   ///< The `@default` branch.
+    bool hasDefault_{false};  ///< Whether there is a `@default` branch.
+};
+
+/**
+ * @class LetNode
+ * @brief Represents a `@let(name = value)` binding in the AST.
+ *
+ * The value is evaluated once per render and bound in a child frame, in
+ * which the rest of the enclosing block is rendered. References to the name
+ * then find the value among the bindings of the frame, instead of walking a
+ * member chain again or rendering a sub-SQL statement again. If the value is
+ * not defined, neither is the name.
+ *
+ * @date 2026-10-17
+ * @since 0.6.21
+ */
+class LetNode : public ASTNode
+{
+  public:
+    LetNode(const std::string& name,
+            const ASTNodePtr& value,
+            const ASTNodePtr& body)
+        : ASTNode(), name_(name), value_(value), body_(body)
+    {
+    }
+
+    virtual ~LetNode() = default;
+
+  public:
+    /**
+     * @brief Returns the output of the rest of the block.
+     */
+    virtual ParamItem getValue(const ParamScope& scope) const override;
+
+    virtual void printInner(std::vector<int> indentFlags) const override;
+
+    virtual std::string nodeName() const override
+    {
+        return "LetNode";
+    }
+
+    virtual std::string profileLabel() const override
+    {
+        return "@let(" + name_ + ")";
+    }
+
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
+    virtual void analyzeInner(AstStats& stats,
+                              size_t loopDepth) const override;
+
+    virtual void canonicalizeInner(WhitespaceState& state) override;
+
+  private:
+    std::string name_;  ///< The bound name.
+    ASTNodePtr value_;  ///< The expression or sub-SQL call bound to the name.
+    ASTNodePtr body_;   ///< The rest of the enclosing block, which may be
+                        ///< nullptr.
+};
+
+/**
+ * @class TrimBlockNode
+ * @brief Represents a `@where ... @endwhere` or `@set ... @endset` block in
+ * the AST.
+ *
+ * The keyword is appended first and the block is rendered right after it.
+ * Then only the two ends of the rendered block are examined: whitespace is
+ * trimmed from both, a leading `AND` or `OR` from a WHERE block, and commas
+ * from either end of a SET block. If nothing is left, the keyword is removed
+ * again, so the output is written in a single pass and moved at most once.
+ *
+ * @date 2026-10-17
+ * @since 0.6.22
+ */
+class TrimBlockNode : public ASTNode
+{
+  public:
+    enum class Kind
+    {
+        Where,  ///< `@where`, printed as `WHERE `.
+        Set,    ///< `@set`, printed as `SET `.
+    };
+
+    TrimBlockNode(Kind kind, const ASTNodePtr& body)
+        : ASTNode(), kind_(kind), body_(body)
+    {
+    }
+
+    virtual ~TrimBlockNode() = default;
+
+  public:
+    /**
+     * @brief Returns the trimmed block with its keyword, or an empty string
+     * if the block is empty.
+     */
+    virtual ParamItem getValue(const ParamScope& scope) const override;
+
+    virtual void printInner(std::vector<int> indentFlags) const override;
+
+    virtual std::string nodeName() const override
+    {
+        return "TrimBlockNode";
+    }
+
+    virtual std::string profileLabel() const override
+    {
+        return kind_ == Kind::Where ? "@where" : "@set";
+    }
+
+    /**
+     * @brief Returns whether any node of the body uses a name for which
+     * `predicate` holds.
+     */
+    virtual bool usesName(const NamePredicate& predicate) const override;
+
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
+    virtual void analyzeInner(AstStats& stats,
+                              size_t loopDepth) const override;
+
+    virtual void canonicalizeInner(WhitespaceState& state) override;
+
+  private:
+    std::string_view keyword() const
+    {
+        return kind_ == Kind::Where ? "WHERE " : "SET ";
+    }
+
+    Kind kind_;         ///< Which keyword the block prints.
+    ASTNodePtr body_;   ///< The content of the block, which may be nullptr.
+};
+
+/**
+ * @class HoistedValueNode
+ * @brief Takes the place of a loop-invariant value in the body of a `@for`.
+ *
+ * The loop renders the original node once before the first iteration and
+ * binds the text to the slot name in the frame of the loop, from which every
+ * iteration copies it. Slot names start with `#`, so they cannot clash with
+ * the names of parameters.
+ *
+ * @date 2026-10-17
+ * @since 0.6.23
+ */
+class HoistedValueNode : public ASTNode
+{
+  public:
+    HoistedValueNode(const std::string& slot, const ASTNodePtr& original)
+        : ASTNode(),
+          slot_(slot),
+          fingerprintSlot_(fingerprintSlot(slot)),
+          original_(original)
+    {
+    }
+
+    virtual ~HoistedValueNode() = default;
+
+  public:
+    /**
+     * @brief Returns the name the fingerprint of the text bound to `slot` is
+     * bound to while renders are fingerprinted.
+     * @date 2026-10-17
+     * @since 0.6.26
+     */
+    static std::string fingerprintSlot(const std::string& slot)
+    {
+        return slot + "#";
+    }
+
+    /**
+     * @brief Returns the text rendered before the loop.
+     */
+    virtual ParamItem getValue(const ParamScope& scope) const override;
+
+    virtual void printInner(std::vector<int> indentFlags) const override;
+
+    virtual std::string nodeName() const override
+    {
+        return "HoistedValueNode";
+    }
+
+    virtual std::string sourceText() const override
+    {
+        return original_->sourceText();
+    }
+
+    virtual std::string profileLabel() const override
+    {
+        return original_->profileLabel();
+    }
+
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
+    /**
+     * @brief Canonicalizes the hoisted node where it is printed, such as the
+     * text of a hoisted `@where` block.
+     */
+    virtual void canonicalizeInner(WhitespaceState& state) override
+    {
+        original_->canonicalizeWhitespace(state);
+    }
+
+  private:
+    std::string slot_;             ///< The name the text is bound to.
+    std::string fingerprintSlot_;  ///< The name its fingerprint is bound to.
+    ASTNodePtr original_;          ///< The hoisted node, kept for printing
+                                   ///< and for canonicalizing.
+};
+
 /**
  * @class ForLoopNode
  * @brief Represents a for loop node in the abstract syntax tree (AST) of an SQL
@@ -1074,7 +2370,8 @@ class IfStmtNode : public ASTNode
  * within SQL statements.
  * It iterates over a collection of values, optionally using an index, and
  * applies a loop body for each iteration.
- * The class supports collections represented as JSON arrays or objects.
+ * The class supports collections represented as JSON arrays or objects, and
+ * IntArray or Int64Array parameters.
  *
  * @date 2025-02-12
  * @since 0.6.0
@@ -1094,6 +2391,23 @@ class ForLoopNode : public ASTNode
           separator_(separator),
           loopBody_(block)
     {
+        hoistInvariants();
+        AstStats body;
+        if (loopBody_)
+        {
+            loopBody_->analyze(body, 1);
+        }
+        if (separator_)
+        {
+            auto separator = separator_->getValue();
+            if (separator && std::holds_alternative<std::string>(*separator))
+            {
+                separatorText_ = std::get<std::string>(*separator);
+            }
+        }
+        body.perIterationBytes += separatorText_.size();
+        iterationSize_ = SizeEstimator(body.perIterationBytes);
+        detectJoin();
     }
 
     virtual ~ForLoopNode() = default;
@@ -1106,10 +2420,10 @@ class ForLoopNode : public ASTNode
      * optionally using an index, and generating SQL for each iteration. The
      * generated SQL is concatenated with the separator string.
      *
-     * @param params A list of parameters to be used in evaluating the loop.
+     * @param scope The parameters in scope.
      * @return A ParamItem containing the generated SQL string for the loop.
      */
-    virtual ParamItem getValue(const ParamList& params = {}) const override;
+    virtual ParamItem getValue(const ParamScope& scope) const override;
 
     virtual void printInner(std::vector<int> indentFlags) const override;
 
@@ -1118,6 +2432,20 @@ class ForLoopNode : public ASTNode
         return "ForLoopNode";
     }
 
+    virtual std::string profileLabel() const override
+    {
+        return "@for(" + valueName_ + " in " + collection_->sourceText() + ")";
+    }
+
+  protected:
+    virtual void appendSql(const ParamScope& scope,
+                           std::string& sql) const override;
+
+    virtual void analyzeInner(AstStats& stats,
+                              size_t loopDepth) const override;
+
+    virtual void canonicalizeInner(WhitespaceState& state) override;
+
   private:
     std::string valueName_;  ///< The name of the value variable in the loop.
     std::string indexName_;  ///< The name of the index or key variable in the
@@ -1127,6 +2455,44 @@ class ForLoopNode : public ASTNode
                              ///< statements.
     ASTNodePtr loopBody_;    ///< The block of SQL statements to execute in each
                              ///< iteration.;
+    mutable SizeEstimator
+        iterationSize_;  ///< Bytes of one iteration including the separator,
+                         ///< used to reserve the output of the loop.
+    std::string separatorText_;  ///< The separator, empty if there is none.
+    bool join_{false};           ///< Whether the body only prints the value,
+                                 ///< such as ` ${id} `.
+    std::string joinPrefix_;     ///< Text before the value in a join body.
+    std::string joinSuffix_;     ///< Text after the value in a join body.
+    std::vector<std::pair<std::string, ASTNodePtr>>
+        hoisted_;  ///< The slot name and the node of every value of the body
+                   ///< which does not depend on the loop variables.
+
+    /**
+     * @brief Replaces the values printed directly in the loop body which do
+     * not use the loop variables, such as outer parameters or sub-SQL calls
+     * with outer arguments, by HoistedValueNode slots. Values inside nested
+     * statements are only evaluated if their branch is taken, so they stay.
+     */
+    void hoistInvariants();
+
+    /**
+     * @brief Sets join_ if the loop body is the value variable, optionally
+     * between two normal texts.
+     */
+    void detectJoin();
+
+    /**
+     * @brief The join kernel: prints every element of the collection between
+     * joinPrefix_ and joinSuffix_, without binding the loop variables or
+     * visiting the loop body. Runs of integers are formatted in batches by
+     * appendDecimals, as typed arrays are.
+     */
+    void appendJoined(const Json::Value& collection, std::string& sql) const;
+
+    JoinFormat joinFormat() const
+    {
+        return {joinPrefix_, joinSuffix_, separatorText_};
+    }
 };
 
 /**
@@ -1165,6 +2531,14 @@ class Parser
      */
     void printAST();
 
+    /**
+     * @brief Builds the Abstract Syntax Tree (AST) of the SQL statement. The
+     * AST is only built once, later calls return immediately.
+     * @date 2026-10-17
+     * @since 0.6.5
+     */
+    void compile();
+
     /**
      * @brief Resets the Parser to the beginning of the SQL statement.
      * @date 2025-02-05
@@ -1178,24 +2552,122 @@ class Parser
     }
 
     /**
-     * @brief Sets the parameters for the SQL statement.
-     * @param params A map of parameter names and their values.
+     * @brief Sets the parameters for the SQL statement.
+     * @param params A map of parameter names and their values.
+     */
+    void setParams(const ParamList& params)
+    {
+        this->params_ = params;
+    }
+
+    /**
+     * @brief Sets the function to retrieve sub-SQL statements.
+     * @param subSqlGetter A function that takes the name of a sub-SQL statement
+     * and a map of parameters, and returns the sub-SQL statement.
+     */
+    void setSubSqlGetter(
+        const std::function<std::string(const std::string&, const ParamList&)>&
+            subSqlGetter)
+    {
+        this->subSqlGetter_ = subSqlGetter;
+    }
+
+    /**
+     * @brief Sets the function which renders sub-SQL statements in place. It
+     * takes precedence over the getter and saves building a parameter list
+     * and a string for every sub-SQL call.
+     * @date 2026-10-17
+     * @since 0.6.13
+     */
+    void setSubSqlRenderer(const SubSqlRenderer& subSqlRenderer)
+    {
+        this->subSqlRenderer_ = subSqlRenderer;
+    }
+
+    /**
+     * @brief Sets the memory resource from which compile() allocates the
+     * nodes of the AST, or nullptr for the global heap. The resource must
+     * outlive the AST. Strings and functions held by the nodes still use the
+     * global heap.
+     * @date 2026-10-17
+     * @since 0.6.14
+     */
+    void setMemoryResource(std::pmr::memory_resource* resource)
+    {
+        memoryResource_ = resource;
+    }
+
+    /**
+     * @brief Sets how `${}` sites without an `escape` argument escape the
+     * strings they print. Must be called before compile().
+     * @date 2026-10-17
+     * @since 0.6.18
+     */
+    void setEscapeMode(EscapeMode mode)
+    {
+        escapeMode_ = mode;
+    }
+
+    /**
+     * @brief Sets whether compile() collapses every run of whitespace in the
+     * normal text into one space, outside of quotes and comments, and drops
+     * the whitespace at the start and end of the statement and the
+     * whitespace which would follow other whitespace on every render.
+     * Must be called before compile().
+     *
+     * @param enabled Whether the whitespace is collapsed.
+     * @param trimEnds Whether the whitespace at the start and end of the
+     * statement is dropped, rather than collapsed. A sub-SQL statement
+     * printed in the middle of another one keeps a space at either end.
+     * @date 2026-10-17
+     * @since 0.6.19
+     */
+    void setCanonicalWhitespace(bool enabled, bool trimEnds = true)
+    {
+        canonicalWhitespace_ = enabled;
+        trimWhitespace_ = trimEnds;
+    }
+
+    /**
+     * @brief Returns a copy of the parser compiled with some parameters
+     * bound to constant values.
+     *
+     * Every `${}` and sub-SQL call whose names are all bound is rendered
+     * into normal text, `@if`, `@elif` and `@switch` with a bound condition
+     * keep only the taken branch, `@for` over a bound collection is unrolled
+     * into one copy of the body per element, and `@let` with a bound value
+     * is dropped. What depends on other parameters is kept, so the copy
+     * still has to be rendered with the bound parameters in scope.
+     *
+     * Names which only have a default value count as unbound. With
+     * canonical whitespace, folded values are kept as string constants
+     * rather than text, as the generic statement does not collapse their
+     * whitespace either. The specialized statement may still collapse some
+     * whitespace the generic one keeps, such as in loop separators or
+     * around a branch, as it knows which text follows which.
+     *
+     * @see SqlGenerator::specialize
+     * @date 2026-10-17
+     * @since 0.6.24
+     */
+    Parser specialize(const ParamList& bound) const;
+
+    /**
+     * @brief Returns an uncompiled parser of `sql` with the settings of this
+     * one, such as its escaping and its sub-SQL renderer.
+     * @date 2026-10-17
+     * @since 0.6.27
      */
-    void setParams(const ParamList& params)
-    {
-        this->params_ = params;
-    }
+    Parser withSource(const std::string& sql) const;
 
     /**
-     * @brief Sets the function to retrieve sub-SQL statements.
-     * @param subSqlGetter A function that takes the name of a sub-SQL statement
-     * and a map of parameters, and returns the sub-SQL statement.
+     * @brief Returns the SQL statement of the parser.
+     * @date 2026-10-17
+     * @since 0.6.27
      */
-    void setSubSqlGetter(
-        const std::function<std::string(const std::string&, const ParamList&)>&
-            subSqlGetter)
+    const std::string& source() const
     {
-        this->subSqlGetter_ = subSqlGetter;
+        return lexer_.source();
     }
 
     // clang-format off
@@ -1207,8 +2679,14 @@ class Parser
      *
      * The rules are as follows:
      * @code{.ebnf}
-     * sql ::= [NormalText] {(sub_sql|print_expr|if_stmt|for_loop) [NormalText]}
-     * print_expr ::= "$" "{" expr "}"
+     * sql ::= [NormalText]
+     *         {(sub_sql|print_expr|if_stmt|switch_stmt|for_loop|trim_block)
+     *          [NormalText]}
+     *         [let_stmt]
+     * trim_block ::= "@" "where" sql "@" "endwhere"
+     *              | "@" "set" sql "@" "endset"
+     * let_stmt ::= "@" "let" "(" Identifier "=" param_value ")" sql
+     * print_expr ::= "$" "{" expr ["," "escape" "=" String] "}"
      * expr ::= 'null' | Integer | String | Identifier {param_suffix}
      * param_suffix ::= "[" expr "]" | "." Identifier
      * sub_sql ::= "@" Identifier "(" [param_list] ")"
@@ -1219,6 +2697,11 @@ class Parser
      *            {"@" "elif" "(" bool_expr ")" sql}
      *            ["@" "else" sql]
      *             "@" "endif"
+     * switch_stmt ::= "@" "switch" "(" expr ")" [Whitespace]
+     *                {"@" "case" "(" case_label {"," case_label} ")" sql}
+     *                ["@" "default" sql]
+     *                 "@" "endswitch"
+     * case_label ::= Integer | String
      * bool_expr ::= term {("or"|"||") term}
      * term ::= factor {("and"|"&&") factor}
      * factor ::= ["!"|"not"] ("(" bool_expr ")" | comp_expr)
@@ -1243,6 +2726,67 @@ class Parser
     // clang-format on
     std::string parse();
 
+    /**
+     * @brief Generates the SQL statement from the compiled AST with the given
+     * parameters.
+     *
+     * Unlike parse(), this method does not modify the parser, so a compiled
+     * parser can be shared by several threads.
+     *
+     * @param params A map of parameter names and their values.
+     * @return The final SQL statement.
+     * @note compile() must have been called before.
+     * @date 2026-10-17
+     * @since 0.6.6
+     */
+    std::string generateSql(const ParamList& params) const;
+
+    /**
+     * @brief Appends the SQL statement to `sql`, looking up parameters in a
+     * scope. The estimated capacity is only reserved when `sql` is empty.
+     * @date 2026-10-17
+     * @since 0.6.13
+     */
+    void generateSql(const ParamScope& scope, std::string& sql) const;
+
+    /**
+     * @brief Sets the capacity reserved for the output of generateSql(). It
+     * is only the initial value: afterwards the capacity follows a high
+     * quantile of the recent output sizes.
+     * @see SizeEstimator
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    void setReserveBytes(size_t bytes)
+    {
+        outputSize_ = SizeEstimator(bytes);
+    }
+
+    /**
+     * @brief Returns the statistics of the compiled AST.
+     * @note compile() must have been called before.
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    AstStats analyze() const;
+
+    /**
+     * @brief Returns the number of tokens of the SQL statement.
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    size_t tokenCount() const;
+
+    /**
+     * @brief Returns the time the last compile() took to build the AST.
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    uint64_t compileNanos() const
+    {
+        return compileNanos_;
+    }
+
   private:
     ASTNodePtr sql();
 
@@ -1262,6 +2806,12 @@ class Parser
 
     ASTNodePtr ifStmt();
 
+    ASTNodePtr switchStmt();
+
+    ASTNodePtr letStmt();
+
+    ASTNodePtr trimBlock();
+
     ASTNodePtr boolExpr();
 
     ASTNodePtr term();
@@ -1272,6 +2822,54 @@ class Parser
 
     ASTNodePtr forLoop();
 
+    /**
+     * @brief Parses the body of a `@for` over a bound collection once per
+     * element, with the loop variables bound, and returns the joined copies.
+     * @return std::nullopt if the collection is neither an array nor an
+     * object, the lexer is then unchanged.
+     */
+    std::optional<ASTNodePtr> unrollLoop(const std::string& valueName,
+                                         const std::string& indexName,
+                                         const ASTNodePtr& collection,
+                                         const std::string& separator);
+
+    /**
+     * @brief Appends a node, or a chain of nodes, to the chain from `head`
+     * to `tail`, joining adjacent normal texts.
+     */
+    void appendNode(ASTNodePtr& head, ASTNode*& tail, ASTNodePtr node) const;
+
+    /**
+     * @brief Returns whether the value of a name is known while specializing,
+     * that is whether it is bound and not shadowed by an unbound loop
+     * variable or `@let`.
+     */
+    bool isKnown(const std::string& name) const;
+
+    /**
+     * @brief Returns whether the node only depends on known names while
+     * specializing.
+     */
+    bool isConstant(const ASTNodePtr& node) const;
+
+    /**
+     * @brief Calls `f` with a scope of the bound parameters and the known
+     * local names.
+     */
+    template <typename F>
+    auto withFoldScope(F&& f) const;
+
+    /**
+     * @brief Renders a constant node into a node which prints the same text.
+     */
+    ASTNodePtr fold(const ASTNodePtr& node) const;
+
+    /**
+     * @brief Returns a node which prints `text`: normal text, or a string
+     * constant if the whitespace is canonicalized, so that it stays as it is.
+     */
+    ASTNodePtr constantText(const std::string& text) const;
+
     std::string match(TokenType);
 
     /**
@@ -1288,14 +2886,192 @@ class Parser
      */
     ParamItem getParamByName(const std::string& paramName) const;
 
+    /**
+     * @brief Creates an AST node in the memory resource of the parser.
+     */
+    template <typename Node, typename... Args>
+    std::shared_ptr<Node> makeNode(Args&&... args) const
+    {
+        if (memoryResource_)
+        {
+            return std::allocate_shared<Node>(
+                std::pmr::polymorphic_allocator<Node>(memoryResource_),
+                std::forward<Args>(args)...);
+        }
+        return std::make_shared<Node>(std::forward<Args>(args)...);
+    }
+
   private:
     ParamList params_;  ///< Map of parameter names and their values.
     std::function<std::string(const std::string&,
                               const ParamList&)>
         subSqlGetter_;         ///< Function to retrieve sub-SQL statements.
+    SubSqlRenderer subSqlRenderer_;  ///< Renders sub-SQL statements in place.
+    std::pmr::memory_resource* memoryResource_{
+        nullptr};  ///< Storage of the AST nodes, nullptr for the global heap.
+    EscapeMode escapeMode_{
+        EscapeMode::None};  ///< Escaping of `${}` sites without an argument.
+    bool canonicalWhitespace_{false};  ///< Whether whitespace is collapsed.
+    bool trimWhitespace_{true};  ///< Whether whitespace at the ends is dropped.
+    bool specializing_{false};   ///< Whether boundParams_ are folded.
+    ParamList boundParams_;      ///< The parameters bound by specialize().
+    std::vector<std::pair<std::string, ParamItem>>
+        locals_;  ///< Names bound by the enclosing `@for` and `@let` while
+                  ///< specializing, std::nullopt if the value is unknown.
     Lexer lexer_;              ///< Lexer used to tokenize the SQL statement.
     std::deque<Token> ahead_;  ///< The next token to be processed.
     ASTNodePtr root_;          ///< The root node of the AST.
+    mutable SizeEstimator
+        outputSize_;  ///< Capacity reserved for the output.
+    uint64_t compileNanos_{0};  ///< Duration of the last compile().
+};
+
+/**
+ * @enum PlaceholderStyle
+ * @brief How the placeholders of a statement are written.
+ * @date 2026-10-17
+ * @since 0.6.25
+ */
+enum class PlaceholderStyle
+{
+    Dollar,    ///< `$1`, `$2`, ..., as used by PostgreSQL.
+    Question,  ///< `?`, as used by MySQL and SQLite.
+};
+
+/**
+ * @struct Statement
+ * @brief A SQL statement whose printed values are placeholders, with the
+ * values to bind to them in order.
+ * @see SqlGenerator::getStatement
+ * @date 2026-10-17
+ * @since 0.6.25
+ */
+struct Statement
+{
+    std::string sql;               ///< The SQL with placeholders.
+    std::vector<ParamValue> args;  ///< The value of every placeholder; a
+                                   ///< missing value is a null Json::Value.
+    uint64_t fingerprint{StatementFingerprint::kNone};  ///< Fingerprint of
+                                                        ///< the render.
+};
+
+/**
+ * @struct StatementShape
+ * @brief One of the texts a statement can have, as returned by
+ * SqlGenerator::enumerateShapes.
+ * @date 2026-10-17
+ * @since 0.6.25
+ */
+struct StatementShape
+{
+    std::string sql;  ///< The SQL with placeholders.
+    std::vector<std::string>
+        params;  ///< What every placeholder is bound to, such as
+                 ///< `${author.name}`, or `%${title}%` for a literal.
+    uint64_t fingerprint{StatementFingerprint::kNone};  ///< Fingerprint of
+                                                        ///< the shape.
+};
+
+/**
+ * @struct ShapeSet
+ * @brief The shapes of a statement.
+ * @date 2026-10-17
+ * @since 0.6.25
+ */
+struct ShapeSet
+{
+    std::vector<StatementShape> shapes;  ///< Distinct shapes, first found
+                                         ///< first.
+    bool complete{true};  ///< false if the limit was reached, or if a `@for`
+                          ///< over a parameter makes the shapes depend on
+                          ///< the number of elements.
+};
+
+/**
+ * @struct RenderResult
+ * @brief A rendered SQL statement with the fingerprint of its literal
+ * skeleton.
+ * @see SqlGenerator::getSqlWithFingerprint
+ * @date 2026-10-17
+ * @since 0.6.26
+ */
+struct RenderResult
+{
+    std::string sql;  ///< The rendered SQL statement.
+    uint64_t fingerprint{StatementFingerprint::kNone};  ///< Equal for renders
+                                                        ///< which differ only
+                                                        ///< in their values.
+};
+
+class SqlGenerator;
+
+/**
+ * @class SpecializedSql
+ * @brief A SQL statement compiled with some of its parameters bound, as
+ * returned by SqlGenerator::specialize. It is rendered with the remaining
+ * parameters and may be used by several threads at the same time. Its
+ * renders are recorded like those of the statement itself, and it must not
+ * outlive its generator.
+ *
+ * @date 2026-10-17
+ * @since 0.6.24
+ */
+class SpecializedSql
+{
+  public:
+    SpecializedSql(SqlGenerator& generator,
+                   std::string name,
+                   Parser parser,
+                   ParamList bound,
+                   const ParamList* defaults)
+        : generator_(generator),
+          name_(std::move(name)),
+          parser_(std::move(parser)),
+          bound_(std::move(bound)),
+          defaults_(defaults)
+    {
+    }
+
+    /**
+     * @brief Renders the SQL statement. The bound parameters take precedence
+     * over `params`, and the default parameters of the statement apply to
+     * the names which are in neither.
+     */
+    std::string getSql(const ParamList& params = {}) const;
+
+    /**
+     * @brief Renders the SQL statement, appending it to `sql`.
+     */
+    void generateSql(const ParamList& params, std::string& sql) const;
+
+    /**
+     * @brief Prints the Abstract Syntax Tree (AST) of the specialized
+     * statement to the standard output.
+     */
+    void printAST()
+    {
+        parser_.printAST();
+    }
+
+    /**
+     * @brief Returns the statistics of the specialized AST.
+     */
+    AstStats analyze() const
+    {
+        return parser_.analyze();
+    }
+
+    const ParamList& boundParams() const
+    {
+        return bound_;
+    }
+
+  private:
+    SqlGenerator& generator_;  ///< Records the renders.
+    std::string name_;  ///< The name of the SQL statement.
+    Parser parser_;     ///< The parser compiled with the bound parameters.
+    ParamList bound_;   ///< The bound parameters.
+    const ParamList* defaults_;  ///< Default parameters of the statement.
 };
 
 /**
@@ -1318,6 +3094,7 @@ class SqlGenerator : public drogon::Plugin<SqlGenerator>
     /// It must be implemented by the user..
     void shutdown()
     {
+        renderQueue_.reset();
     }
 
     /**
@@ -1340,6 +3117,10 @@ class SqlGenerator : public drogon::Plugin<SqlGenerator>
 
     /**
      * @brief Retrieves a SQL statement by name, with optional parameters.
+     *
+     * All SQL statements are compiled in initAndStart(), so this method may be
+     * called from several threads (e.g. drogon IO loops) at the same time.
+     *
      * @param name The name of the SQL statement to retrieve.
      * @param params A map of parameter names and their values (default is an
      * empty map).
@@ -1347,34 +3128,381 @@ class SqlGenerator : public drogon::Plugin<SqlGenerator>
      */
     std::string getSql(const std::string& name, const ParamList& params = {});
 
+    /**
+     * @brief Renders a SQL statement like getSql and returns it with the
+     * fingerprint of its literal skeleton, to group statements which only
+     * differ in their values.
+     *
+     * The fingerprint is computed from the template text as it is printed,
+     * with every value printed by `${}` counted as a marker, so the rendered
+     * statement is not scanned again. Renders which take the same branches
+     * and loop iterations have the same fingerprint, also when a `@where` or
+     * `@set` trims the text differently. The text of a hoisted loop-invariant
+     * value counts by its own fingerprint.
+     *
+     * @throw std::out_of_range If the SQL statement does not exist.
+     * @see StatementFingerprint
+     * @date 2026-10-17
+     * @since 0.6.26
+     */
+    RenderResult getSqlWithFingerprint(const std::string& name,
+                                       const ParamList& params = {});
+
+    /**
+     * @brief Returns the SQL statement `name` compiled with the parameters
+     * of `bound` folded into it, such as the column list of a report which
+     * only changes with its configuration.
+     *
+     * Conditions, loops and sub-SQL calls which only depend on bound
+     * parameters are evaluated once here instead of on every render, so the
+     * result only does the work of the remaining parameters. Specializations
+     * are cached by the name and the bound values, at most
+     * `kMaxSpecializations` of them; further ones are compiled on every call.
+     *
+     * @throw std::out_of_range If the SQL statement does not exist.
+     * @see Parser::specialize
+     * @date 2026-10-17
+     * @since 0.6.24
+     */
+    std::shared_ptr<SpecializedSql> specialize(const std::string& name,
+                                               const ParamList& bound);
+
+    /// Number of specializations kept by specialize().
+    static constexpr size_t kMaxSpecializations = 1024;
+
+    /**
+     * @brief Renders a SQL statement with a placeholder for every value
+     * printed by `${}`, for a prepared statement such as
+     * `dbClient->execSqlAsync(statement.sql, ...)` with the arguments bound.
+     *
+     * A value printed inside a string literal makes the whole literal one
+     * placeholder, so `LIKE '%${title}%'` becomes `LIKE $1` with `%title%`
+     * as its argument. Values printed inside double quotes or comments
+     * cannot be bound and must not be printed this way; a `@switch` chooses
+     * among identifiers instead.
+     *
+     * @throw std::out_of_range If the SQL statement does not exist.
+     * @date 2026-10-17
+     * @since 0.6.25
+     */
+    Statement getStatement(const std::string& name,
+                           const ParamList& params = {},
+                           PlaceholderStyle style = PlaceholderStyle::Dollar);
+
+    /**
+     * @brief Returns the texts getStatement can return for a SQL statement,
+     * for example to prepare them all when the application starts.
+     *
+     * Every combination of the branches of `@if`, `@elif` and `@switch` is
+     * rendered, also combinations which the conditions rule out, and taking
+     * no branch of an `@if` without `@else`. A `@for` iterates over the
+     * default value of its collection if there is one; otherwise the shapes
+     * are rendered without iterations and are not complete.
+     *
+     * @param maxShapes The number of distinct shapes after which the
+     * enumeration stops.
+     * @throw std::out_of_range If the SQL statement does not exist.
+     * @date 2026-10-17
+     * @since 0.6.25
+     */
+    ShapeSet enumerateShapes(const std::string& name,
+                             size_t maxShapes = kMaxShapes,
+                             PlaceholderStyle style = PlaceholderStyle::Dollar);
+
+    /// Default limit of enumerateShapes().
+    static constexpr size_t kMaxShapes = 256;
+
+    /**
+     * @brief Renders an `INSERT ... VALUES (...)` statement with one row per
+     * parameter list, such as a batch of single-row inserts.
+     *
+     * The main SQL statement is split around its first `VALUES` row when the
+     * plugin starts. The text before the row and after it is rendered once
+     * with the first parameter list, and the row once for every parameter
+     * list, each with the default parameters of the statement. It is recorded
+     * as one render of the statement in the metrics, the profiler and the
+     * slow-render log.
+     *
+     * @return The statement, or an empty string if `rows` is empty.
+     * @throw std::out_of_range If the SQL statement does not exist.
+     * @throw std::runtime_error If the SQL statement has no `VALUES` row.
+     * @see InsertCoalescer
+     * @date 2026-10-17
+     * @since 0.6.27
+     */
+    std::string getInsertSql(const std::string& name,
+                             const std::vector<ParamList>& rows);
+
+    /**
+     * @brief Whether getInsertSql can render the SQL statement `name`.
+     * @date 2026-10-17
+     * @since 0.6.27
+     */
+    bool hasValuesRow(const std::string& name) const
+    {
+        return valuesRows_.find(name) != valuesRows_.end();
+    }
+
+    /**
+     * @brief Renders a SQL statement and appends it to a string allocated
+     * from a memory resource.
+     *
+     * The nodes print into a std::string, so the SQL statement is rendered
+     * into an output buffer kept by the calling thread and then copied to
+     * `sql`, and the only allocation of a render in steady state is made by
+     * `sql`. The buffer keeps at most `kMaxPooledOutputBytes` of capacity
+     * between renders, also when a render throws.
+     *
+     * @date 2026-10-17
+     * @since 0.6.14
+     */
+    void renderInto(const std::string& name,
+                    const ParamList& params,
+                    std::pmr::string& sql);
+
+    /**
+     * @brief Renders a SQL statement with pmr parameters and appends it to a
+     * string allocated from a memory resource.
+     *
+     * @date 2026-10-17
+     * @since 0.6.14
+     */
+    void renderInto(const std::string& name,
+                    const pmr::ParamList& params,
+                    std::pmr::string& sql);
+
+    /// Capacity of the output buffer of renderInto() kept by each thread.
+    static constexpr size_t kMaxPooledOutputBytes = 256 * 1024;
+
+    /**
+     * @brief Renders a SQL statement and passes it to a callback.
+     *
+     * Renders which are estimated to produce at least `min_bytes` run on a
+     * worker pool, so that they do not block the calling IO loop. The pool is
+     * configured with
+     * @code{.json}
+     * "async_render": {"threads": 2, "min_bytes": 65536}
+     * @endcode
+     * Without the configuration, or for smaller renders, the callback is
+     * called before this method returns.
+     *
+     * @param name The name of the SQL statement to retrieve.
+     * @param params A map of parameter names and their values.
+     * @param callback Called with the SQL statement, possibly on a worker
+     * thread.
+     * @param exceptionCallback Called instead of `callback` if the render
+     * throws.
+     * @see estimateBytes
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    void getSqlAsync(
+        const std::string& name,
+        ParamList params,
+        std::function<void(std::string)>&& callback,
+        std::function<void(const std::exception_ptr&)>&& exceptionCallback);
+
+    /**
+     * @brief Estimates the size of a render with the cost model of the SQL
+     * statement. Every element of an array or object parameter is counted as
+     * one loop iteration.
+     *
+     * @return The estimated size in bytes, 0 for an unknown SQL statement.
+     * @see CompileStats
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    size_t estimateBytes(const std::string& name,
+                         const ParamList& params) const;
+
+    /**
+     * @brief Returns the compile statistics of every SQL statement, the most
+     * expensive first. SQL statements are ranked by their estimated size with
+     * CompileStats::kReferenceIterations loop iterations.
+     *
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    std::vector<CompileStats> compileStats() const;
+
+    /**
+     * @brief Returns the allocation statistics of the last getSql call made by
+     * the calling thread.
+     *
+     * @return Empty statistics unless compiled with `TL_SQL_INSTRUMENTATION`.
+     * @see AllocationStats
+     * @date 2026-10-17
+     * @since 0.6.7
+     */
+    static const RenderStats& lastRenderStats();
+
+    /**
+     * @brief Returns all allocations made by the calling thread so far.
+     *
+     * @return Zeros unless compiled with `TL_SQL_INSTRUMENTATION`.
+     * @date 2026-10-17
+     * @since 0.6.7
+     */
+    static AllocationStats threadAllocationStats();
+
+    /**
+     * @brief Starts recording render metrics of every SQL statement.
+     *
+     * The metrics can also be enabled in the configuration:
+     * @code{.json}
+     * "metrics": {"enabled": true, "path": "/sql_metrics"}
+     * @endcode
+     * If `path` is given, a drogon handler serves the metrics in the
+     * Prometheus text format at that path. With `"fingerprints": true`,
+     * every render is fingerprinted as by getSqlWithFingerprint and counted
+     * per fingerprint as well.
+     *
+     * @param fingerprints Whether to count renders per fingerprint.
+     * @note Must be called before getSql is used by other threads.
+     * @date 2026-10-17
+     * @since 0.6.8
+     */
+    void enableMetrics(bool fingerprints = false);
+
+    /**
+     * @brief Returns the render metrics, or nullptr if they are not enabled.
+     * @date 2026-10-17
+     * @since 0.6.8
+     */
+    const RenderMetrics* metrics() const
+    {
+        return metrics_.get();
+    }
+
+    /**
+     * @brief Starts recording renders which take at least `threshold`, with
+     * the shape of their parameters and the iterations of their loops.
+     *
+     * The log can also be enabled in the configuration:
+     * @code{.json}
+     * "slow_render_log": {"threshold_us": 1000, "capacity": 128}
+     * @endcode
+     *
+     * @param threshold The minimum render time to record.
+     * @param capacity The number of slow renders kept.
+     * @note Must be called before getSql is used by other threads.
+     * @see SlowRenderLog
+     * @date 2026-10-17
+     * @since 0.6.10
+     */
+    void enableSlowRenderLog(std::chrono::nanoseconds threshold,
+                             size_t capacity = 128);
+
+    /**
+     * @brief Returns the slow-render log, or nullptr if it is not enabled.
+     * @date 2026-10-17
+     * @since 0.6.10
+     */
+    const SlowRenderLog* slowRenderLog() const
+    {
+        return slowRenderLog_.get();
+    }
+
+    /**
+     * @brief Starts or stops profiling the renders of a SQL statement.
+     *
+     * May be called at any time, also while other threads call getSql. The
+     * templates to profile from the start can be set in the configuration:
+     * @code{.json}
+     * "profiler": {"templates": ["get_menu_with_submenu"],
+     *              "max_trace_events": 100000}
+     * @endcode
+     *
+     * @throw std::out_of_range If the SQL statement does not exist.
+     * @see RenderProfiler
+     * @date 2026-10-17
+     * @since 0.6.9
+     */
+    void setProfiling(const std::string& name, bool enabled = true);
+
+    /**
+     * @brief Returns the profiler which records the profiled renders.
+     * @date 2026-10-17
+     * @since 0.6.9
+     */
+    RenderProfiler& profiler()
+    {
+        return *profiler_;
+    }
+
   private:
+    // SpecializedSql records its renders with instrumentRender()
+    friend class SpecializedSql;
+
     /**
-     * @brief Retrieves the main SQL statement by name.
+     * @brief Renders the main SQL statement by name, appending it to `sql`.
      * @param name The name of the main SQL statement.
-     * @param params A map of parameter names and their values.
-     * @return The main SQL statement with parameters substituted.
+     * @param scope The parameters of the render.
+     * @param sql The output buffer.
      */
-    std::string getMainSql(const std::string& name, ParamList params);
+    void getMainSql(const std::string& name,
+                    ParamScope& scope,
+                    std::string& sql);
 
     /**
-     * @brief Retrieves a sub-SQL statement by name.
+     * @brief Renders a sub-SQL statement by name, appending it to `sql`.
      * @param name The name of the SQL statement containing the sub-SQL
      * statement.
      * @param subSqlName The name of the sub-SQL statement.
-     * @param params A map of parameter names and their values.
-     * @return The sub-SQL statement with parameters substituted.
+     * @param scope The parameters of the call. The default parameters of the
+     * sub-SQL statement are added to it.
+     * @param sql The output buffer.
      */
-    std::string getSubSql(const std::string& name,
-                          const std::string& subSqlName,
-                          ParamList params);
+    void getSubSql(const std::string& name,
+                   const std::string& subSqlName,
+                   ParamScope& scope,
+                   std::string& sql);
 
     /**
-     * @brief Retrieves a simple SQL statement by name.
+     * @brief Renders a simple SQL statement by name, appending it to `sql`.
      * @param name The name of the simple SQL statement.
-     * @param params A map of parameter names and their values.
-     * @return The simple SQL statement with parameters substituted.
+     * @param scope The parameters of the render.
+     * @param sql The output buffer.
+     */
+    void getSimpleSql(const std::string& name,
+                      ParamScope& scope,
+                      std::string& sql);
+
+    /**
+     * @brief Renders a SQL statement into `sql` and records the render in the
+     * metrics, the profiler and the slow-render log.
+     * @tparam Params ParamList or pmr::ParamList.
+     * @param fingerprint Set to the fingerprint of the render if not nullptr.
+     */
+    template <typename Params>
+    void render(const std::string& name,
+                const Params& params,
+                std::string& sql,
+                uint64_t* fingerprint = nullptr);
+
+    /**
+     * @brief Runs `body`, which renders the SQL statement `name` into `sql`,
+     * and records the render in the metrics, the profiler, the slow-render
+     * log and the fingerprint. Also used by getInsertSql() and
+     * SpecializedSql, whose renders are recorded under their statement.
+     * @param params Described by the slow-render log.
+     * @param fingerprint Set to the fingerprint of the render if not nullptr.
      */
-    std::string getSimpleSql(const std::string& name, const ParamList& params);
+    template <typename Params, typename Body>
+    void instrumentRender(const std::string& name,
+                          const Params& params,
+                          std::string& sql,
+                          uint64_t* fingerprint,
+                          Body&& body);
+
+    /**
+     * @brief Implements both overloads of renderInto().
+     * @tparam Params ParamList or pmr::ParamList.
+     */
+    template <typename Params>
+    void renderIntoImpl(const std::string& name,
+                        const Params& params,
+                        std::pmr::string& sql);
 
     /**
      * @brief Prepares the parser before printing tokens, printing AST, or
@@ -1385,10 +3513,86 @@ class SqlGenerator : public drogon::Plugin<SqlGenerator>
      */
     void prepareParser(const std::string& name, const std::string& subSqlName);
 
+    /**
+     * @brief Returns the default parameters of the main SQL statement
+     * `name`, or nullptr if it has none.
+     */
+    const ParamList* mainDefaults(const std::string& name) const;
+
+    /**
+     * @brief Splits the main SQL statement `name` around its `VALUES` row,
+     * if it has one, for getInsertSql.
+     */
+    void prepareValuesRow(const std::string& name);
+
+    /**
+     * @brief Finds the compiled parser of a sub-SQL statement.
+     * @throw std::out_of_range If the sub-SQL statement does not exist.
+     * @date 2026-10-17
+     * @since 0.6.6
+     */
+    const Parser& findParser(const std::string& name,
+                             const std::string& subSqlName) const;
+
+    /**
+     * @brief Collects the CompileStats of every SQL statement and reserves
+     * the estimated output size in every parser.
+     *
+     * @date 2026-10-17
+     * @since 0.6.11
+     */
+    void buildCompileStats();
+
   private:
     Json::Value sqls_;  ///< The JSON object containing SQL statements.
+    std::unique_ptr<std::pmr::monotonic_buffer_resource>
+        astArena_;  ///< Optional storage of all AST nodes, released at once
+                    ///< with the plugin.
+    EscapeMode escapeMode_{EscapeMode::None};  ///< Default escaping of the
+                                               ///< `${}` sites.
+    bool canonicalWhitespace_{false};  ///< Default of whitespace collapsing.
     std::unordered_map<std::string, std::unordered_map<std::string, Parser>>
         parsers_;  ///< Map of parsers for each SQL statement and sub-SQL
                    ///< statement.
+    std::unordered_map<std::string, std::unordered_map<std::string, ParamList>>
+        defaultParams_;  ///< Default values of the "params" field for each
+                         ///< sub-SQL statement.
+    std::unordered_map<std::string, size_t>
+        templateIndex_;  ///< Index of each SQL statement, in name order.
+    std::unique_ptr<RenderMetrics> metrics_;  ///< Optional render metrics.
+    bool fingerprintMetrics_{false};  ///< Whether the metrics count renders
+                                      ///< per fingerprint.
+    std::unique_ptr<std::atomic<bool>[]>
+        profiled_;  ///< Whether each SQL statement is profiled.
+    std::atomic<size_t> profiledCount_{
+        0};  ///< Number of profiled SQL statements.
+    std::unique_ptr<SlowRenderLog>
+        slowRenderLog_;  ///< Optional log of slow renders.
+    std::vector<CompileStats>
+        compileStats_;  ///< Compile statistics, in templateIndex_ order.
+    std::unique_ptr<trantor::ConcurrentTaskQueue>
+        renderQueue_;  ///< Optional worker pool of getSqlAsync.
+    size_t asyncMinBytes_{0};  ///< Estimated size of renders run on the pool.
+    std::unique_ptr<RenderProfiler> profiler_{
+        std::make_unique<RenderProfiler>()};  ///< Records profiled renders.
+    std::unordered_map<std::string, std::shared_ptr<SpecializedSql>>
+        specializations_;  ///< Cache of specialize(), by the name and the
+                           ///< bound values.
+    std::mutex specializationsMutex_;  ///< Guards specializations_.
+
+    /**
+     * @brief A main SQL statement split around its `VALUES` row.
+     */
+    struct ValuesRow
+    {
+        Parser head;  ///< The text up to and including `VALUES`.
+        Parser row;   ///< The row, with its parentheses.
+        Parser tail;  ///< The text after the row.
+        bool spaceBeforeTail{false};  ///< Whether whitespace separates the
+                                      ///< row from the tail.
+    };
+
+    std::unordered_map<std::string, ValuesRow>
+        valuesRows_;  ///< Split statements, by name.
 };
 };  // namespace tl::sql
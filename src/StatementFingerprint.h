@@ -0,0 +1,172 @@
+/**
+ * @file StatementFingerprint.h
+ * @brief Fingerprints of the literal skeleton of rendered SQL statements.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.26
+ *
+ * This header file contains the StatementFingerprint class, a streaming
+ * 64-bit hash which the renderer feeds with the template text it prints and
+ * with a marker for every printed value. Two renders which take the same
+ * branches and loop iterations therefore have the same fingerprint whatever
+ * their values, without scanning the rendered statement again.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace tl::sql
+{
+
+/**
+ * @class StatementFingerprint
+ * @brief A streaming 64-bit hash of the template text and printed values of
+ * a render.
+ *
+ * The text is hashed eight bytes at a time. Bytes which do not fill a word
+ * are kept until the next text, so the fingerprint only depends on the
+ * concatenation of the text and not on how it is split between calls.
+ *
+ * @date 2026-10-17
+ * @since 0.6.26
+ */
+class StatementFingerprint
+{
+  public:
+    /// Fingerprint of a render which was not fingerprinted; digest() never
+    /// returns it.
+    static constexpr uint64_t kNone = 0;
+
+    /**
+     * @brief Adds template text.
+     */
+    void addText(std::string_view text)
+    {
+        length_ += text.size();
+        auto pos = text.data();
+        auto end = pos + text.size();
+        if (pending_ > 0)
+        {
+            while (pending_ < 8 && pos != end)
+            {
+                addPending(*pos++);
+            }
+            if (pending_ < 8)
+            {
+                return;
+            }
+            state_ = mix(state_, tail_);
+            tail_ = 0;
+            pending_ = 0;
+        }
+        for (; end - pos >= 8; pos += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, pos, sizeof(word));
+            state_ = mix(state_, word);
+        }
+        while (pos != end)
+        {
+            addPending(*pos++);
+        }
+    }
+
+    /**
+     * @brief Adds `count` copies of `text`, such as the elements of a list,
+     * in blocks rather than one copy at a time.
+     */
+    void addRepeated(std::string_view text, size_t count)
+    {
+        constexpr size_t kBlockBytes = 1024;
+        if (count == 0 || text.empty())
+        {
+            return;
+        }
+        if (text.size() * 2 > kBlockBytes)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                addText(text);
+            }
+            return;
+        }
+        char block[kBlockBytes];
+        auto copies = std::min(count, kBlockBytes / text.size());
+        for (size_t i = 0; i < copies; ++i)
+        {
+            std::memcpy(block + i * text.size(), text.data(), text.size());
+        }
+        for (; count >= copies; count -= copies)
+        {
+            addText(std::string_view(block, copies * text.size()));
+        }
+        addText(std::string_view(block, count * text.size()));
+    }
+
+    /**
+     * @brief Adds a printed value, which counts as one byte that template
+     * text does not contain.
+     */
+    void addValue()
+    {
+        addText(std::string_view("\0", 1));
+    }
+
+    /**
+     * @brief Adds the fingerprint of a part of the statement rendered on its
+     * own, such as a value hoisted out of a loop.
+     */
+    void addFingerprint(uint64_t fingerprint)
+    {
+        char bytes[1 + sizeof(fingerprint)] = {'\0'};
+        std::memcpy(bytes + 1, &fingerprint, sizeof(fingerprint));
+        addText(std::string_view(bytes, sizeof(bytes)));
+    }
+
+    /**
+     * @brief Returns the fingerprint of everything added so far.
+     */
+    uint64_t digest() const
+    {
+        auto state = pending_ > 0 ? mix(state_, tail_) : state_;
+        state ^= length_;
+        // The finalizer of MurmurHash3
+        state ^= state >> 33;
+        state *= 0xff51afd7ed558ccdull;
+        state ^= state >> 33;
+        state *= 0xc4ceb9fe1a85ec53ull;
+        state ^= state >> 33;
+        return state == kNone ? 1 : state;
+    }
+
+  private:
+    static uint64_t rotate(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    static uint64_t mix(uint64_t state, uint64_t word)
+    {
+        word *= 0x87c37b91114253d5ull;
+        word = rotate(word, 31);
+        word *= 0x4cf5ad432745937full;
+        state ^= word;
+        return rotate(state, 27) * 5 + 0x52dce729;
+    }
+
+    void addPending(char c)
+    {
+        tail_ |= uint64_t(static_cast<unsigned char>(c)) << (8 * pending_++);
+    }
+
+    uint64_t state_{0x9e3779b97f4a7c15ull};
+    uint64_t tail_{0};     ///< Bytes which do not fill a word yet.
+    unsigned pending_{0};  ///< Number of bytes in tail_.
+    uint64_t length_{0};
+};
+
+}  // namespace tl::sql
@@ -0,0 +1,152 @@
+/**
+ * @file StatementPipeline.cc
+ * @brief Implementation of the pipelined rendering and execution of SQL
+ * statements.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.28
+ */
+#include "StatementPipeline.h"
+
+using namespace ::std;
+using namespace ::tl::sql;
+
+StatementPipeline::StatementPipeline(SqlGenerator &generator,
+                                     Executor executor,
+                                     size_t capacity,
+                                     bool ordered,
+                                     PlaceholderStyle style)
+    : generator_(generator),
+      executor_(std::move(executor)),
+      capacity_(max<size_t>(capacity, 1)),
+      ordered_(ordered),
+      style_(style)
+{
+    worker_ = thread([this] { run(); });
+}
+
+StatementPipeline::~StatementPipeline()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    worker_.join();
+    // Completions of the executor still refer to the pipeline
+    wait();
+}
+
+void StatementPipeline::submit(const string &name,
+                               ParamList params,
+                               DoneCallback done)
+{
+    {
+        unique_lock<mutex> lock(mutex_);
+        if (stopping_)
+        {
+            throw runtime_error("Statement pipeline is stopping");
+        }
+        changed_.wait(lock, [this] { return pending_ < capacity_; });
+        ++pending_;
+        queue_.push_back({name, std::move(params), std::move(done)});
+    }
+    changed_.notify_all();
+}
+
+void StatementPipeline::wait()
+{
+    unique_lock<mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return pending_ == 0; });
+}
+
+size_t StatementPipeline::pending() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return pending_;
+}
+
+void StatementPipeline::run()
+{
+    unique_lock<mutex> lock(mutex_);
+    while (true)
+    {
+        changed_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty())
+        {
+            return;
+        }
+        auto job = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        // Rendered while the previous statement may still execute
+        Statement statement;
+        try
+        {
+            statement = generator_.getStatement(job.name, job.params, style_);
+        }
+        catch (...)
+        {
+            complete(job.done, current_exception());
+            lock.lock();
+            continue;
+        }
+
+        lock.lock();
+        if (ordered_)
+        {
+            changed_.wait(lock, [this] { return executing_ == 0; });
+        }
+        ++executing_;
+        lock.unlock();
+        try
+        {
+            executor_(std::move(statement),
+                      [this, done = job.done](const exception_ptr &error) {
+                          {
+                              lock_guard<mutex> guard(mutex_);
+                              --executing_;
+                          }
+                          // The next statement need not wait for `done`
+                          changed_.notify_all();
+                          complete(done, error);
+                      });
+        }
+        catch (...)
+        {
+            {
+                lock_guard<mutex> guard(mutex_);
+                --executing_;
+            }
+            complete(job.done, current_exception());
+        }
+        lock.lock();
+    }
+}
+
+void StatementPipeline::complete(const DoneCallback &done,
+                                 const exception_ptr &error)
+{
+    if (done)
+    {
+        try
+        {
+            done(error);
+        }
+        catch (const exception &e)
+        {
+            LOG_ERROR << "Statement callback threw: " << e.what();
+        }
+        catch (...)
+        {
+            LOG_ERROR << "Statement callback threw";
+        }
+    }
+    // Notified under the lock, since wait() may return and the pipeline be
+    // destroyed as soon as the lock is released
+    lock_guard<mutex> lock(mutex_);
+    --pending_;
+    changed_.notify_all();
+}
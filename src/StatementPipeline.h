@@ -0,0 +1,145 @@
+/**
+ * @file StatementPipeline.h
+ * @brief Pipelined rendering and execution of SQL statements.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.28
+ *
+ * This header file contains the StatementPipeline class. Statements are
+ * queued by name and parameters, rendered with placeholders on a worker
+ * thread of the pipeline and handed to an executor, such as the one of
+ * DbClientPipeline.h, so that the next statement is rendered while the
+ * previous one is still executing.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "SqlGenerator.h"
+
+namespace tl::sql
+{
+
+/**
+ * @class StatementPipeline
+ * @brief Renders queued statements with SqlGenerator::getStatement on a
+ * worker thread and passes them to an executor, which runs them
+ * asynchronously.
+ *
+ * At most `capacity` statements are queued, rendering or executing at a
+ * time; submit() blocks while the pipeline is full. An ordered pipeline
+ * passes a statement to the executor only when the previous one has
+ * completed, so the statements run in the order they were submitted even on
+ * a client with several connections, and still renders the next statement
+ * while the previous one executes. An unordered pipeline passes every
+ * statement on as soon as it is rendered.
+ *
+ * @code
+ * auto pipeline = makeDbClientPipeline(*generator, app().getDbClient());
+ * pipeline->submit("insert_user", {{"username", name}},
+ *                  [](const std::exception_ptr &error) { ... });
+ * @endcode
+ *
+ * @date 2026-10-17
+ * @since 0.6.28
+ */
+class StatementPipeline
+{
+  public:
+    /// Called once a statement has completed, with nullptr on success.
+    using DoneCallback = std::function<void(const std::exception_ptr&)>;
+    /// Runs a rendered statement and calls the callback exactly once, on any
+    /// thread, when it has completed. If it throws, it must not call the
+    /// callback.
+    using Executor = std::function<void(Statement, DoneCallback)>;
+
+    /**
+     * @param generator Renders the statements; must outlive the pipeline.
+     * @param executor Runs the rendered statements.
+     * @param capacity The number of statements which may be in the
+     * pipeline at a time.
+     * @param ordered Whether a statement waits for the previous one to
+     * complete before it is executed.
+     * @param style The placeholders the executor expects.
+     */
+    StatementPipeline(SqlGenerator& generator,
+                      Executor executor,
+                      size_t capacity = 64,
+                      bool ordered = true,
+                      PlaceholderStyle style = PlaceholderStyle::Dollar);
+
+    /**
+     * @brief Waits until every submitted statement has completed and stops
+     * the worker thread.
+     */
+    ~StatementPipeline();
+
+    StatementPipeline(const StatementPipeline&) = delete;
+    StatementPipeline& operator=(const StatementPipeline&) = delete;
+
+    /**
+     * @brief Queues the SQL statement `name` with `params`, waiting while
+     * the pipeline is full.
+     *
+     * `done` receives the error if the statement cannot be rendered or
+     * fails. It runs on the thread which completes the statement, which may
+     * be the worker thread, and must not wait for submit() there.
+     */
+    void submit(const std::string& name,
+                ParamList params,
+                DoneCallback done = nullptr);
+
+    /**
+     * @brief Waits until every submitted statement has completed.
+     */
+    void wait();
+
+    /**
+     * @brief Returns the number of statements which have not completed yet.
+     */
+    size_t pending() const;
+
+  private:
+    /**
+     * @brief A statement which has not been rendered yet.
+     */
+    struct Job
+    {
+        std::string name;
+        ParamList params;
+        DoneCallback done;
+    };
+
+    /**
+     * @brief Renders and executes queued statements until stopped.
+     */
+    void run();
+
+    /**
+     * @brief Passes the result of a statement to its callback and frees its
+     * place in the pipeline.
+     */
+    void complete(const DoneCallback& done, const std::exception_ptr& error);
+
+    SqlGenerator& generator_;
+    Executor executor_;
+    size_t capacity_;
+    bool ordered_;
+    PlaceholderStyle style_;
+    mutable std::mutex mutex_;         ///< Guards the members below.
+    std::condition_variable changed_;  ///< Signals a change of them.
+    std::deque<Job> queue_;            ///< Statements to be rendered.
+    size_t pending_{0};     ///< Statements submitted and not completed.
+    size_t executing_{0};   ///< Statements passed to the executor.
+    bool stopping_{false};  ///< Whether the worker is to stop when idle.
+    std::thread worker_;    ///< Renders the statements.
+};
+
+}  // namespace tl::sql
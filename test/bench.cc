@@ -0,0 +1,1021 @@
+/**
+ * @file bench.cc
+ * @brief Microbenchmarks for the Lexer, the Parser and SQL rendering.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.29
+ *
+ * Every template in config.json is measured on three layers: tokenizing with
+ * `Lexer::next`, building the AST with `Parser::compile` and rendering with
+ * `SqlGenerator::getSql`. Synthetic templates (a 10k-element loop, 50 levels
+ * of nested sub-SQL, a 1 MB literal, joins of 1M ids, 10k rows of int64,
+ * double and bool values, a 32-way dispatch written with `@elif` and with
+ * `@switch`, a deep path printed 8 times with and without `@let`, and an
+ * insert of 10k rows which all print the same outer values) show how each
+ * layer scales. Formatting 1M integers is compared between `std::to_string`,
+ * `std::to_chars` and appendDecimals, and escaping 1 MB of text between a
+ * loop over every character and appendEscaped. A configurable report is
+ * rendered generically and specialized for its configuration, and a filtered
+ * query is fingerprinted while rendering and by scanning its output. An
+ * insert of 1000 rows is rendered as 1000 statements and coalesced into one.
+ * Statements are rendered and executed on a fake database client one after
+ * another and through a StatementPipeline. A bulk insert of 10k rows is
+ * rendered from a JSON array of objects and from a ColumnBatch, each with
+ * and without converting the columns it is made of. The results are written
+ * as JSON so that runs can be compared with a script.
+ *
+ * Built with `make bench INSTRUMENT=1`, each render result also contains the
+ * allocations of a single render by node type and by sub-SQL statement, and
+ * how often its output buffers had to grow.
+ *
+ * Usage: ./bench [--min-time=seconds] [--filter=substring] [-o file]
+ */
+#include <json/value.h>
+#include <json/writer.h>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <thread>
+
+#include "../src/InsertCoalescer.h"
+#include "../src/SqlGenerator.h"
+#include "../src/StatementPipeline.h"
+#include "bench_common.h"
+
+using namespace ::std;
+using namespace ::tl::sql;
+
+#ifdef TL_SQL_INSTRUMENTATION
+// The instrumentation mode of the library already counts allocations.
+namespace
+{
+AllocationStats allocationsSoFar()
+{
+    return SqlGenerator::threadAllocationStats();
+}
+}  // namespace
+#else
+namespace
+{
+atomic<size_t> allocCount{0};  ///< Number of calls to operator new.
+atomic<size_t> allocBytes{0};  ///< Bytes requested from operator new.
+
+AllocationStats allocationsSoFar()
+{
+    AllocationStats stats;
+    stats.allocations = allocCount.load(memory_order_relaxed);
+    stats.bytes = allocBytes.load(memory_order_relaxed);
+    return stats;
+}
+}  // namespace
+
+void *operator new(size_t size)
+{
+    allocCount.fetch_add(1, memory_order_relaxed);
+    allocBytes.fetch_add(size, memory_order_relaxed);
+    if (auto ptr = malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw bad_alloc();
+}
+
+// Not inlined, so that GCC pairs delete expressions with operator new rather
+// than with the free() inside
+[[gnu::noinline]] void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+#endif
+
+namespace
+{
+/**
+ * @brief The result of running one benchmark case.
+ */
+struct Measurement
+{
+    size_t iterations{0};
+    double nsPerOp{0};
+    double allocsPerOp{0};
+    double bytesPerOp{0};
+};
+
+double minTime = 0.2;  ///< Minimum wall time of a single benchmark case.
+string filter;         ///< Only cases whose name contains it are run.
+volatile size_t sink;  ///< Keeps the optimizer from dropping results.
+
+/**
+ * @brief Runs `op` repeatedly, doubling the batch size until the batch takes
+ * at least `minTime` seconds.
+ */
+template <typename Op>
+Measurement measure(Op &&op)
+{
+    sink = op();  // warm up
+    Measurement result;
+    for (size_t batch = 1;; batch *= 2)
+    {
+        auto allocs = allocationsSoFar();
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < batch; ++i)
+        {
+            sink = op();
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() >= minTime || batch >= (size_t{1} << 30))
+        {
+            result.iterations = batch;
+            result.nsPerOp = elapsed.count() * 1e9 / batch;
+            auto end = allocationsSoFar();
+            result.allocsPerOp =
+                double(end.allocations - allocs.allocations) / batch;
+            result.bytesPerOp = double(end.bytes - allocs.bytes) / batch;
+            return result;
+        }
+    }
+}
+
+Json::Value toJson(const string &name, const Measurement &m)
+{
+    Json::Value json;
+    json["name"] = name;
+    json["iterations"] = Json::UInt64(m.iterations);
+    json["ns_per_op"] = m.nsPerOp;
+    json["allocs_per_op"] = m.allocsPerOp;
+    json["alloc_bytes_per_op"] = m.bytesPerOp;
+    return json;
+}
+
+#ifdef TL_SQL_INSTRUMENTATION
+Json::Value toJson(const AllocationStats &stats)
+{
+    Json::Value json;
+    json["allocations"] = Json::UInt64(stats.allocations);
+    json["bytes"] = Json::UInt64(stats.bytes);
+    json["peak_bytes"] = Json::UInt64(stats.peakBytes);
+    return json;
+}
+
+/**
+ * @brief Summarizes the RenderStats of the last render, which are only
+ * collected when built with `make bench INSTRUMENT=1`.
+ */
+Json::Value toJson(const RenderStats &stats)
+{
+    Json::Value json;
+    json["total"] = toJson(stats.total);
+    for (const auto &[type, typeStats] : stats.byNodeType)
+    {
+        json["by_node_type"][type] = toJson(typeStats);
+    }
+    for (const auto &[subSql, subSqlStats] : stats.bySubSql)
+    {
+        json["by_sub_sql"][subSql] = toJson(subSqlStats);
+    }
+    json["output_reallocations"] = Json::UInt64(stats.outputReallocations);
+    return json;
+}
+#endif
+
+bool selected(const string &name)
+{
+    return filter.empty() || name.find(filter) != string::npos;
+}
+
+/**
+ * @brief Collects the SQL text of every sub-SQL of every template, keyed by
+ * "name.subSqlName".
+ */
+vector<pair<string, string>> collectSqls(const Json::Value &sqls)
+{
+    vector<pair<string, string>> result;
+    for (const auto &name : sqls.getMemberNames())
+    {
+        const auto &item = sqls[name];
+        if (item.isString())
+        {
+            result.emplace_back(name + ".main", item.asString());
+            continue;
+        }
+        for (const auto &subSqlName : item.getMemberNames())
+        {
+            const auto &subSql = item[subSqlName];
+            if (subSql.isString())
+            {
+                result.emplace_back(name + "." + subSqlName, subSql.asString());
+            }
+            else if (subSql.isMember("sql"))
+            {
+                result.emplace_back(name + "." + subSqlName,
+                                    subSql["sql"].asString());
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Builds the synthetic templates: a loop over 10k elements, 50 levels
+ * of nested sub-SQL, a 1 MB literal, a join of 1M ids, passed as a JSON
+ * array and as an IntArray, an insert of 10k rows of JSON scalars, and an
+ * ORDER BY chosen among 32 columns by an `@elif` chain and by a `@switch`,
+ * a path of 4 members printed 8 times, directly and through a `@let`, and
+ * an insert of 10k rows whose outer values and sub-SQL call are hoisted.
+ */
+Json::Value syntheticSqls()
+{
+    Json::Value sqls;
+    sqls["for_10k"] =
+        "SELECT * FROM users WHERE id IN (@for(id in ids, separator=',') "
+        "${id} @endfor)";
+
+    auto &nested = sqls["nested_50"];
+    nested["main"] = "main: (@level0(param))";
+    for (int i = 0; i < 50; ++i)
+    {
+        auto name = "level" + to_string(i);
+        nested[name] =
+            i + 1 < 50 ? name + ": (@level" + to_string(i + 1) + "(param))"
+                       : name + ": ${param}";
+    }
+
+    string literal = "SELECT * FROM users WHERE id = ${id} AND comment = '";
+    while (literal.size() < (1 << 20))
+    {
+        literal += "lorem ipsum dolor sit amet, consectetur adipiscing elit ";
+    }
+    literal += "' LIMIT ${limit}";
+    sqls["literal_1mb"] = literal;
+
+    sqls["join_1m"] = "@for(id in ids, separator=',') ${id} @endfor";
+    sqls["join_1m_typed"] = sqls["join_1m"];
+    sqls["scalars_10k"] =
+        "INSERT INTO products (id, price, active) VALUES @for(row in rows, "
+        "separator=',') (${row.id}, ${row.price}, ${row.active}) @endfor";
+
+    string elif = "SELECT * FROM orders ORDER BY ";
+    string cases = "SELECT * FROM orders ORDER BY @switch(sort_by) ";
+    for (int i = 0; i < 32; ++i)
+    {
+        auto column = "col" + to_string(i);
+        elif += (i == 0 ? "@if" : "@elif") + ("(sort_by == '" + column +
+                                               "') " + column + " ");
+        cases += "@case('" + column + "') " + column + " ";
+    }
+    sqls["dispatch_elif_32"] = elif + "@else id @endif";
+    sqls["dispatch_switch_32"] = cases + "@default id @endswitch";
+
+    string path = "SELECT * FROM t WHERE ";
+    string let = "@let(v = a.b.c.d)SELECT * FROM t WHERE ";
+    for (int i = 0; i < 8; ++i)
+    {
+        auto column = (i == 0 ? "c" : " OR c") + to_string(i) + " = ";
+        path += column + "${a.b.c.d}";
+        let += column + "${v}";
+    }
+    sqls["path_8"] = path;
+    sqls["path_8_let"] = let;
+
+    auto &hoist = sqls["hoist_10k"];
+    hoist["main"] =
+        "INSERT INTO log (batch, tenant, item) VALUES @for(item in items, "
+        "separator=',') (${batch.id}, (@tenant(org = org)), ${item}) @endfor";
+    hoist["tenant"] = "SELECT id FROM tenant WHERE org = '${org}'";
+    return sqls;
+}
+
+ParamList syntheticParamsFor(const string &name)
+{
+    if (name == "for_10k")
+    {
+        Json::Value ids(Json::arrayValue);
+        for (int i = 0; i < 10000; ++i)
+        {
+            ids.append(i);
+        }
+        return {{"ids", ids}};
+    }
+    if (name == "join_1m")
+    {
+        Json::Value ids(Json::arrayValue);
+        ids.resize(1000000);
+        for (Json::ArrayIndex i = 0; i < ids.size(); ++i)
+        {
+            ids[i] = static_cast<int>(i);
+        }
+        return {{"ids", ids}};
+    }
+    if (name == "join_1m_typed")
+    {
+        IntArray ids(1000000);
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            ids[i] = static_cast<int32_t>(i);
+        }
+        return {{"ids", std::move(ids)}};
+    }
+    if (name == "scalars_10k")
+    {
+        Json::Value rows(Json::arrayValue);
+        for (int i = 0; i < 10000; ++i)
+        {
+            Json::Value row;
+            row["id"] = Json::Int64(1) << 40 | i;
+            row["price"] = i / 100.0;
+            row["active"] = i % 2 == 0;
+            rows.append(std::move(row));
+        }
+        return {{"rows", rows}};
+    }
+    if (name.rfind("dispatch_", 0) == 0)
+    {
+        // The last branch is the slowest one to reach by @elif
+        return {{"sort_by", string("col31")}};
+    }
+    if (name.rfind("path_8", 0) == 0)
+    {
+        Json::Value a;
+        a["b"]["c"]["d"] = 42;
+        return {{"a", a}};
+    }
+    if (name == "hoist_10k")
+    {
+        Json::Value batch;
+        batch["id"] = 7;
+        IntArray items(10000);
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            items[i] = static_cast<int32_t>(i);
+        }
+        return {{"batch", batch},
+                {"org", string("acme")},
+                {"items", std::move(items)}};
+    }
+    if (name == "nested_50")
+    {
+        return {{"param", string("param")}};
+    }
+    if (name == "literal_1mb")
+    {
+        return {{"id", 1}, {"limit", 10}};
+    }
+    return {};
+}
+
+/**
+ * @brief Formats 1M integers of mixed lengths as a comma separated list with
+ * each method and appends the results to `report`.
+ */
+template <typename Int>
+void runFormat(const string &type, Json::Value &report)
+{
+    vector<Int> values(1000000);
+    uint64_t state = 0x9e3779b97f4a7c15;
+    for (auto &value : values)
+    {
+        // Uniform bits give mostly long numbers, so shift by a random amount
+        state = state * 6364136223846793005 + 1442695040888963407;
+        value = static_cast<Int>(state) >> (state >> 59) % (sizeof(Int) * 8);
+    }
+    string sql;
+    auto run = [&](const string &method, auto &&format) {
+        auto name = type + "_" + method;
+        if (!selected(name))
+        {
+            return;
+        }
+        auto result = measure([&sql, &values, &format] {
+            sql.clear();
+            format(values, sql);
+            return sql.size();
+        });
+        auto json = toJson(name, result);
+        json["output_bytes"] = Json::UInt64(sql.size());
+        report.append(json);
+    };
+    run("to_string", [](const vector<Int> &values, string &sql) {
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            if (i > 0)
+            {
+                sql += ',';
+            }
+            sql += to_string(values[i]);
+        }
+    });
+    run("to_chars", [](const vector<Int> &values, string &sql) {
+        char digits[kMaxDecimalBytes];
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            if (i > 0)
+            {
+                sql += ',';
+            }
+            sql.append(digits, to_chars(digits, end(digits), values[i]).ptr);
+        }
+    });
+    run("append_decimals", [](const vector<Int> &values, string &sql) {
+        appendDecimals(values.data(), values.size(), {"", "", ","}, sql);
+    });
+}
+
+/**
+ * @brief Escapes 1 MB of text with a quote or wildcard every 1000 characters
+ * in each mode, character by character and with appendEscaped, and appends
+ * the results to `report`.
+ */
+void runEscape(Json::Value &report)
+{
+    string text;
+    while (text.size() < (1 << 20))
+    {
+        text += "lorem ipsum dolor sit amet, consectetur adipiscing elit ";
+        if (text.size() % 1000 < 56)
+        {
+            text += "O'Brien 50%_off ";
+        }
+    }
+    const pair<const char *, EscapeMode> modes[] = {
+        {"literal", EscapeMode::Literal},
+        {"like", EscapeMode::Like},
+    };
+    string sql;
+    for (const auto &[modeName, mode] : modes)
+    {
+        auto run = [&, mode = mode](const string &method, auto &&escape) {
+            auto name = string("escape_") + modeName + "_" + method;
+            if (!selected(name))
+            {
+                return;
+            }
+            auto result = measure([&sql, &text, &escape, mode] {
+                sql.clear();
+                escape(text, mode, sql);
+                return sql.size();
+            });
+            auto json = toJson(name, result);
+            json["output_bytes"] = Json::UInt64(sql.size());
+            report.append(json);
+        };
+        run("per_char", [](const string &text, EscapeMode mode, string &sql) {
+            for (auto c : text)
+            {
+                if (c == '\'')
+                {
+                    sql += '\'';
+                }
+                else if (mode == EscapeMode::Like &&
+                         (c == '%' || c == '_' || c == '\\'))
+                {
+                    sql += '\\';
+                }
+                sql += c;
+            }
+        });
+        run("append_escaped",
+            [](const string &text, EscapeMode mode, string &sql) {
+                appendEscaped(text, mode, sql);
+            });
+    }
+}
+
+/**
+ * @brief Renders a report of 20 configured columns, a tenant sub-query and a
+ * configured order, generically and specialized for its configuration, with
+ * only the filters given per render, and appends the results to `report`.
+ */
+void runSpecialize(Json::Value &report)
+{
+    Json::Value sqls;
+    auto &sql = sqls["report_20"];
+    sql["main"] =
+        "SELECT @for(column in columns, separator=', ') ${column.expr} AS "
+        "\"${column.name}\" @endfor FROM orders WHERE tenant = "
+        "(@tenant(org = org)) @if(status) AND status = '${status}' @endif "
+        "@if(archived) AND archived_at IS NOT NULL @endif @switch(sort) "
+        "@case('date') ORDER BY created_at @case('amount') ORDER BY amount "
+        "@default ORDER BY id @endswitch LIMIT ${limit}";
+    sql["tenant"] = "SELECT id FROM tenant WHERE org = '${org}'";
+    SqlGenerator generator;
+    Json::Value config;
+    config["sqls"] = sqls;
+    generator.initAndStart(config);
+
+    Json::Value columns(Json::arrayValue);
+    for (int i = 0; i < 20; ++i)
+    {
+        Json::Value column;
+        column["expr"] = "SUM(col" + to_string(i) + ")";
+        column["name"] = "Column " + to_string(i);
+        columns.append(std::move(column));
+    }
+    ParamList bound{{"columns", columns},
+                    {"org", string("acme")},
+                    {"archived", false},
+                    {"sort", string("amount")}};
+    ParamList rest{{"status", string("paid")}, {"limit", 50}};
+    auto all = rest;
+    all.insert(bound.begin(), bound.end());
+
+    auto run = [&report](const string &name, auto &&render) {
+        if (!selected(name))
+        {
+            return;
+        }
+        auto outputBytes = render().size();
+        auto result = measure([&render] { return render().size(); });
+        auto json = toJson(name, result);
+        json["output_bytes"] = Json::UInt64(outputBytes);
+        report.append(json);
+    };
+    run("report_20_generic",
+        [&generator, &all] { return generator.getSql("report_20", all); });
+    auto specialized = generator.specialize("report_20", bound);
+    run("report_20_specialized",
+        [&specialized, &rest] { return specialized->getSql(rest); });
+    // Looking the specialization up in the cache on every render
+    run("report_20_specialize_cached", [&generator, &bound, &rest] {
+        return generator.specialize("report_20", bound)->getSql(rest);
+    });
+}
+
+/**
+ * @brief Fingerprints the same statement while it is rendered and by
+ * scanning the rendered text for literals, as done without the renderer.
+ */
+void runFingerprint(Json::Value &report)
+{
+    Json::Value config;
+    config["sqls"]["search"] =
+        "SELECT id, title, author, created_at FROM blog @where @if(state) "
+        "state = ${state} @endif @if(title) AND title LIKE '%${title}%' "
+        "@endif @if(ids) AND id IN (@for(id in ids, separator=', ')${id}"
+        "@endfor) @endif @endwhere ORDER BY created_at DESC LIMIT ${limit}";
+    SqlGenerator generator;
+    generator.initAndStart(config);
+    IntArray ids(1000);
+    iota(ids.begin(), ids.end(), 1);
+    ParamList params{{"state", 1},
+                     {"title", string("fingerprint")},
+                     {"ids", std::move(ids)},
+                     {"limit", 20}};
+
+    // Numbers and the contents of string literals are values
+    auto scan = [](const string &sql) {
+        StatementFingerprint fingerprint;
+        size_t text = 0;
+        for (size_t pos = 0; pos < sql.size();)
+        {
+            auto c = sql[pos];
+            auto end = pos;
+            if (c == '\'')
+            {
+                for (++end; end < sql.size(); ++end)
+                {
+                    if (sql[end] == '\'' &&
+                        (end + 1 == sql.size() || sql[++end] != '\''))
+                    {
+                        break;
+                    }
+                }
+            }
+            else if (isdigit(static_cast<unsigned char>(c)) &&
+                     (pos == 0 || !isalnum(static_cast<unsigned char>(
+                                      sql[pos - 1]))))
+            {
+                while (end < sql.size() &&
+                       isdigit(static_cast<unsigned char>(sql[end])))
+                {
+                    ++end;
+                }
+            }
+            if (end == pos)
+            {
+                ++pos;
+                continue;
+            }
+            fingerprint.addText(string_view(sql).substr(text, pos - text));
+            fingerprint.addValue();
+            pos = text = end;
+        }
+        fingerprint.addText(string_view(sql).substr(text));
+        return fingerprint.digest();
+    };
+
+    auto run = [&report](const string &name, auto &&render) {
+        if (!selected(name))
+        {
+            return;
+        }
+        auto result = measure([&render] { return render(); });
+        report.append(toJson(name, result));
+    };
+    run("search_1000_plain", [&generator, &params] {
+        return generator.getSql("search", params).size();
+    });
+    run("search_1000_render_fingerprint", [&generator, &params] {
+        return generator.getSqlWithFingerprint("search", params).fingerprint;
+    });
+    run("search_1000_scan_fingerprint", [&generator, &params, &scan] {
+        return scan(generator.getSql("search", params));
+    });
+}
+
+/**
+ * @brief Renders 1000 rows of an insert as single-row statements, as one
+ * statement with SqlGenerator::getInsertSql, and through an InsertCoalescer.
+ * Each result is the number of statements, i.e. of round trips to a database.
+ */
+void runCoalesce(Json::Value &report)
+{
+    Json::Value config;
+    config["sqls"]["insert_user"] =
+        "INSERT INTO users (username, email, created_at) VALUES "
+        "(${username}, ${email}, now())";
+    SqlGenerator generator;
+    generator.initAndStart(config);
+    vector<ParamList> rows;
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto name = "user_" + to_string(i);
+        rows.push_back({{"username", "'" + name + "'"},
+                        {"email", "'" + name + "@example.com'"}});
+    }
+
+    auto run = [&report](const string &name, auto &&render) {
+        if (!selected(name))
+        {
+            return;
+        }
+        auto result = measure([&render] { return render(); });
+        report.append(toJson(name, result));
+    };
+    run("insert_1000_single", [&generator, &rows] {
+        size_t statements = 0;
+        for (const auto &row : rows)
+        {
+            statements += !generator.getSql("insert_user", row).empty();
+        }
+        return statements;
+    });
+    run("insert_1000_multi_row", [&generator, &rows] {
+        return size_t(!generator.getInsertSql("insert_user", rows).empty());
+    });
+    run("insert_1000_coalesced", [&generator, &rows] {
+        size_t statements = 0;
+        {
+            InsertCoalescer coalescer(
+                generator,
+                [&statements](CoalescedInsert) { ++statements; },
+                rows.size(),
+                chrono::milliseconds(0));
+            for (const auto &row : rows)
+            {
+                coalescer.add("insert_user", row);
+            }
+        }
+        return statements;
+    });
+}
+
+/**
+ * @brief A database client which runs statements on `connections` threads
+ * that each take `latency` per statement, like a DbClient with a pool of
+ * connections.
+ */
+class FakeDbClient
+{
+  public:
+    FakeDbClient(size_t connections, chrono::microseconds latency)
+        : latency_(latency)
+    {
+        for (size_t i = 0; i < connections; ++i)
+        {
+            connections_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~FakeDbClient()
+    {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        for (auto &connection : connections_)
+        {
+            connection.join();
+        }
+    }
+
+    void execute(Statement statement, StatementPipeline::DoneCallback done)
+    {
+        {
+            lock_guard<mutex> lock(mutex_);
+            queue_.emplace_back(std::move(statement), std::move(done));
+        }
+        changed_.notify_one();
+    }
+
+  private:
+    void run()
+    {
+        unique_lock<mutex> lock(mutex_);
+        while (true)
+        {
+            changed_.wait(lock,
+                          [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty())
+            {
+                return;
+            }
+            auto done = std::move(queue_.front().second);
+            queue_.pop_front();
+            lock.unlock();
+            this_thread::sleep_for(latency_);
+            done(nullptr);
+            lock.lock();
+        }
+    }
+
+    chrono::microseconds latency_;
+    mutex mutex_;
+    condition_variable changed_;
+    deque<pair<Statement, StatementPipeline::DoneCallback>> queue_;
+    bool stopping_{false};
+    vector<thread> connections_;
+};
+
+/**
+ * @brief Renders and executes 200 filtered queries on a fake client with
+ * 50 us of latency, waiting for each before rendering the next, and through
+ * ordered and unordered pipelines. Each result is the number of statements.
+ */
+void runPipeline(Json::Value &report)
+{
+    Json::Value config;
+    config["sqls"]["search"] =
+        "SELECT id, title FROM blog WHERE state = ${state} AND id IN "
+        "(@for(id in ids, separator=', ')${id}@endfor) LIMIT ${limit}";
+    SqlGenerator generator;
+    generator.initAndStart(config);
+    IntArray ids(1000);
+    iota(ids.begin(), ids.end(), 1);
+    ParamList params{{"state", 1}, {"ids", std::move(ids)}, {"limit", 20}};
+    constexpr size_t kStatements = 200;
+    constexpr chrono::microseconds kLatency(50);
+
+    auto run = [&report](const string &name, auto &&execute) {
+        if (!selected(name))
+        {
+            return;
+        }
+        auto result = measure([&execute] { return execute(); });
+        report.append(toJson(name, result));
+    };
+    run("pipeline_200_serial", [&generator, &params] {
+        FakeDbClient client(1, kLatency);
+        mutex doneMutex;
+        condition_variable doneChanged;
+        for (size_t i = 0; i < kStatements; ++i)
+        {
+            auto done = false;
+            client.execute(generator.getStatement("search", params),
+                           [&](const exception_ptr &) {
+                               lock_guard<mutex> lock(doneMutex);
+                               done = true;
+                               doneChanged.notify_one();
+                           });
+            unique_lock<mutex> lock(doneMutex);
+            doneChanged.wait(lock, [&done] { return done; });
+        }
+        return kStatements;
+    });
+    auto pipelined = [&generator, &params](size_t connections, bool ordered) {
+        FakeDbClient client(connections, kLatency);
+        StatementPipeline pipeline(
+            generator,
+            [&client](Statement statement,
+                      StatementPipeline::DoneCallback done) {
+                client.execute(std::move(statement), std::move(done));
+            },
+            64,
+            ordered);
+        for (size_t i = 0; i < kStatements; ++i)
+        {
+            pipeline.submit("search", params);
+        }
+        pipeline.wait();
+        return kStatements;
+    };
+    run("pipeline_200_ordered",
+        [&pipelined] { return pipelined(1, true); });
+    run("pipeline_200_unordered_4",
+        [&pipelined] { return pipelined(4, false); });
+}
+
+/**
+ * @brief Renders an insert of 10k rows whose values are held in columns, once
+ * through a JSON array of objects and once through a ColumnBatch. The
+ * `_convert` variants include building the parameter from the columns.
+ */
+void runColumnBatch(Json::Value &report)
+{
+    Json::Value config;
+    config["sqls"]["insert_users"] =
+        "INSERT INTO users (id, name, score) VALUES @for(user in users, "
+        "separator=', ') (${user.id}, '${user.name}', ${user.score}) @endfor";
+    SqlGenerator generator;
+    generator.initAndStart(config);
+    constexpr size_t kRows = 10000;
+    Int64Array ids(kRows);
+    vector<string> names(kRows);
+    vector<double> scores(kRows);
+    for (size_t i = 0; i < kRows; ++i)
+    {
+        ids[i] = 1000000 + static_cast<int64_t>(i);
+        names[i] = "user_" + to_string(i);
+        scores[i] = static_cast<double>(i) / 4;
+    }
+    auto toJsonRows = [&ids, &names, &scores] {
+        Json::Value users(Json::arrayValue);
+        for (size_t i = 0; i < kRows; ++i)
+        {
+            Json::Value user;
+            user["id"] = static_cast<Json::Int64>(ids[i]);
+            user["name"] = names[i];
+            user["score"] = scores[i];
+            users.append(std::move(user));
+        }
+        return users;
+    };
+    auto toBatch = [&ids, &names, &scores] {
+        ColumnBatch users;
+        users.add("id", ids).add("name", names).add("score", scores);
+        return users;
+    };
+    ParamList json{{"users", toJsonRows()}};
+    ParamList batch{{"users", toBatch()}};
+
+    auto run = [&report](const string &name, auto &&render) {
+        if (!selected(name))
+        {
+            return;
+        }
+        auto result = measure([&render] { return render(); });
+        report.append(toJson(name, result));
+    };
+    run("batch_10000_json", [&generator, &json] {
+        return generator.getSql("insert_users", json).size();
+    });
+    run("batch_10000_columns", [&generator, &batch] {
+        return generator.getSql("insert_users", batch).size();
+    });
+    run("batch_10000_json_convert", [&generator, &toJsonRows] {
+        return generator.getSql("insert_users", {{"users", toJsonRows()}})
+            .size();
+    });
+    run("batch_10000_columns_convert", [&generator, &toBatch] {
+        return generator.getSql("insert_users", {{"users", toBatch()}}).size();
+    });
+}
+
+/**
+ * @brief Runs all three layers for every template in `sqls` and appends the
+ * results to `report`.
+ */
+void runSuite(const Json::Value &sqls,
+              const function<ParamList(const string &)> &params,
+              Json::Value &report)
+{
+    for (const auto &[name, sql] : collectSqls(sqls))
+    {
+        if (!selected(name))
+        {
+            continue;
+        }
+        size_t tokens = 0;
+        auto lexer = measure([&sql = sql, &tokens] {
+            Lexer lexer(sql);
+            tokens = 0;
+            while (lexer.next().type() != Done)
+            {
+                ++tokens;
+            }
+            return tokens;
+        });
+        auto lexerJson = toJson(name, lexer);
+        lexerJson["bytes"] = Json::UInt64(sql.size());
+        lexerJson["tokens"] = Json::UInt64(tokens);
+        lexerJson["mb_per_s"] = sql.size() / lexer.nsPerOp * 1e3;
+        lexerJson["tokens_per_s"] = tokens / lexer.nsPerOp * 1e9;
+        report["lexer"].append(lexerJson);
+
+        auto parser = measure([&sql = sql] {
+            Parser parser(sql);
+            parser.compile();
+            return sql.size();
+        });
+        report["parser"].append(toJson(name, parser));
+    }
+
+    SqlGenerator generator;
+    Json::Value config;
+    config["sqls"] = sqls;
+    generator.initAndStart(config);
+    for (const auto &name : sqls.getMemberNames())
+    {
+        if (!selected(name))
+        {
+            continue;
+        }
+        auto templateParams = params(name);
+        auto outputBytes = generator.getSql(name, templateParams).size();
+        auto render = measure([&generator, &name, &templateParams] {
+            return generator.getSql(name, templateParams).size();
+        });
+        auto renderJson = toJson(name, render);
+        renderJson["output_bytes"] = Json::UInt64(outputBytes);
+#ifdef TL_SQL_INSTRUMENTATION
+        generator.getSql(name, templateParams);
+        renderJson["instrumentation"] = toJson(SqlGenerator::lastRenderStats());
+#endif
+        report["render"].append(renderJson);
+    }
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    string output;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg.rfind("--min-time=", 0) == 0)
+        {
+            minTime = atof(arg.c_str() + 11);
+        }
+        else if (arg.rfind("--filter=", 0) == 0)
+        {
+            filter = arg.substr(9);
+        }
+        else if (arg == "-o" && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0]
+                 << " [--min-time=seconds] [--filter=substring] [-o file]"
+                 << endl;
+            return 1;
+        }
+    }
+
+    Json::Value config;
+    if (!loadConfig(config))
+    {
+        return 1;
+    }
+
+    Json::Value report;
+    report["min_time"] = minTime;
+    runSuite(config["sqls"], paramsFor, report["templates"]);
+    runSuite(syntheticSqls(), syntheticParamsFor, report["synthetic"]);
+    runFormat<int32_t>("int32", report["format"]);
+    runFormat<int64_t>("int64", report["format"]);
+    runEscape(report["escape"]);
+    runSpecialize(report["specialize"]);
+    runFingerprint(report["fingerprint"]);
+    runCoalesce(report["coalesce"]);
+    runPipeline(report["pipeline"]);
+    runColumnBatch(report["column_batch"]);
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "  ";
+    if (output.empty())
+    {
+        cout << Json::writeString(writer, report) << endl;
+    }
+    else
+    {
+        ofstream(output) << Json::writeString(writer, report) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+/**
+ * @file bench_common.h
+ * @brief Helpers shared by the benchmark programs.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.29
+ */
+#pragma once
+
+#include <json/reader.h>
+#include <json/value.h>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/SqlGenerator.h"
+
+/**
+ * @brief Loads ./config.json, the same configuration used by test.cc.
+ * @return False if the file cannot be opened or parsed.
+ */
+inline bool loadConfig(Json::Value &config)
+{
+    std::ifstream ifs("./config.json");
+    Json::CharReaderBuilder builder;
+    JSONCPP_STRING errs;
+    if (!ifs.is_open() || !Json::parseFromStream(builder, ifs, &config, &errs))
+    {
+        std::cerr << "Failed to load config.json" << std::endl;
+        std::cerr << errs << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief The parameters used to render each template of config.json, the
+ * same ones used by test.cc. Every parameter a template prints is given, so
+ * that no render is timed on the path of a missing parameter.
+ */
+inline tl::sql::ParamList paramsFor(const std::string &name)
+{
+    if (name == "get_user_by_id")
+    {
+        return {{"user_id", 1}};
+    }
+    if (name == "get_user_paginated")
+    {
+        return {{"limit", 10}, {"offset", 300}};
+    }
+    if (name == "insert_user")
+    {
+        return {{"username", std::string("zhangsan")}};
+    }
+    if (name == "sub_sql_param" || name == "deep_param")
+    {
+        return {{"param", std::string("param")}};
+    }
+    if (name == "ignore_param")
+    {
+        return {{"param", std::string("ignore_param")}};
+    }
+    if (name == "object_param")
+    {
+        Json::Value address;
+        address["province"] = "hlj";
+        address["city"] = "sfh";
+        return {{"address", address}};
+    }
+    if (name == "array_param")
+    {
+        Json::Value address;
+        address[0] = "hlj";
+        address[1] = "sfh";
+        return {{"address", address}};
+    }
+    if (name == "array_object_param")
+    {
+        Json::Value users;
+        users[0]["name"] = "zhangsan";
+        users[0]["address"]["province"] = "hlj";
+        users[0]["address"]["city"] = "sfh";
+        users[1]["name"] = "lisi";
+        users[1]["address"]["province"] = "hlj";
+        users[1]["address"]["city"] = "mdj";
+        return {{"users", users}};
+    }
+    if (name == "array_object_param_with_array_param")
+    {
+        Json::Value users;
+        users[0]["name"] = "张三";
+        users[0]["address"][0] = "黑龙江";
+        users[0]["address"][1] = "绥芬河";
+        users[1]["name"] = "李四";
+        users[1]["address"][0] = "黑龙江";
+        users[1]["address"][1] = "牡丹江";
+        return {{"users", users}};
+    }
+    if (name == "get_menu_with_submenu")
+    {
+        return {{"menu_id", 1}};
+    }
+    if (name == "scalar_test")
+    {
+        Json::Value item;
+        item["weight"] = 2.5;
+        return {{"item", item}};
+    }
+    if (name == "for_block_test")
+    {
+        tl::sql::Int64Array ids(357, INT64_MIN);
+        ids[0] = 100;
+        return {{"ids", ids}};
+    }
+    if (name == "escape_test")
+    {
+        return {{"name", std::string("O'Brien")},
+                {"prefix", std::string("50%_off\\")},
+                {"column", std::string("we\"ird")}};
+    }
+    if (name == "mysql_escape_test")
+    {
+        return {{"name", std::string("\\' OR 1=1 -- ")},
+                {"prefix", std::string("50%_off\\")}};
+    }
+    if (name == "escape_default")
+    {
+        Json::Value user;
+        user["name"] = "it's";
+        return {{"user", user}, {"limit", 5}};
+    }
+    if (name == "json_scalar_test")
+    {
+        Json::Value user;
+        user["big"] = Json::UInt64(UINT64_MAX);
+        user["zero"] = 0.0;
+        return {{"x", Json::Value(5)},
+                {"big", Json::Value(Json::UInt64(UINT64_MAX))},
+                {"user", user},
+                {"name", Json::Value("it's")},
+                {"zero", Json::Value(0.0)}};
+    }
+    if (name == "keyword_names_test")
+    {
+        return {{"default", std::string("id")}, {"case", std::string("a")}};
+    }
+    if (name == "let_name_test")
+    {
+        Json::Value let;
+        let["let"] = "x";
+        return {{"let", let}};
+    }
+    if (name == "where_set_names_test")
+    {
+        return {{"set", std::string("'a'")}, {"where", 2}};
+    }
+    if (name == "switch_test")
+    {
+        return {{"sort_by", std::string("total")}};
+    }
+    if (name == "let_test")
+    {
+        Json::Value user;
+        user["address"]["province"] = "Hebei";
+        user["address"]["city"] = "Handan";
+        return {{"user", user}, {"limit", 10}};
+    }
+    if (name == "where_test")
+    {
+        return {{"state", 1},
+                {"title", std::string("t")},
+                {"author", std::string("a")}};
+    }
+    if (name == "set_test")
+    {
+        return {{"title", std::string("t")}, {"views", 10}, {"id", 1}};
+    }
+    if (name == "hoist_test")
+    {
+        Json::Value batch;
+        batch["id"] = 7;
+        return {{"batch", batch},
+                {"org", std::string("acme")},
+                {"items", tl::sql::IntArray{3, 1, 2}}};
+    }
+    if (name == "column_batch_test")
+    {
+        tl::sql::ColumnBatch users;
+        users.add("id", tl::sql::Int64Array{1, 2, 3})
+            .add("name", std::vector<std::string>{"Tom", "O'Neil", "Ann"})
+            .add("active", std::vector<bool>{true, false, true})
+            .add("score", std::vector<double>{9.5, 0, 7.25});
+        return {{"users", users}};
+    }
+    if (name == "specialize_test")
+    {
+        Json::Value columns(Json::arrayValue);
+        Json::Value column;
+        column["expr"] = "id";
+        column["name"] = "Id";
+        columns.append(column);
+        return {{"columns", columns},
+                {"org", std::string("acme")},
+                {"sort", std::string("date")},
+                {"status", std::string("paid")},
+                {"limit", 20}};
+    }
+    if (name == "whitespace_test")
+    {
+        return {{"id", 1}, {"name", std::string("b  c")}};
+    }
+    return {};
+}
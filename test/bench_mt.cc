@@ -0,0 +1,503 @@
+/**
+ * @file bench_mt.cc
+ * @brief Multi-threaded scaling benchmark of `SqlGenerator::getSql`.
+ *
+ * @author tanglong3bf
+ * @date 2026-10-17
+ * @version 0.6.11
+ *
+ * Like drogon IO loops, N pinned threads render SQL statements from one shared
+ * SqlGenerator at the same time. Each thread picks templates according to a
+ * weighted mix. For every thread count the benchmark reports throughput,
+ * p50/p99/p999 latency, allocations per render, optionally the time spent in
+ * the allocator (to reveal allocator contention) and, if the kernel allows
+ * it, cache misses read from Linux perf counters. No database is needed.
+ *
+ * Usage: ./bench_mt [--threads=1,2,4,...] [--duration=seconds]
+ *                   [--mix=name:weight,...] [--no-pin] [--alloc-timing]
+ *                   [--perf] [--metrics] [-o file]
+ *
+ * `--metrics` enables the render metrics registry, to measure its overhead.
+ */
+#include <json/value.h>
+#include <json/writer.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <thread>
+
+#include "../src/SqlGenerator.h"
+#include "bench_common.h"
+
+using namespace ::std;
+using namespace ::tl::sql;
+
+namespace
+{
+thread_local uint64_t allocNanos{0};  ///< Time spent in operator new.
+bool allocTiming{false};              ///< Whether allocNanos is measured.
+
+#ifdef TL_SQL_INSTRUMENTATION
+// The instrumentation mode of the library already replaces operator new and
+// counts allocations, but does not time them.
+size_t allocationsSoFar()
+{
+    return SqlGenerator::threadAllocationStats().allocations;
+}
+#else
+thread_local size_t allocCount{0};  ///< Calls to operator new.
+
+size_t allocationsSoFar()
+{
+    return allocCount;
+}
+#endif
+}  // namespace
+
+#ifndef TL_SQL_INSTRUMENTATION
+void *operator new(size_t size)
+{
+    ++allocCount;
+    void *ptr;
+    if (allocTiming)
+    {
+        auto start = chrono::steady_clock::now();
+        ptr = malloc(size == 0 ? 1 : size);
+        allocNanos += chrono::duration_cast<chrono::nanoseconds>(
+                          chrono::steady_clock::now() - start)
+                          .count();
+    }
+    else
+    {
+        ptr = malloc(size == 0 ? 1 : size);
+    }
+    if (!ptr)
+    {
+        throw bad_alloc();
+    }
+    return ptr;
+}
+
+// Not inlined, so that GCC pairs delete expressions with operator new rather
+// than with the free() inside
+[[gnu::noinline]] void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+#endif
+
+namespace
+{
+/**
+ * @brief Per-thread hardware counters read with perf_event_open.
+ */
+class PerfCounters
+{
+  public:
+    PerfCounters()
+    {
+        leader_ = open(PERF_COUNT_HW_CACHE_MISSES, -1);
+        if (leader_ >= 0)
+        {
+            member_ = open(PERF_COUNT_HW_CACHE_REFERENCES, leader_);
+        }
+    }
+
+    ~PerfCounters()
+    {
+        if (member_ >= 0)
+        {
+            close(member_);
+        }
+        if (leader_ >= 0)
+        {
+            close(leader_);
+        }
+    }
+
+    bool available() const
+    {
+        return leader_ >= 0 && member_ >= 0;
+    }
+
+    void start()
+    {
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    /// Returns {cache misses, cache references}.
+    pair<uint64_t, uint64_t> stop()
+    {
+        ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t values[3]{};  // nr, misses, references
+        if (read(leader_, values, sizeof(values)) != sizeof(values))
+        {
+            return {0, 0};
+        }
+        return {values[1], values[2]};
+    }
+
+  private:
+    static int open(uint64_t config, int group)
+    {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = group < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return static_cast<int>(
+            syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+    }
+
+    int leader_{-1};
+    int member_{-1};
+};
+
+/**
+ * @brief A template in the mix, with its parameters and weight.
+ */
+struct MixItem
+{
+    string name;
+    ParamList params;
+    double weight;
+};
+
+/**
+ * @brief What a worker thread measured.
+ */
+struct WorkerResult
+{
+    LatencyHistogram latency;
+    uint64_t ops{0};
+    uint64_t allocs{0};
+    uint64_t allocNanos{0};
+    uint64_t cacheMisses{0};
+    uint64_t cacheReferences{0};
+    bool perfAvailable{false};
+};
+
+/**
+ * @brief Parses "a:1,b:2" into {{"a", 1}, {"b", 2}}.
+ */
+vector<pair<string, double>> parseMix(const string &spec)
+{
+    vector<pair<string, double>> result;
+    stringstream ss(spec);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        auto colon = item.find(':');
+        if (colon == string::npos)
+        {
+            result.emplace_back(item, 1.0);
+        }
+        else
+        {
+            result.emplace_back(item.substr(0, colon),
+                                atof(item.c_str() + colon + 1));
+        }
+    }
+    return result;
+}
+
+vector<size_t> parseThreads(const string &spec)
+{
+    vector<size_t> result;
+    stringstream ss(spec);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        result.emplace_back(stoul(item));
+    }
+    return result;
+}
+
+void pinToCpu(size_t index)
+{
+    auto cpus = thread::hardware_concurrency();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % (cpus ? cpus : 1), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/**
+ * @brief Runs `threads` workers against `generator` for `duration` seconds.
+ */
+Json::Value runScenario(SqlGenerator &generator,
+                        const vector<MixItem> &mix,
+                        size_t threads,
+                        double duration,
+                        bool pin,
+                        bool perf)
+{
+    vector<double> cumulative;
+    double sum = 0;
+    for (const auto &item : mix)
+    {
+        sum += item.weight;
+        cumulative.emplace_back(sum);
+    }
+
+    atomic<size_t> ready{0};
+    atomic<bool> start{false};
+    atomic<bool> stop{false};
+    vector<WorkerResult> results(threads);
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t] {
+            if (pin)
+            {
+                pinToCpu(t);
+            }
+            auto &result = results[t];
+            optional<PerfCounters> counters;
+            if (perf)
+            {
+                counters.emplace();
+                result.perfAvailable = counters->available();
+            }
+            uint64_t seed = 0x9e3779b97f4a7c15ull * (t + 1);
+            ready.fetch_add(1);
+            while (!start.load(memory_order_acquire))
+            {
+                this_thread::yield();
+            }
+            auto allocs = allocationsSoFar();
+            auto nanos = allocNanos;
+            if (result.perfAvailable)
+            {
+                counters->start();
+            }
+            while (!stop.load(memory_order_relaxed))
+            {
+                // xorshift64
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                auto r = (seed >> 11) * (1.0 / 9007199254740992.0) * sum;
+                size_t i = 0;
+                while (i + 1 < cumulative.size() && cumulative[i] <= r)
+                {
+                    ++i;
+                }
+                auto begin = chrono::steady_clock::now();
+                auto sql = generator.getSql(mix[i].name, mix[i].params);
+                auto end = chrono::steady_clock::now();
+                result.latency.add(LatencyHistogram::bucketIndex(
+                    chrono::duration_cast<chrono::nanoseconds>(end - begin)
+                        .count()));
+                ++result.ops;
+            }
+            if (result.perfAvailable)
+            {
+                tie(result.cacheMisses, result.cacheReferences) =
+                    counters->stop();
+            }
+            result.allocs = allocationsSoFar() - allocs;
+            result.allocNanos = allocNanos - nanos;
+        });
+    }
+    while (ready.load() < threads)
+    {
+        this_thread::yield();
+    }
+    auto begin = chrono::steady_clock::now();
+    start.store(true, memory_order_release);
+    this_thread::sleep_for(chrono::duration<double>(duration));
+    stop.store(true);
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+
+    WorkerResult total;
+    total.perfAvailable = perf;
+    for (const auto &result : results)
+    {
+        total.latency.merge(result.latency);
+        total.ops += result.ops;
+        total.allocs += result.allocs;
+        total.allocNanos += result.allocNanos;
+        total.cacheMisses += result.cacheMisses;
+        total.cacheReferences += result.cacheReferences;
+        total.perfAvailable = total.perfAvailable && result.perfAvailable;
+    }
+    Json::Value json;
+    json["threads"] = Json::UInt64(threads);
+    json["ops"] = Json::UInt64(total.ops);
+    json["ops_per_s"] = total.ops / elapsed.count();
+    json["p50_ns"] = Json::UInt64(total.latency.quantile(0.5));
+    json["p99_ns"] = Json::UInt64(total.latency.quantile(0.99));
+    json["p999_ns"] = Json::UInt64(total.latency.quantile(0.999));
+    json["allocs_per_op"] = double(total.allocs) / total.ops;
+    if (allocTiming)
+    {
+        json["alloc_ns_per_call"] = double(total.allocNanos) / total.allocs;
+        json["alloc_ns_per_op"] = double(total.allocNanos) / total.ops;
+    }
+    if (perf)
+    {
+        if (total.perfAvailable)
+        {
+            json["cache_misses_per_op"] =
+                double(total.cacheMisses) / total.ops;
+            json["cache_references_per_op"] =
+                double(total.cacheReferences) / total.ops;
+        }
+        else
+        {
+            json["perf"] = "unavailable";
+        }
+    }
+    return json;
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    vector<size_t> threadCounts{1, 2, 4, 8, 16, 32, 64};
+    double duration = 1.0;
+    string mixSpec;
+    bool pin = true;
+    bool perf = false;
+    bool metrics = false;
+    string output;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg.rfind("--threads=", 0) == 0)
+        {
+            threadCounts = parseThreads(arg.substr(10));
+        }
+        else if (arg.rfind("--duration=", 0) == 0)
+        {
+            duration = atof(arg.c_str() + 11);
+        }
+        else if (arg.rfind("--mix=", 0) == 0)
+        {
+            mixSpec = arg.substr(6);
+        }
+        else if (arg == "--no-pin")
+        {
+            pin = false;
+        }
+        else if (arg == "--alloc-timing")
+        {
+#ifdef TL_SQL_INSTRUMENTATION
+            cerr << "--alloc-timing is not supported with INSTRUMENT=1"
+                 << endl;
+            return 1;
+#else
+            allocTiming = true;
+#endif
+        }
+        else if (arg == "--perf")
+        {
+            perf = true;
+        }
+        else if (arg == "--metrics")
+        {
+            metrics = true;
+        }
+        else if (arg == "-o" && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0]
+                 << " [--threads=1,2,4,...] [--duration=seconds]"
+                    " [--mix=name:weight,...] [--no-pin] [--alloc-timing]"
+                    " [--perf] [--metrics] [-o file]"
+                 << endl;
+            return 1;
+        }
+    }
+
+    Json::Value config;
+    if (!loadConfig(config))
+    {
+        return 1;
+    }
+    config.removeMember("metrics");
+    config.removeMember("profiler");
+    config.removeMember("slow_render_log");
+    config.removeMember("async_render");
+    SqlGenerator generator;
+    generator.initAndStart(config);
+    if (metrics)
+    {
+        generator.enableMetrics();
+    }
+
+    vector<MixItem> mix;
+    if (mixSpec.empty())
+    {
+        for (const auto &name : config["sqls"].getMemberNames())
+        {
+            mix.push_back({name, paramsFor(name), 1.0});
+        }
+    }
+    else
+    {
+        for (const auto &[name, weight] : parseMix(mixSpec))
+        {
+            if (!config["sqls"].isMember(name))
+            {
+                cerr << "Unknown template: " << name << endl;
+                return 1;
+            }
+            mix.push_back({name, paramsFor(name), weight});
+        }
+    }
+
+    Json::Value report;
+    report["duration"] = duration;
+    report["pinned"] = pin;
+    report["metrics"] = metrics;
+    report["hardware_concurrency"] = thread::hardware_concurrency();
+    for (const auto &item : mix)
+    {
+        report["mix"][item.name] = item.weight;
+    }
+    for (auto threads : threadCounts)
+    {
+        report["results"].append(
+            runScenario(generator, mix, threads, duration, pin, perf));
+    }
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "  ";
+    if (output.empty())
+    {
+        cout << Json::writeString(writer, report) << endl;
+    }
+    else
+    {
+        ofstream(output) << Json::writeString(writer, report) << endl;
+    }
+    return 0;
+}
@@ -1,9 +1,12 @@
 #include <json/value.h>
 #include <json/reader.h>
 #include <fstream>
+#include <future>
 #include <iostream>
 
 #include "../src/SqlGenerator.h"
+#include "../src/InsertCoalescer.h"
+#include "../src/StatementPipeline.h"
 
 using namespace ::std;
 using namespace ::tl::sql;
@@ -63,6 +66,51 @@ int main()
     printTokens("insert_user");
     printAST("insert_user");
     getSqlAndPrint("insert_user", {{"username", string("zhangsan")}});
+    std::cout << "Insert SQL of insert_user with 3 rows: " << std::endl;
+    std::cout << "\033[92m"
+              << sqlGenerator.getInsertSql(
+                     "insert_user",
+                     {{{"username", string("zhangsan")}},
+                      {{"username", string("lisi")}, {"password", string("x")}},
+                      {{"username", string("wangwu")}}})
+              << "\033[0m" << std::endl;
+    {
+        // Flushed at 3 rows, the last row when the coalescer is destroyed
+        InsertCoalescer coalescer(
+            sqlGenerator,
+            [](CoalescedInsert insert) {
+                std::cout << "Coalesced " << insert.rows << " rows of "
+                          << insert.name << ": " << insert.sql << std::endl;
+            },
+            3,
+            std::chrono::milliseconds(0));
+        for (int i = 0; i < 7; ++i)
+        {
+            coalescer.add("insert_user",
+                          {{"username", "user" + std::to_string(i)}});
+        }
+        std::cout << "Pending rows: " << coalescer.pendingRows() << std::endl;
+    }
+    {
+        // A fake database client which completes each statement after 1 ms
+        auto execute = [](Statement statement,
+                          StatementPipeline::DoneCallback done) {
+            std::thread([statement = std::move(statement), done] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                std::cout << "Executed: " << statement.sql << " with $1 = "
+                          << std::get<std::string>(statement.args[0])
+                          << std::endl;
+                done(nullptr);
+            }).detach();
+        };
+        StatementPipeline pipeline(sqlGenerator, execute, 2);
+        for (int i = 0; i < 3; ++i)
+        {
+            pipeline.submit("insert_user",
+                            {{"username", "user" + std::to_string(i)}});
+        }
+        pipeline.wait();
+    }
 
     printTokens("get_height_more_than_avg");
     printAST("get_height_more_than_avg");
@@ -143,6 +191,194 @@ int main()
     printTokens("for_test2");
     printAST("for_test2");
     getSqlAndPrint("for_test2");
+    getSqlAndPrint("for_test2",
+                   {{"ids", IntArray{INT32_MIN, -1, 0, 9, 10, INT32_MAX}}});
+    getSqlAndPrint("for_test2",
+                   {{"ids", Int64Array{INT64_MIN, -10000000000, 99, 100}}});
+
+    // "(100" and 356 times "),(" and INT64_MIN fill the 8192 bytes of a
+    // formatting block of appendDecimals exactly, leaving the last ")"
+    Int64Array blockIds(357, INT64_MIN);
+    blockIds[0] = 100;
+    auto blockSql = sqlGenerator.getSql("for_block_test", {{"ids", blockIds}});
+    std::cout << "Length of for_block_test: " << blockSql.size() << ", ends with "
+              << blockSql.back() << std::endl;
+
+    printTokens("scalar_test");
+    printAST("scalar_test");
+    Json::Value item;
+    item["weight"] = 1e21;
+    getSqlAndPrint("scalar_test", {{"item", item}});
+    item["weight"] = 2.5;
+    getSqlAndPrint("scalar_test",
+                   {{"item", item},
+                    {"price", 19.99},
+                    {"in_stock", false},
+                    {"id", int64_t{-4294967296}}});
+
+    printTokens("escape_test");
+    printAST("escape_test");
+    getSqlAndPrint("escape_test",
+                   {{"name", string("O'Brien")},
+                    {"prefix", string("50%_off\\")},
+                    {"column", string("we\"ird")}});
+
+    getSqlAndPrint("mysql_escape_test",
+                   {{"name", string("\\' OR 1=1 -- ")},
+                    {"prefix", string("50%_off\\")}});
+
+    printAST("escape_default");
+    Json::Value user;
+    user["name"] = "it's";
+    getSqlAndPrint("escape_default", {{"user", user}, {"limit", 5}});
+
+    printTokens("switch_test");
+    printAST("switch_test");
+    getSqlAndPrint("switch_test", {{"sort_by", string("date")}});
+    getSqlAndPrint("switch_test", {{"sort_by", string("total")}});
+    getSqlAndPrint("switch_test", {{"sort_by", true}});
+    getSqlAndPrint("switch_test", {{"sort_by", string("1")}});
+    getSqlAndPrint("switch_test", {});
+
+    // Top-level JSON scalars behave like members of a JSON object
+    Json::Value scalars;
+    scalars["big"] = Json::UInt64(UINT64_MAX);
+    scalars["zero"] = 0.0;
+    getSqlAndPrint("json_scalar_test",
+                   {{"x", Json::Value(5)},
+                    {"big", Json::Value(Json::UInt64(UINT64_MAX))},
+                    {"user", scalars},
+                    {"name", Json::Value("it's")},
+                    {"zero", Json::Value(0.0)}});
+
+    // The keywords of directives are only keywords right after @
+    printTokens("keyword_names_test");
+    getSqlAndPrint("keyword_names_test",
+                   {{"default", string("id")}, {"case", string("a")}});
+    getSqlAndPrint("keyword_names_test",
+                   {{"default", string("id")}, {"case", string("b")}});
+    Json::Value let;
+    let["let"] = "x";
+    getSqlAndPrint("let_name_test", {{"let", let}});
+    getSqlAndPrint("where_set_names_test",
+                   {{"set", string("'a'")}, {"where", 2}});
+
+    printAST("let_test");
+    Json::Value address;
+    address["province"] = "Hebei";
+    address["city"] = "Handan";
+    user["address"] = address;
+    getSqlAndPrint("let_test", {{"user", user}, {"limit", 10}});
+
+    printTokens("where_test");
+    printAST("where_test");
+    getSqlAndPrint("where_test", {});
+    getSqlAndPrint("where_test", {{"title", string("t")}});
+    getSqlAndPrint("where_test", {{"author", string("a")}});
+    getSqlAndPrint("where_test",
+                   {{"state", 1},
+                    {"title", string("t")},
+                    {"author", string("a")}});
+    printAST("set_test");
+    getSqlAndPrint("set_test", {{"title", string("t")}, {"id", 1}});
+    getSqlAndPrint("set_test",
+                   {{"title", string("t")}, {"views", 10}, {"id", 1}});
+
+    printAST("hoist_test");
+    Json::Value batch;
+    batch["id"] = 7;
+    getSqlAndPrint("hoist_test",
+                   {{"batch", batch},
+                    {"org", string("acme")},
+                    {"items", IntArray{3, 1, 2}}});
+
+    // Rows given as columns, without an object per row
+    ColumnBatch users;
+    users.add("id", Int64Array{1, 2, 3})
+        .add("name", std::vector<std::string>{"Tom", "O'Neil", "Ann"})
+        .add("active", std::vector<bool>{true, false, true})
+        .add("score", std::vector<double>{9.5, 0, 7.25});
+    printAST("column_batch_test");
+    getSqlAndPrint("column_batch_test", {{"users", users}});
+    auto batchStatement =
+        sqlGenerator.getStatement("column_batch_test", {{"users", users}});
+    std::cout << batchStatement.sql << " with "
+              << batchStatement.args.size() << " args" << std::endl;
+
+    printAST("whitespace_test");
+    getSqlAndPrint("whitespace_test", {{"id", 1}});
+    getSqlAndPrint("whitespace_test", {{"id", 1}, {"name", string("b  c")}});
+
+    // The columns, the tenant and the order of a report are fixed once
+    Json::Value columns(Json::arrayValue);
+    Json::Value column;
+    column["expr"] = "id";
+    column["name"] = "Id";
+    columns.append(column);
+    column["expr"] = "amount / 100.0";
+    column["name"] = "Amount";
+    columns.append(column);
+    ParamList bound{{"columns", columns},
+                    {"org", string("acme")},
+                    {"sort", string("date")}};
+    auto report = sqlGenerator.specialize("specialize_test", bound);
+    std::cout << "AST of specialize_test specialized:" << std::endl;
+    report->printAST();
+    std::cout << "Specialized SQL of specialize_test: " << std::endl;
+    std::cout << "\033[92m"
+              << report->getSql({{"status", string("paid")}, {"limit", 20}})
+              << "\033[0m" << std::endl;
+    bound.emplace("status", string("paid"));
+    bound.emplace("limit", 20);
+    getSqlAndPrint("specialize_test", bound);
+
+    for (const auto* name : {"if_else_test", "where_test"})
+    {
+        auto shapes = sqlGenerator.enumerateShapes(name);
+        std::cout << "Shapes of " << name << " (complete: " << std::boolalpha
+                  << shapes.complete << "):" << std::endl;
+        for (const auto& shape : shapes.shapes)
+        {
+            std::cout << "\033[92m" << shape.sql << "\033[0m";
+            for (const auto& param : shape.params)
+            {
+                std::cout << " " << param;
+            }
+            std::cout << std::endl;
+        }
+    }
+    auto statement = sqlGenerator.getStatement("if_else_test",
+                                               {{"title", string("标题")}});
+    std::cout << "Statement of if_else_test: " << std::endl;
+    std::cout << "\033[92m" << statement.sql << "\033[0m" << std::endl;
+    std::cout << "Arguments: " << statement.args.size() << std::endl;
+
+    // Bound LIKE patterns keep their escaping, identifiers stay text
+    statement = sqlGenerator.getStatement("escape_test",
+                                          {{"name", string("O'Brien")},
+                                           {"prefix", string("50%_off")},
+                                           {"column", string("id")}});
+    std::cout << "Statement of escape_test: " << std::endl;
+    std::cout << "\033[92m" << statement.sql << "\033[0m";
+    for (const auto& arg : statement.args)
+    {
+        std::cout << " " << get<string>(arg);
+    }
+    std::cout << std::endl;
+    for (const auto& shape : sqlGenerator.enumerateShapes("escape_test").shapes)
+    {
+        std::cout << "Shape of escape_test: " << shape.sql << std::endl;
+    }
+
+    // Renders which only differ in their values share a fingerprint
+    for (const auto& params : {ParamList{{"state", 1}, {"title", string("a")}},
+                               ParamList{{"state", 2}, {"title", string("b")}},
+                               ParamList{{"title", string("a")}}})
+    {
+        auto result = sqlGenerator.getSqlWithFingerprint("where_test", params);
+        std::cout << "Fingerprint " << std::hex << result.fingerprint
+                  << std::dec << " of: " << result.sql << std::endl;
+    }
 
     printTokens("get_menu_with_submenu");
     printAST("get_menu_with_submenu");
@@ -154,5 +390,67 @@ int main()
     printAST("get_menu_with_submenu", "child_nodes");
     getSqlAndPrint("get_menu_with_submenu", {{"menu_id", 1}});
 
+    std::cout << "Profile of get_menu_with_submenu (output bytes):"
+              << std::endl;
+    std::cout << sqlGenerator.profiler().foldedStacks(
+        ProfileMetric::OutputBytes);
+
+    std::cout << "Most expensive templates:" << std::endl;
+    for (const auto& stats : sqlGenerator.compileStats())
+    {
+        std::cout << stats.name << ": tokens=" << stats.tokens
+                  << ", nodes=" << stats.astNodes
+                  << ", sub_sql_depth=" << stats.subSqlDepth
+                  << ", loop_depth=" << stats.loopDepth
+                  << ", literal_bytes=" << stats.literalBytes
+                  << ", estimate=" << stats.baseBytes << "+"
+                  << stats.perIterationBytes << "n" << std::endl;
+    }
+
+    // for_test2 is estimated above min_bytes in config.json, so it is
+    // rendered by the worker pool
+    std::promise<std::string> asyncSql;
+    sqlGenerator.getSqlAsync(
+        "for_test2",
+        {},
+        [&asyncSql](std::string sql) { asyncSql.set_value(std::move(sql)); },
+        [&asyncSql](const std::exception_ptr& e) {
+            asyncSql.set_exception(e);
+        });
+    std::cout << "Async SQL of for_test2: " << std::endl;
+    std::cout << "\033[92m" << asyncSql.get_future().get() << "\033[0m"
+              << std::endl;
+
+    // Parameters and output allocated from one per-request arena
+    std::pmr::monotonic_buffer_resource arena;
+    tl::sql::pmr::ParamList arenaParams(&arena);
+    arenaParams.emplace("user_id", 1);
+    std::pmr::string arenaSql(&arena);
+    sqlGenerator.renderInto("get_user_by_id", arenaParams, arenaSql);
+    std::cout << "Arena SQL of get_user_by_id: " << std::endl;
+    std::cout << "\033[92m" << arenaSql << "\033[0m" << std::endl;
+
+    std::cout << "Render metrics:" << std::endl;
+    for (const auto& metrics : sqlGenerator.metrics()->snapshot())
+    {
+        std::cout << metrics.name << ": renders=" << metrics.renders
+                  << ", errors=" << metrics.errors
+                  << ", output_bytes=" << metrics.outputBytes << std::endl;
+    }
+
+    // The threshold in config.json is 0, so the last renders are kept
+    std::cout << "Slow renders:" << std::endl;
+    for (const auto& render : sqlGenerator.slowRenderLog()->entries())
+    {
+        std::cout << render.name << ": output_bytes=" << render.outputBytes
+                  << ", params=" << render.paramShape
+                  << ", param_depth=" << render.paramDepth;
+        for (const auto& [loop, iterations] : render.loops)
+        {
+            std::cout << ", " << loop << "=" << iterations;
+        }
+        std::cout << std::endl;
+    }
+
     return 0;
 }